@@ -10,10 +10,14 @@
 #include "Config.hpp"
 
 #include "ValueJson.hpp"
+#include "ValueJsonInternal.hpp"
 #include "ValueYaml.hpp"
 
+#include "Parallel.hpp"
 #include "Path.hpp"
 
+#include "external/unordered_dense.h" // requires 64-bit well-mixed hash
+
 #include "math.h"
 
 using namespace HL;
@@ -25,6 +29,33 @@ namespace
     const char* const kYamlExtensions[] = { ".yaml", ".yml", 0 };
 #endif
 
+    int NumThreads(const ConfigInfo* info)
+    {
+        return info ? NumThreadsToUse(info->mThreads) : 1;
+    }
+
+    ArrayValue* UniqueArrayPtr(Value* v)
+    // Returns v's array for modification. Shared arrays are meant to be read-only, and another owner could be being
+    // processed at the same time, so if the elements may be modified, the array is copied first.
+    {
+        ArrayValue* av = v->AsArrayPtr();
+
+        if (!av || av->RefCount() == 1)
+            return av;
+
+        bool hasContainers = false;
+
+        for (const Value& elt : *av)
+            if (elt.IsObject() || elt.IsArray())
+                hasContainers = true;
+
+        if (!hasContainers)
+            return av;
+
+        *v = Value(CreateArrayValue(av->count, av->Elts()));
+        return v->AsArrayPtr();
+    }
+
     // Templates support
     bool ApplyTemplatesInternal(Value& objects, Value* target, String* errors)
     {
@@ -60,7 +91,7 @@ namespace
         return true;
     }
 
-    bool ApplyTemplates(Value* objects, String* errors)
+    bool ApplyTemplates(Value* objects, String* errors, int numThreads = 1)
     {
         bool success = true;
 
@@ -76,12 +107,40 @@ namespace
                 if (member.value.IsObject() && !ApplyTemplatesInternal(*objects, &member.value, errors))
                     success = false;
 
-            for (NameValue member : *ov)
-                if (!ApplyTemplates(&member.value, errors))
-                    success = false;
+            if (numThreads > 1)
+            {
+                // The members are now independent of one another, so can be expanded in parallel. Errors are
+                // gathered per member and appended in order, so the result is the same as the serial case.
+                std::vector<Value*> members;
+                for (NameValue member : *ov)
+                    members.push_back(&member.value);
+
+                int n = size_i(members);
+                std::vector<String> memberErrors(errors ? n : 0);
+                std::vector<uint8_t> memberSuccess(n);
+
+                ParallelFor(n, numThreads,
+                    [&](int i)
+                    {
+                        memberSuccess[i] = ApplyTemplates(members[i], errors ? &memberErrors[i] : nullptr);
+                    }
+                );
+
+                for (int i = 0; i < n; i++)
+                {
+                    if (!memberSuccess[i])
+                        success = false;
+                    if (errors)
+                        *errors += memberErrors[i];
+                }
+            }
+            else
+                for (NameValue member : *ov)
+                    if (!ApplyTemplates(&member.value, errors))
+                        success = false;
         }
 
-        ArrayValue* av = objects->AsArrayPtr();
+        ArrayValue* av = UniqueArrayPtr(objects);
         if (av)
             for (Value& v : *av)
                 if (!ApplyTemplates(&v, errors))
@@ -96,7 +155,7 @@ namespace
     // Imports support
     typedef bool FileLoader(const char* path, Value* value, String* errors, StringTable* st);
 
-    bool AddImports(FileLoader loader, const char* basePath, Value* value, String* errors, ConfigInfo* info);
+    bool AddImports(FileLoader loader, const char* basePath, Value* value, String* errors, ConfigInfo* info, int numThreads = 1);
 
     bool LoadImport
     (
@@ -198,14 +257,58 @@ namespace
         return success;
     }
 
-    bool AddImports(FileLoader loader, const char* basePath, Value* value, String* errors, ConfigInfo* info)
+    bool AddImportsParallel(FileLoader loader, const char* basePath, const std::vector<Value*>& children, String* errors, ConfigInfo* info, int numThreads)
     {
+        // Each child gets its own errors and import list, which are merged in order afterwards, so the results are the
+        // same as the serial case. The string table isn't thread safe, so isn't used here.
+        int n = size_i(children);
+        std::vector<String> childErrors(errors ? n : 0);
+        std::vector<ConfigInfo> childInfos(info ? n : 0);
+        std::vector<uint8_t> childSuccess(n);
+
+        for (ConfigInfo& childInfo : childInfos)
+            childInfo.mVariant = info->mVariant;
+
+        ParallelFor(n, numThreads,
+            [&](int i)
+            {
+                childSuccess[i] = AddImports(loader, basePath, children[i], errors ? &childErrors[i] : nullptr, info ? &childInfos[i] : nullptr);
+            }
+        );
+
         bool success = true;
 
-        ArrayValue* av = value->AsArrayPtr();
+        for (int i = 0; i < n; i++)
+        {
+            if (!childSuccess[i])
+                success = false;
+            if (errors)
+                *errors += childErrors[i];
+            if (info)
+                for (const String& import : childInfos[i].mImports)
+                    info->mImports.insert(import);
+        }
+
+        return success;
+    }
+
+    bool AddImports(FileLoader loader, const char* basePath, Value* value, String* errors, ConfigInfo* info, int numThreads)
+    {
+        bool success = true;
+
+        ArrayValue* av = UniqueArrayPtr(value);
 
         if (av)
         {
+            if (numThreads > 1)
+            {
+                std::vector<Value*> children;
+                for (Value& childValue : *av)
+                    children.push_back(&childValue);
+
+                return AddImportsParallel(loader, basePath, children, errors, info, numThreads);
+            }
+
             for (Value& childValue : *av)
                 if (!AddImports(loader, basePath, &childValue, errors, info))
                     success = false;
@@ -218,9 +321,18 @@ namespace
         if (!ov)
             return success;
 
-        for (NameValue member : *ov)
-            if (!AddImports(loader, basePath, &member.value, errors, info))
-                success = false;
+        if (numThreads > 1)
+        {
+            std::vector<Value*> children;
+            for (NameValue member : *ov)
+                children.push_back(&member.value);
+
+            success = AddImportsParallel(loader, basePath, children, errors, info, numThreads);
+        }
+        else
+            for (NameValue member : *ov)
+                if (!AddImports(loader, basePath, &member.value, errors, info))
+                    success = false;
 
         const Value& importValues = value->Member("import");
 
@@ -317,10 +429,10 @@ namespace
                 info->mImports.clear();
             }
 
-            success = AddImports(loader, PathLocation(path), config, errors, info);
+            success = AddImports(loader, PathLocation(path), config, errors, info, NumThreads(info));
         }
 
-        if (!ApplyTemplates(config, errors))
+        if (!ApplyTemplates(config, errors, NumThreads(info)))
             success = false;
 
         if (!success && errors)
@@ -391,10 +503,206 @@ bool HL::SaveConfig(FILE* file, const Value& config, const char* type, String* e
     return false;
 }
 
+namespace
+{
+    // Settings support. Settings are first collected into a tree of overrides, so that a large batch of them can be
+    // applied in one pass over each object affected, rather than with a search and insert per setting.
+    struct SettingNode
+    {
+        ValueKeySpan     field;             // Slice of the setting name, e.g., "b" or "[2]"
+        bool             isIndex  = false;  // Whether 'field' is "[n]"
+        bool             detached = false;  // Whether a later setting of a parent has replaced this
+        bool             hasValue = false;
+        Value            value;
+        std::vector<int> children;
+    };
+
+    struct SettingKey
+    {
+        int          parent;
+        ValueKeySpan field;
+
+        bool operator == (const SettingKey& other) const
+        {
+            return parent == other.parent && field.size == other.field.size && memcmp(field.data, other.field.data, field.size) == 0;
+        }
+    };
+
+    struct SettingKeyHash
+    {
+        typedef size_t HashType;
+
+        using is_avalanching = void;
+
+        HashType operator () (const SettingKey& key) const
+        {
+            uint32_t hashValue = UINT32_C(0x811C9DC5) ^ uint32_t(key.parent);
+
+            for (size_t i = 0; i < key.field.size; i++)
+                hashValue = (hashValue ^ uint8_t(key.field.data[i])) * 0x01000193;
+
+            return hashValue * UINT64_C(0x9ddfea08eb382d69);
+        }
+    };
+
+    inline const char* PathFieldEnd(const char* field, const char* pathEnd)
+    // Returns the end of the dotted member name or [n] index starting at 'field'
+    {
+        const char* fieldEnd = field + 1;
+
+        if (*field == '[')
+        {
+            while (fieldEnd < pathEnd && fieldEnd[-1] != ']')
+                fieldEnd++;
+        }
+        else
+        {
+            while (fieldEnd < pathEnd && *fieldEnd != '.' && *fieldEnd != '[')
+                fieldEnd++;
+        }
+
+        return fieldEnd;
+    }
+
+    inline bool FieldLess(ValueKeySpan a, ValueKeySpan b)
+    {
+        int c = memcmp(a.data, b.data, a.size < b.size ? a.size : b.size);
+        return c < 0 || (c == 0 && a.size < b.size);
+    }
+
+    struct SettingsTree
+    {
+        std::vector<SettingNode> mNodes = std::vector<SettingNode>(1);  // mNodes[0] is the root
+        ankerl::dense_hash_map<SettingKey, int, SettingKeyHash> mChildren;
+
+        void Add(const char* name, const char* nameEnd, Value&& value);  // Adds setting for the given member path
+        void Apply(int node, Value* v);                                   // Applies 'node' and its children to 'v'
+    };
+
+    void SettingsTree::Add(const char* name, const char* nameEnd, Value&& value)
+    {
+        int node = 0;
+
+        // Walk the dotted member names and [n] indices in place, skipping empty names
+        for (const char* field = name; field < nameEnd; )
+        {
+            if (*field == '.')
+            {
+                field++;
+                continue;
+            }
+
+            const char* fieldEnd = PathFieldEnd(field, nameEnd);
+
+            SettingKey key = { node, { field, size_t(fieldEnd - field) } };
+            auto it = mChildren.find(key);
+
+            if (it != mChildren.end() && !mNodes[it->second].detached)
+                node = it->second;
+            else
+            {
+                int child = size_i(mNodes);
+
+                mNodes.emplace_back();
+                mNodes.back().field = key.field;
+                mNodes.back().isIndex = (*field == '[');
+                mNodes[node].children.push_back(child);
+
+                mChildren[key] = child;
+                node = child;
+            }
+
+            field = fieldEnd;
+        }
+
+        // This replaces anything set within it by earlier settings
+        SettingNode& result = mNodes[node];
+
+        for (int child : result.children)
+            mNodes[child].detached = true;
+
+        result.children.clear();
+        result.hasValue = true;
+        result.value = std::move(value);
+    }
+
+    void SettingsTree::Apply(int index, Value* v)
+    {
+        SettingNode& node = mNodes[index];
+
+        if (node.hasValue)
+            *v = std::move(node.value);
+
+        if (node.children.empty())
+            return;
+
+        // As per UpdateMemberPath(), [n] fields index into arrays, and are otherwise member names
+        std::vector<int> memberNodes;
+
+        for (int child : node.children)
+        {
+            const SettingNode& childNode = mNodes[child];
+
+            if (!childNode.isIndex || !v->IsArray())
+            {
+                memberNodes.push_back(child);
+                continue;
+            }
+
+            char* end = nullptr;
+            long long i = strtoll(childNode.field.data + 1, &end, 10);
+
+            if (*end != ']' || i < 0 || i >= v->NumElts())
+            {
+                HL_ERROR("Setting index out of range");
+                continue;
+            }
+
+            // Shared arrays are read-only, so copy before modifying
+            ArrayValue* av = v->AsArrayPtr();
+
+            if (av->RefCount() > 1)
+            {
+                *v = Value(CreateArrayValue(av->count, av->Elts()));
+                av = v->AsArrayPtr();
+            }
+
+            Apply(child, &(*av)[i]);
+        }
+
+        if (memberNodes.empty())
+            return;
+
+        if (!v->ToObject())
+        {
+            HL_ERROR("Can't insert a member on a non-object");
+            return;
+        }
+
+        std::sort(memberNodes.begin(), memberNodes.end(),
+            [this](int a, int b) { return FieldLess(mNodes[a].field, mNodes[b].field); }
+        );
+
+        int n = size_i(memberNodes);
+        std::vector<ValueKeySpan> keys(n);
+        std::vector<Value*> members(n);
+
+        for (int i = 0; i < n; i++)
+            keys[i] = mNodes[memberNodes[i]].field;
+
+        v->AsObjectPtr()->UpdateMembers(n, keys.data(), members.data());
+
+        for (int i = 0; i < n; i++)
+            Apply(memberNodes[i], members[i]);
+    }
+}
+
 bool HL::ApplySettings(int numSettings, const char* const settings[], Value* config, String* errors)
 {
-    Value settingsValue;
-    Strings members;
+    SettingsTree tree;
+    JsonReader reader;
+    String quotedMemberValueStr;
+    bool success = true;
 
     for (int i = 0; i < numSettings; i++)
     {
@@ -404,51 +712,250 @@ bool HL::ApplySettings(int numSettings, const char* const settings[], Value* con
             assignChar = strchr(settings[i], ':');
 
         const char* memberValueStr = 0;
+        const char* nameEnd = assignChar;
 
         if (!assignChar)
-            members = Split(settings[i], ".");
+            nameEnd = settings[i] + strlen(settings[i]);
         else
         {
             memberValueStr = assignChar + 1;
             while (*memberValueStr == ' ')
                 memberValueStr++;
-
-            String name(settings[i], assignChar);
-            members = Split(name, ".");
         }
 
-        Value* v = config;
-
-        for (const char* memberName : members)
-            v = &v->UpdateMember(memberName);
+        Value memberValue;
 
         if (!memberValueStr)
-        {
-            *v = true;
-            continue;
-        }
-
-        String quotedMemberValueStr;
-
-        if ( strchr("[{-\"", memberValueStr[0]) == nullptr
+            memberValue = true;
+        else if ( strchr("[{-\"", memberValueStr[0]) == nullptr
                 && !isdigit(memberValueStr[0])
                 && !EqualI(memberValueStr, "null")
                 && !EqualI(memberValueStr, "true")
                 && !EqualI(memberValueStr, "false")
            )
         {
-            quotedMemberValueStr += '"';
-            quotedMemberValueStr += memberValueStr;
-            quotedMemberValueStr += '"';
-            memberValueStr = quotedMemberValueStr.c_str();
+            // A plain string, which only needs parsing if it contains escapes
+            if (strpbrk(memberValueStr, "\\\"") == nullptr)
+                memberValue = memberValueStr;
+            else
+            {
+                quotedMemberValueStr.clear();
+                quotedMemberValueStr += '"';
+                quotedMemberValueStr += memberValueStr;
+                quotedMemberValueStr += '"';
+
+                success = reader.Read(quotedMemberValueStr.c_str(), &memberValue);
+            }
         }
+        else if (*memberValueStr)
+            success = reader.Read(memberValueStr, &memberValue);
 
-        Value memberValue;
-        if (*memberValueStr && !LoadJsonText(memberValueStr, &memberValue, errors))
-            return false;
+        if (!success)
+        {
+            // Apply the settings before this one, as if they'd been applied individually
+            if (errors)
+                reader.GetErrors(errors);
+            break;
+        }
+
+        tree.Add(settings[i], nameEnd, std::move(memberValue));
+    }
+
+    tree.Apply(0, config);
+
+    return success;
+}
+
+namespace
+{
+    // Pruning support. The paths are gathered into a tree, as with settings, and the config is then walked alongside
+    // it, with each value matched against the set of nodes whose paths lead to it.
+    struct PruneNode
+    {
+        ValueKeySpan     field;          // Slice of the path, e.g., "b", "[2]", or "*"
+        bool             whole = false;  // Whether a path ends here, so everything within is kept
+        std::vector<int> children;
+    };
+
+    inline bool IsWildcard(ValueKeySpan field)
+    {
+        return (field.size == 1 && field.data[0] == '*') || (field.size == 3 && memcmp(field.data, "[*]", 3) == 0);
+    }
+
+    void RemoveHiddenMembers(Value* root)
+    {
+        std::vector<Value*> stack = { root };
+        std::vector<String> hidden;
+
+        while (!stack.empty())
+        {
+            Value* v = stack.back();
+            stack.pop_back();
+
+            if (v->IsObject())
+            {
+                ObjectValue* object = v->AsObjectPtr();
+
+                if (!object)
+                    continue;
+
+                hidden.clear();
+
+                for (int i = 0, n = object->NumMembers(); i < n; i++)
+                    if (MemberIsHidden(object->MemberName(i)))
+                        hidden.push_back(object->MemberName(i));
+
+                for (const String& name : hidden)
+                    object->RemoveMember(name.c_str());
+
+                for (int i = 0, n = object->NumMembers(); i < n; i++)
+                    if (object->MemberValue(i).IsObject() || object->MemberValue(i).IsArray())
+                        stack.push_back(&object->MemberValue(i));
+            }
+            else if (ArrayValue* av = UniqueArrayPtr(v))
+            {
+                for (Value& elt : *av)
+                    if (elt.IsObject() || elt.IsArray())
+                        stack.push_back(&elt);
+            }
+        }
+    }
+
+    struct PruneTree
+    {
+        std::vector<PruneNode> mNodes = std::vector<PruneNode>(1);  // mNodes[0] is the root
+        ankerl::dense_hash_map<SettingKey, int, SettingKeyHash> mChildren;
+
+        void Add(const char* path, const char* pathEnd);          // Adds the given path
+        void Prune(const std::vector<int>& nodes, Value* v);     // Prunes 'v' to what's reached by 'nodes'
+    };
+
+    void PruneTree::Add(const char* path, const char* pathEnd)
+    {
+        int node = 0;
+
+        for (const char* field = path; field < pathEnd; )
+        {
+            if (*field == '.')
+            {
+                field++;
+                continue;
+            }
+
+            const char* fieldEnd = PathFieldEnd(field, pathEnd);
+
+            SettingKey key = { node, { field, size_t(fieldEnd - field) } };
+            auto it = mChildren.find(key);
+
+            if (it != mChildren.end())
+                node = it->second;
+            else
+            {
+                int child = size_i(mNodes);
+
+                mNodes.emplace_back();
+                mNodes.back().field = key.field;
+                mNodes[node].children.push_back(child);
+
+                mChildren[key] = child;
+                node = child;
+            }
+
+            field = fieldEnd;
+        }
+
+        mNodes[node].whole = true;
+    }
+
+    void PruneTree::Prune(const std::vector<int>& nodes, Value* v)
+    {
+        for (int node : nodes)
+            if (mNodes[node].whole)
+            {
+                RemoveHiddenMembers(v);
+                return;
+            }
+
+        std::vector<int> wildcards;
+        std::vector<std::pair<int64_t, int>> indices;
+
+        for (int node : nodes)
+            for (int child : mNodes[node].children)
+            {
+                ValueKeySpan field = mNodes[child].field;
 
-        *v = memberValue;
+                if (IsWildcard(field))
+                    wildcards.push_back(child);
+                else if (field.data[0] == '[')
+                    indices.push_back({ strtoll(field.data + 1, nullptr, 10), child });
+            }
+
+        if (v->Type() == kValueArray)
+        {
+            // Elements can't be removed without renumbering the rest, so any no path leads into are kept as is
+            ArrayValue* av = UniqueArrayPtr(v);
+
+            if (!av)
+                return;
+
+            std::sort(indices.begin(), indices.end());
+            auto next = indices.begin();
+
+            for (int64_t i = 0, n = av->count; i < n; i++)
+            {
+                std::vector<int> matched = wildcards;
+
+                for (; next != indices.end() && next->first <= i; ++next)
+                    if (next->first == i)
+                        matched.push_back(next->second);
+
+                if (matched.empty())
+                    RemoveHiddenMembers(&(*av)[i]);
+                else
+                    Prune(matched, &(*av)[i]);
+            }
+        }
+        else if (v->Type() == kValueObject)
+        {
+            ObjectValue* object = v->AsObjectPtr();
+            std::vector<String> removed;
+
+            for (int i = 0, n = object->NumMembers(); i < n; i++)
+            {
+                const char* name = object->MemberName(i);
+                std::vector<int> matched;
+
+                if (!MemberIsHidden(name))
+                {
+                    matched = wildcards;
+
+                    for (int node : nodes)
+                    {
+                        auto it = mChildren.find({ node, { name, strlen(name) } });
+
+                        if (it != mChildren.end())
+                            matched.push_back(it->second);
+                    }
+                }
+
+                if (matched.empty())
+                    removed.push_back(name);
+                else
+                    Prune(matched, &object->MemberValue(i));
+            }
+
+            for (const String& name : removed)
+                object->RemoveMember(name.c_str());
+        }
     }
+}
+
+void HL::PruneConfig(int numPaths, const char* const paths[], Value* config)
+{
+    PruneTree tree;
+
+    for (int i = 0; i < numPaths; i++)
+        tree.Add(paths[i], paths[i] + strlen(paths[i]));
 
-    return true;
+    tree.Prune({ 0 }, config);
 }
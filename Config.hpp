@@ -28,6 +28,8 @@ namespace HL
         vector_set<String> mImports;  // all other imported config files
 
         StringTable* mStringTable = 0;  // Optional shared string table used during loading
+
+        int mThreads = 1;               // Number of threads to use for resolving imports and templates across the top-level members, or 0 for one per core. Results are the same either way, but imports loaded in parallel don't use mStringTable.
     };
 
     bool LoadConfig(const char* path, Value* config, String* errors = nullptr, ConfigInfo* info = nullptr);
@@ -49,10 +51,22 @@ namespace HL
     // be a simple key, or a full path expression (e.g., "a.b.c[2].d"). The <value> is parsed as json, and can be
     // omitted, in which case the member's value is set to 'true'.
     // Returns false if there was an error parsing one of the values, with 'errors' set correspondingly.
+    // The result is as if the settings were applied in order, but they're first gathered into a tree of overrides,
+    // so that large batches are applied in a single pass over each affected object.
 
     template<class C, class U = typename C::value_type>
     bool ApplySettings(const C& c, Value* config, String* errors = 0);  // variant for a container of const char*
 
+    void PruneConfig(int numPaths, const char* const paths[], Value* config);
+    // Removes everything from the given config that isn't on one of the given paths, e.g., those the runtime was seen
+    // to read, along with any hidden members, as per MemberIsHidden(). Paths are as per ApplySettings(), and can also
+    // use '*' or "[*]" to match any member or element, e.g., "models.*.lod_distances". Whatever a path ends at is kept
+    // entirely, so for a subtree the runtime iterates over, list the subtree itself, e.g., "models". Array elements
+    // aren't removed, as that would renumber the rest, but are pruned in turn if a path leads into them.
+
+    template<class C, class U = typename C::value_type>
+    void PruneConfig(const C& c, Value* config);  // variant for a container of const char*
+
 
     //
     // Inlines
@@ -62,6 +76,11 @@ namespace HL
     {
         return ApplySettings(size_i(c), c.data(), config, errors);
     }
+
+    template<class C, class U> void PruneConfig(const C& c, Value* config)
+    {
+        PruneConfig(size_i(c), c.data(), config);
+    }
 }
 
 #endif
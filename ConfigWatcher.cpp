@@ -0,0 +1,243 @@
+//
+// ConfigWatcher.cpp
+//
+// Notification of changes to the files a config was loaded from
+//
+
+#include "ConfigWatcher.hpp"
+
+#include <chrono>
+#include <math.h>
+#include <string.h>
+
+#ifdef __linux__
+    #define HL_INOTIFY 1
+
+    #include <errno.h>
+    #include <poll.h>
+    #include <sys/inotify.h>
+    #include <unistd.h>
+#endif
+
+using namespace HL;
+
+namespace
+{
+    inline double Now()
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+#ifdef HL_INOTIFY
+    // Editors variously write in place, or write elsewhere and rename over the original, possibly after renaming the
+    // original out of the way, so we need the lot.
+    const uint32_t kWatchMask = IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+#endif
+}
+
+ConfigWatcher::ConfigWatcher()
+{
+#ifdef HL_INOTIFY
+    mFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+ConfigWatcher::~ConfigWatcher()
+{
+#ifdef HL_INOTIFY
+    if (mFD >= 0)
+        close(mFD);
+#endif
+}
+
+bool ConfigWatcher::Watch(const ConfigInfo& info, String* errors)
+{
+    bool result = Watch(info.mMain.c_str(), errors);
+
+    for (const String& import : info.mImports)
+        result = Watch(import.c_str(), errors) && result;
+
+    return result;
+}
+
+bool ConfigWatcher::Watch(const char* path, String* errors)
+{
+#ifdef HL_INOTIFY
+    if (mFD < 0)
+    {
+        if (errors)
+            AppendFormat(errors, "Can't watch %s: inotify is unavailable\n", path);
+        return false;
+    }
+
+    const char* name = strrchr(path, '/');
+    String dirPath = name ? String(path, name + 1 - path) : String(".");
+    name = name ? name + 1 : path;
+
+    // Watching a directory again returns its existing descriptor
+    int wd = inotify_add_watch(mFD, dirPath.c_str(), kWatchMask);
+
+    if (wd < 0)
+    {
+        if (errors)
+            AppendFormat(errors, "Can't watch %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    Dir* dir = nullptr;
+
+    for (Dir& d : mDirs)
+        if (d.wd == wd)
+            dir = &d;
+
+    if (!dir)
+    {
+        mDirs.push_back({ wd, {} });
+        dir = &mDirs.back();
+    }
+
+    dir->files.insert({ String(name), String(path) });
+    return true;
+#else
+    if (errors)
+        AppendFormat(errors, "Can't watch %s: file watching isn't supported on this platform\n", path);
+    return false;
+#endif
+}
+
+void ConfigWatcher::Clear()
+{
+#ifdef HL_INOTIFY
+    for (const Dir& dir : mDirs)
+        inotify_rm_watch(mFD, dir.wd);
+#endif
+
+    mDirs.clear();
+    mPending.clear();
+}
+
+void ConfigWatcher::SetDebounce(double seconds)
+{
+    mDebounce = seconds;
+}
+
+void ConfigWatcher::SetCallback(Callback callback)
+{
+    mCallback = std::move(callback);
+}
+
+int ConfigWatcher::FD() const
+{
+    return mFD;
+}
+
+int ConfigWatcher::TimeoutMS() const
+{
+    if (mPending.empty())
+        return -1;
+
+    double remaining = mLastEvent + mDebounce - Now();
+
+    return remaining > 0.0 ? int(ceil(remaining * 1000.0)) : 0;
+}
+
+bool ConfigWatcher::Update(std::vector<String>* changed)
+{
+    ReadEvents();
+
+    if (mPending.empty() || Now() - mLastEvent < mDebounce)
+        return false;
+
+    std::vector<String> files(mPending.begin(), mPending.end());
+    mPending.clear();
+
+    if (mCallback)
+        mCallback(files);
+
+    if (changed)
+        changed->insert(changed->end(), files.begin(), files.end());
+
+    return true;
+}
+
+bool ConfigWatcher::Wait(double seconds, std::vector<String>* changed)
+{
+#ifdef HL_INOTIFY
+    double end = Now() + seconds;
+
+    while (!Update(changed))
+    {
+        if (mFD < 0)
+            return false;
+
+        int timeout = TimeoutMS();
+
+        if (seconds >= 0.0)
+        {
+            int remaining = int(ceil((end - Now()) * 1000.0));
+
+            if (remaining <= 0)
+                return false;
+
+            if (timeout < 0 || timeout > remaining)
+                timeout = remaining;
+        }
+
+        pollfd pfd = { mFD, POLLIN, 0 };
+        poll(&pfd, 1, timeout);
+    }
+
+    return true;
+#else
+    (void) seconds;
+    return Update(changed);
+#endif
+}
+
+void ConfigWatcher::ReadEvents()
+{
+#ifdef HL_INOTIFY
+    if (mFD < 0)
+        return;
+
+    alignas(inotify_event) char buffer[4096];
+    ssize_t size;
+
+    while ((size = read(mFD, buffer, sizeof(buffer))) > 0)
+    {
+        for (const char* p = buffer; p < buffer + size; )
+        {
+            const inotify_event* event = (const inotify_event*) p;
+            p += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                // Events were lost, so assume everything changed
+                for (const Dir& dir : mDirs)
+                    for (const auto& file : dir.files)
+                        mPending.insert(file.second);
+
+                mLastEvent = Now();
+                continue;
+            }
+
+            if (event->len == 0)
+                continue;
+
+            for (const Dir& dir : mDirs)
+                if (dir.wd == event->wd)
+                {
+                    auto it = dir.files.find(String(event->name));
+
+                    if (it != dir.files.end())
+                    {
+                        mPending.insert(it->second);
+                        mLastEvent = Now();
+                    }
+
+                    break;
+                }
+        }
+    }
+#endif
+}
@@ -0,0 +1,65 @@
+//
+// ConfigWatcher.hpp
+//
+// Notification of changes to the files a config was loaded from
+//
+
+#ifndef HL_CONFIG_WATCHER_H
+#define HL_CONFIG_WATCHER_H
+
+#include "Config.hpp"
+#include "vector_map.hpp"
+
+#include <functional>
+
+namespace HL
+{
+    class ConfigWatcher
+    // Watches the files a config was loaded from, as listed by a ConfigInfo, so it can be reloaded when any of them
+    // change. This is event driven, via inotify, so there's no per-file cost while nothing's happening. Each file's
+    // directory is watched rather than the file itself, so saves that write a temporary file and rename it over the
+    // original are caught, and bursts of changes, e.g., the several writes of an editor save, are reported as one,
+    // once things have been quiet for the debounce period.
+    // Either call Update() regularly, e.g., once a frame, or wait on FD() along with your other descriptors, using
+    // TimeoutMS() as the poll() timeout, and then call Update(). Wait() does the latter for you.
+    // Currently Linux only: elsewhere Watch() fails.
+    {
+    public:
+        typedef std::function<void(const std::vector<String>& changed)> Callback;
+
+        ConfigWatcher();
+        ~ConfigWatcher();
+
+        bool Watch(const ConfigInfo& info, String* errors = nullptr);  // Adds info's main config file and imports to the watched files. Returns false if any couldn't be watched.
+        bool Watch(const char* path,       String* errors = nullptr);  // Adds the given file
+        void Clear();                                                  // Stops watching all files
+
+        void SetDebounce(double seconds);       // How long changes must be quiet for before they're reported, default 0.1s
+        void SetCallback(Callback callback);    // Called from Update() with the changed files
+
+        int  FD() const;                        // Descriptor that becomes readable when a watched file may have changed, or -1 if unsupported
+        int  TimeoutMS() const;                 // Milliseconds until pending changes will have settled, or -1 if there are none
+
+        bool Update(std::vector<String>* changed = nullptr);                // Processes any events without blocking. Once changes have settled, appends the changed files to 'changed', calls the callback, and returns true.
+        bool Wait(double seconds, std::vector<String>* changed = nullptr);  // As Update(), but blocks for up to 'seconds', or indefinitely if < 0, until there are changes
+
+    protected:
+        struct Dir
+        {
+            int                        wd;      // inotify watch descriptor
+            vector_map<String, String> files;   // Watched file names -> paths as given
+        };
+
+        int                mFD       = -1;
+        double             mDebounce = 0.1;
+        Callback           mCallback;
+
+        std::vector<Dir>   mDirs;
+        vector_set<String> mPending;            // Changed files yet to be reported
+        double             mLastEvent = 0;      // Time of the latest change
+
+        void ReadEvents();
+    };
+}
+
+#endif
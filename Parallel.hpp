@@ -0,0 +1,66 @@
+//
+// Parallel.hpp
+//
+// Minimal support for spreading independent work across threads
+//
+
+#ifndef HL_PARALLEL_H
+#define HL_PARALLEL_H
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace HL
+{
+    int NumThreadsToUse(int numThreads);  // Returns 'numThreads' if >= 1, otherwise the number of cores
+
+    template<class F> void ParallelFor(int n, int numThreads, F f);
+    // Calls f(i) for each i in [0, n), spread across up to 'numThreads' threads, including the calling one.
+    // Indices are handed out in order, so earlier ones start first.
+
+
+    // --- Inlines -------------------------------------------------------------
+
+    inline int NumThreadsToUse(int numThreads)
+    {
+        if (numThreads >= 1)
+            return numThreads;
+
+        int n = int(std::thread::hardware_concurrency());
+        return n > 1 ? n : 1;
+    }
+
+    template<class F> void ParallelFor(int n, int numThreads, F f)
+    {
+        if (numThreads > n)
+            numThreads = n;
+
+        if (numThreads <= 1)
+        {
+            for (int i = 0; i < n; i++)
+                f(i);
+            return;
+        }
+
+        std::atomic<int> next(0);
+
+        auto worker = [&next, n, &f]()
+        {
+            for (int i; (i = next++) < n; )
+                f(i);
+        };
+
+        std::vector<std::thread> threads;
+
+        for (int t = 1; t < numThreads; t++)
+            threads.emplace_back(worker);
+
+        worker();
+
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+}
+
+#endif
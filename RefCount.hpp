@@ -50,7 +50,7 @@ namespace HL
         AutoRef();
         AutoRef(T* object);
         AutoRef(const AutoRef& rhs);
-        AutoRef(AutoRef&& rhs);
+        AutoRef(AutoRef&& rhs) noexcept;
 
         ~AutoRef();
 
@@ -221,7 +221,7 @@ namespace HL
             mObject->AddRef();
     }
 
-    template<class T> inline AutoRef<T>::AutoRef(AutoRef&& rhs) : mObject(rhs.mObject)
+    template<class T> inline AutoRef<T>::AutoRef(AutoRef&& rhs) noexcept : mObject(rhs.mObject)
     {
         rhs.mObject = nullptr;
     }
@@ -20,6 +20,7 @@ namespace
     const uint32_t kHashPrime32 = 0x01000193;
 
     uint32_t StrHashU32 (const char* s, uint32_t hashValue = kHashOffset32); // Basic string hash. 'hashValue' can be used to chain hashes.
+    uint32_t StrHashU32 (const char* s, size_t len, uint32_t hashValue = kHashOffset32); // Variant for unterminated strings
 
     inline uint32_t StrHashU32(const char* s, uint32_t hashValue)
     {
@@ -32,6 +33,17 @@ namespace
         return hashValue;
     }
 
+    inline uint32_t StrHashU32(const char* s, size_t len, uint32_t hashValue)
+    {
+        const uint8_t* data = (const uint8_t*) s;
+        const uint8_t* dataEnd = data + len;
+
+        while (data < dataEnd && *data)
+            hashValue = (hashValue ^ *data++) * kHashPrime32;
+
+        return hashValue;
+    }
+
     // We use this both for convenience and to support delayed creation of
     // a StringValue from a const char* on lookup.
     struct STStringRef : public AutoRef<StringValue>
@@ -58,6 +70,12 @@ namespace
             HashType hash = StrHashU32(s) * UINT64_C(0x9ddfea08eb382d69);
             return hash;
         }
+
+        HashType operator () (ValueKeySpan s) const
+        {
+            HashType hash = StrHashU32(s.data, s.size) * UINT64_C(0x9ddfea08eb382d69);
+            return hash;
+        }
     };
 
     struct StringSetEqual
@@ -67,6 +85,8 @@ namespace
         bool operator () (const StringValueRef& a, const StringValueRef& b) const { return strcmp(a->c_str(), b->c_str()) == 0; }
         bool operator () (const StringValueRef& a, const char*           b) const { return strcmp(a->c_str(), b) == 0; }
         bool operator () (const char*           a, const StringValueRef& b) const { return strcmp(a, b->c_str()) == 0; }
+        bool operator () (const StringValueRef& a, ValueKeySpan          b) const { return CompareKey(a->c_str(), b) == 0; }
+        bool operator () (ValueKeySpan          a, const StringValueRef& b) const { return CompareKey(b->c_str(), a) == 0; }
     };
 
     struct StringSetLess
@@ -103,6 +123,19 @@ StringValue* StringTable::GetString(const char* str)
     return *it;
 }
 
+StringValue* StringTable::GetString(const char* str, size_t len)
+{
+    StringTableImpl* self = static_cast<StringTableImpl*>(this);
+
+    ValueKeySpan key = { str, len };
+    auto it = self->mStrings.find(key);
+
+    if (it == self->mStrings.end())
+        it = self->mStrings.insert(StringValueRef(CreateStringValue(str, len))).first;
+
+    return *it;
+}
+
 void StringTable::Flush()
 {
     StringTableImpl* self = static_cast<StringTableImpl*>(this);
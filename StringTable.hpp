@@ -17,7 +17,8 @@ namespace HL
 
     struct StringTable : RefCounted
     {
-        StringValue* GetString(const char* str);  // Returns ref-counted string from table, adding if necessary
+        StringValue* GetString(const char* str);              // Returns ref-counted string from table, adding if necessary
+        StringValue* GetString(const char* str, size_t len);  // Variant taking the first 'len' characters of 'str', which needn't be terminated
 
         void Flush();  // Flushes all entries that are unreferenced
         void Clear();  // Clears all entries
@@ -12,6 +12,11 @@
     #include "StringTable.hpp"
 #endif
 
+#include "external/unordered_dense.h"
+
+#include <mutex>
+#include <shared_mutex>
+
 using namespace HL;
 
 
@@ -85,30 +90,17 @@ Value::Value(const Value& other) : mType(other.mType)
         // We copy objects rather than adding a reference because they are
         // mutable, unlike strings/arrays where we ensure copy-on-write.
         HL_ASSERT(other.mValue.mObject);
-        mValue.mObject = new ObjectValue(*other.mValue.mObject);
+        mValue.mObject = CreateObjectValue(*other.mValue.mObject);
         HL_ASSERT(mValue.mObject->RefCount() == 0);
         mValue.mObject->AddRef();
         break;
     default:
         HL_ERROR("Invalid type");
     }
-
-#ifdef HL_VALUE_COMMENTS
-    if (other.mComments)
-    {
-        mComments = new String[kNumberOfCommentPlacements];
-
-        for (int comment = 0; comment < kNumberOfCommentPlacements; ++comment)
-            mComments[comment] = other.mComments[comment];
-    }
-#endif
 }
 
-Value::Value(Value&& other) :
+Value::Value(Value&& other) noexcept :
     mValue(other.mValue),
-#ifdef HL_VALUE_COMMENTS
-    mComments(other.mComments),
-#endif
     mType(other.mType)
 {
     switch (mType)
@@ -125,20 +117,12 @@ Value::Value(Value&& other) :
     default:
         break;
     }
-#ifdef HL_VALUE_COMMENTS
-    other.mComments = nullptr;
-#endif
     other.mType = kValueNull;
 }
 
 Value::~Value()
 {
     MakeNull();
-
-#ifdef HL_VALUE_COMMENTS
-    if (mComments)
-        DeleteArray(mComments);
-#endif
 }
 
 void Value::operator = (const Value& other)
@@ -158,9 +142,6 @@ void Value::Swap(Value& other)
         mValue.mObject->Swap(other.mValue.mObject);  // to preserve mod counts
     else
         std::swap(mValue, other.mValue);
-#ifdef HL_VALUE_COMMENTS
-    std::swap(mComments, other.mComments);
-#endif
     std::swap(mType, other.mType);
 }
 
@@ -255,6 +236,8 @@ bool Value::IsConvertibleTo(ValueType other) const
 
 const char* Value::AsCString(const char* defaultValue) const
 {
+    HL_VALUE_COUNT(this);
+
     switch (mType)
     {
     case kValueString:
@@ -270,6 +253,8 @@ const char* Value::AsCString(const char* defaultValue) const
 
 uint32_t Value::AsID(uint32_t defaultValue) const
 {
+    HL_VALUE_COUNT(this);
+
     switch (mType)
     {
     case kValueString:
@@ -297,6 +282,8 @@ uint32_t Value::AsID(uint32_t defaultValue) const
 
 int32_t Value::AsInt(int32_t defaultValue) const
 {
+    HL_VALUE_COUNT(this);
+
     switch (mType)
     {
     case kValueBool:
@@ -338,6 +325,8 @@ int32_t Value::AsInt(int32_t defaultValue) const
 
 uint32_t Value::AsUInt(uint32_t defaultValue) const
 {
+    HL_VALUE_COUNT(this);
+
     switch (mType)
     {
     case kValueBool:
@@ -377,6 +366,8 @@ uint32_t Value::AsUInt(uint32_t defaultValue) const
 
 int64_t Value::AsInt64(int64_t defaultValue) const
 {
+    HL_VALUE_COUNT(this);
+
     switch (mType)
     {
     case kValueBool:
@@ -409,6 +400,8 @@ int64_t Value::AsInt64(int64_t defaultValue) const
 
 uint64_t Value::AsUInt64(uint64_t defaultValue) const
 {
+    HL_VALUE_COUNT(this);
+
     switch (mType)
     {
     case kValueBool:
@@ -444,6 +437,8 @@ uint64_t Value::AsUInt64(uint64_t defaultValue) const
 
 float Value::AsFloat(float defaultValue) const
 {
+    HL_VALUE_COUNT(this);
+
     switch (mType)
     {
     case kValueBool:
@@ -468,6 +463,8 @@ float Value::AsFloat(float defaultValue) const
 
 double Value::AsDouble(double defaultValue) const
 {
+    HL_VALUE_COUNT(this);
+
     switch (mType)
     {
     case kValueBool:
@@ -492,6 +489,8 @@ double Value::AsDouble(double defaultValue) const
 
 bool Value::AsBool(bool defaultValue) const
 {
+    HL_VALUE_COUNT(this);
+
     switch (mType)
     {
     case kValueBool:
@@ -522,24 +521,119 @@ bool Value::AsBool(bool defaultValue) const
 
 // Array
 
-Value& Value::Elt(int index)
+Value& Value::Elt(int64_t index)
 {
     if (mType == kValueArray)
-        return (*mValue.mArray)[index];
+        return (*AsArrayPtr())[index];  // unslices and clears key indexes, as the caller may modify the element
 
     HL_ERROR("Not an array");
     kNullValueScratch.MakeNull();
     return kNullValueScratch;
 }
 
-const Value& Value::Elt(int index) const
+const Value& Value::Elt(int64_t index) const
 {
     if (mType == kValueArray)
-        return (*mValue.mArray)[index];
+        return HL_VALUE_READ((*mValue.mArray)[index]);
 
     return kNullValue;
 }
 
+namespace
+{
+    ArrayValue* GrowArray(ArrayValue* av, int64_t capacity)
+    {
+        if (!av)
+            return CreateArrayValue(0, capacity);
+
+        if (av->RefCount() > 1 || av->IsSlice())
+            return CreateArrayValue(av->count, capacity, av->Elts());  // copy-on-write
+
+        // We're the only owner, so relocate the elements rather than copying them. Values don't hold
+        // pointers to themselves, so this can be a straight memory copy.
+        ArrayValue* newArray = CreateArrayValue(0, capacity);
+        memcpy((void*) newArray->Elts(), (const void*) av->Elts(), av->count * sizeof(Value));
+        newArray->count = av->count;
+        av->count = 0;
+
+        return newArray;
+    }
+}
+
+Value& Value::AppendElt(const Value& v)
+{
+    return AppendElt(Value(v));  // copying first also handles 'v' being an element of this array
+}
+
+Value& Value::AppendElt(Value&& v)
+{
+    if (!ToArray())
+    {
+        HL_ERROR("Not an array");
+        kNullValueScratch.MakeNull();
+        return kNullValueScratch;
+    }
+
+    ArrayValue* av = mValue.mArray;
+
+    if (!av || av->count == av->Capacity() || av->RefCount() > 1 || av->IsSlice())
+    {
+        int64_t count = av ? av->count : 0;
+        int64_t capacity = count < 4 ? 4 : std::min(count * 2, ArrayValueHeader::kMaxCount);
+
+        if (count == ArrayValueHeader::kMaxCount)
+        {
+            HL_ERROR("Array is at its maximum size");
+            kNullValueScratch.MakeNull();
+            return kNullValueScratch;
+        }
+
+        Value temp(std::move(v));  // in case 'v' lives in the current array
+        mValue.mArray = GrowArray(av, capacity);
+        mValue.mArray->AddRef();
+
+        if (av)
+            av->Release();
+
+        av = mValue.mArray;
+        new (&av->Elts()[av->count]) Value(std::move(temp));
+        return av->Elts()[av->count++];
+    }
+
+    av->ClearKeyIndexes();
+
+    new (&av->Elts()[av->count]) Value(std::move(v));
+    return av->Elts()[av->count++];
+}
+
+void Value::ReserveElts(int64_t n)
+{
+    if (!ToArray())
+        return;
+
+    ArrayValue* av = mValue.mArray;
+
+    if (av && av->Capacity() >= n && av->RefCount() == 1 && !av->IsSlice())
+        return;
+
+    if (av && n < av->count)
+        n = av->count;
+
+    mValue.mArray = GrowArray(av, n);
+    mValue.mArray->AddRef();
+
+    if (av)
+        av->Release();
+}
+
+Value Value::Slice(int64_t first, int64_t count) const
+{
+    if (mType != kValueArray)
+        return Value();
+
+    return Value(CreateArraySlice(mValue.mArray ? mValue.mArray : &kNullArrayValue, first, count));
+}
+
 // Array/Object STL
 
 size_t Value::size() const
@@ -547,10 +641,10 @@ size_t Value::size() const
     switch (mType)
     {
     case kValueString:
-        return mValue.mString ? int(mValue.mString->size()) : 0;
+        return mValue.mString ? mValue.mString->size() : 0;
 
     case kValueArray:
-        return mValue.mArray ? int(mValue.mArray->size()) : 0;
+        return mValue.mArray ? mValue.mArray->size() : 0;
 
     case kValueObject:
         return mValue.mObject->NumMembers();
@@ -605,32 +699,6 @@ void Value::clear()
     }
 }
 
-// Comments
-
-#ifdef HL_VALUE_COMMENTS
-void Value::SetComment(const char* comment, CommentPlacement placement)
-{
-    if (!mComments)
-        mComments = new String[kNumberOfCommentPlacements];
-
-    mComments[placement] = comment;
-}
-
-
-bool Value::HasComment(CommentPlacement placement) const
-{
-    return mComments != 0 && !mComments[placement].empty();
-}
-
-const char* Value::Comment(CommentPlacement placement) const
-{
-    if (mComments)
-        return mComments[placement].c_str();
-
-    return "";
-}
-#endif
-
 // Comparisons
 
 bool Value::operator < (const Value& other) const
@@ -677,6 +745,145 @@ bool Value::operator > (const Value& other) const
     return other < *this;
 }
 
+namespace
+{
+    template<class T> inline int CompareT(const T& a, const T& b)
+    {
+        if (a < b)
+            return -1;
+        if (a > b)
+            return 1;
+        return 0;
+    }
+
+    struct ContentsPair
+    // Same-sized arrays or objects whose contents are being compared
+    {
+        const ArrayValue*  arrays [2];
+        const ObjectValue* objects[2];
+        int64_t            i;
+        int64_t            n;
+    };
+
+    inline ContentsPair Contents(const ArrayValue* a, const ArrayValue* b)
+    {
+        return { { a, b }, { 0, 0 }, 0, a->count };
+    }
+
+    inline ContentsPair Contents(const ObjectValue* a, const ObjectValue* b)
+    {
+        return { { 0, 0 }, { a, b }, 0, a->NumMembers() };
+    }
+
+    const int kCompareContents = 2;
+
+    int CompareShallow(const Value& a, const Value& b, bool exact, ContentsPair* pair)
+    // Compares 'a' and 'b' as per Compare(), or as per operator == if 'exact' is set, in which case only zero vs.
+    // non-zero is meaningful. If they are non-empty arrays or objects of the same size, returns kCompareContents,
+    // with 'pair' set up for CompareContents().
+    {
+        ValueType type = a.Type();
+
+        if (type != b.Type())
+            return (exact || type > b.Type()) ? 1 : -1;
+
+        if (type == kValueArray)
+        {
+            const ArrayValue* aa = a.mValue.mArray;
+            const ArrayValue* ab = b.mValue.mArray;
+
+            if (aa == ab)
+                return 0;
+
+            if (!aa || !ab)
+                return exact ? 1 : CompareT(aa != nullptr, ab != nullptr);
+
+            if (aa->count != ab->count)
+                return exact ? 1 : CompareT(aa->count, ab->count);
+
+            *pair = Contents(aa, ab);
+            return aa->count > 0 ? kCompareContents : 0;
+        }
+
+        if (type == kValueObject)
+        {
+            const ObjectValue* oa = a.mValue.mObject;
+            const ObjectValue* ob = b.mValue.mObject;
+
+            int na = oa->NumMembers();
+            int nb = ob->NumMembers();
+
+            if (na != nb)
+                return exact ? 1 : CompareT(na, nb);
+
+            *pair = Contents(oa, ob);
+            return na > 0 ? kCompareContents : 0;
+        }
+
+        if (exact)
+            return a == b ? 0 : 1;
+
+        return a.Compare(b);
+    }
+
+    int CompareContents(ContentsPair pair, bool exact)
+    // Compares the contents of 'pair' depth first. Nested containers are handled via an explicit stack rather than
+    // recursively, so arbitrarily deep values can't overflow the call stack.
+    {
+        std::vector<ContentsPair> parents;  // only allocated if there are nested containers
+
+        while (true)
+        {
+            if (pair.i == pair.n)
+            {
+                if (parents.empty())
+                    return 0;
+
+                pair = parents.back();
+                parents.pop_back();
+                continue;
+            }
+
+            int64_t i = pair.i++;
+            const Value* a;
+            const Value* b;
+
+            if (pair.arrays[0])
+            {
+                a = &(*pair.arrays[0])[i];
+                b = &(*pair.arrays[1])[i];
+            }
+            else
+            {
+                const ObjectValue* oa = pair.objects[0];
+                const ObjectValue* ob = pair.objects[1];
+
+                if (!exact || !oa->Shape() || oa->Shape() != ob->Shape())
+                {
+                    int keyCompare = ::Compare(oa->MemberName(int(i)), ob->MemberName(int(i)));
+
+                    if (keyCompare != 0)
+                        return keyCompare;
+                }
+
+                a = &oa->MemberValue(int(i));
+                b = &ob->MemberValue(int(i));
+            }
+
+            ContentsPair children;
+            int result = CompareShallow(*a, *b, exact, &children);
+
+            if (result == kCompareContents)
+            {
+                parents.push_back(pair);
+                pair = children;
+            }
+            else if (result != 0)
+                return result;
+        }
+    }
+}
+
 bool Value::operator == (const Value& other) const
 {
     int temp = other.mType;
@@ -704,30 +911,20 @@ bool Value::operator == (const Value& other) const
     case kValueString:
         return (mValue.mString == other.mValue.mString)
             || (mValue.mString && other.mValue.mString && *mValue.mString == *other.mValue.mString);
-    case kValueArray:
-        return (mValue.mArray == other.mValue.mArray)
-            || (mValue.mArray && other.mValue.mArray && *mValue.mArray == *other.mValue.mArray);
 
+    case kValueArray:
     case kValueObject:
-        return mValue.mObject->NumMembers() == other.mValue.mObject->NumMembers()
-            && (*mValue.mObject) == (*other.mValue.mObject);
+        {
+            ContentsPair pair;
+            int result = CompareShallow(*this, other, true, &pair);
+
+            return result == 0 || (result == kCompareContents && CompareContents(pair, true) == 0);
+        }
     }
 
     return false;
 }
 
-namespace
-{
-    template<class T> inline int CompareT(const T& a, const T& b)
-    {
-        if (a < b)
-            return -1;
-        if (a > b)
-            return 1;
-        return 0;
-    }
-}
-
 int Value::Compare(const Value& other) const
 {
     if (mType != other.mType)
@@ -760,17 +957,13 @@ int Value::Compare(const Value& other) const
             return CompareT(b1, b2);
         }
     case kValueArray:
+    case kValueObject:
         {
-            bool b1 =       mValue.mArray != nullptr;
-            bool b2 = other.mValue.mArray != nullptr;
-
-            if (b1 && b2)
-                return mValue.mArray->Compare(*other.mValue.mArray);
+            ContentsPair pair;
+            int result = CompareShallow(*this, other, false, &pair);
 
-            return CompareT(b1, b2);
+            return result == kCompareContents ? CompareContents(pair, false) : result;
         }
-    case kValueObject:
-        return mValue.mObject->Compare(*other.mValue.mObject);
     default:
         ;
     }
@@ -781,6 +974,48 @@ int Value::Compare(const Value& other) const
 
 // Utilities
 
+namespace
+{
+    // Releasing a container can release its children, and so on. Rather than recursing, which can overflow the
+    // stack for deeply nested values, releases made while one is in progress are queued, and handled by the outermost.
+    // Arrays aren't ValueRCs, so entries record which they are.
+    struct QueuedRelease
+    {
+        const ValueRC*    object;
+        const ArrayValue* array;
+
+        void Release() const { if (array) array->Release(); else object->Release(); }
+    };
+
+    thread_local std::vector<QueuedRelease>* tReleaseQueue = nullptr;
+
+    void ReleaseContainer(QueuedRelease container)
+    {
+        if (tReleaseQueue)
+        {
+            tReleaseQueue->push_back(container);
+            return;
+        }
+
+        std::vector<QueuedRelease> queue;
+        tReleaseQueue = &queue;
+
+        container.Release();
+
+        while (!queue.empty())
+        {
+            container = queue.back();
+            queue.pop_back();
+            container.Release();
+        }
+
+        tReleaseQueue = nullptr;
+    }
+
+    inline void ReleaseContainer(const ValueRC* object)   { ReleaseContainer(QueuedRelease{ object, nullptr }); }
+    inline void ReleaseContainer(const ArrayValue* array) { ReleaseContainer(QueuedRelease{ nullptr, array }); }
+}
+
 void Value::MakeNull()
 {
     switch (mType)
@@ -795,12 +1030,12 @@ void Value::MakeNull()
     case kValueArray:
         if (mValue.mArray)
         {
-            mValue.mArray->Release();
+            ReleaseContainer(mValue.mArray);
             mValue.mArray = nullptr;
         }
         break;
     case kValueObject:
-        mValue.mObject->Release();
+        ReleaseContainer(mValue.mObject);
         mValue.mObject = nullptr;
         break;
     default:
@@ -822,10 +1057,9 @@ ArrayValue& Value::MakeArray(int n)
 
  ArrayValue& Value::MakeArray(size_t n)
  {
-     HL_ASSERT(n <= INT_MAX);
      MakeNull();
      mType = kValueArray;
-     mValue.mArray = CreateArrayValue((int) n);
+     mValue.mArray = CreateArrayValue(int64_t(n));
      mValue.mArray->AddRef();
 
      return *mValue.mArray;
@@ -878,6 +1112,9 @@ void Value::Merge(const Value& overrides)
     mValue.mObject->Merge(*overrides.mValue.mObject);
 }
 
+static_assert(sizeof(Value) <= 16, "Value should fit in 16 bytes");
+static_assert(sizeof(ArrayValue) <= 16, "ArrayValue header should fit in 16 bytes");
+
 const Value HL::kNullValue;
 Value HL::kNullValueScratch;
 
@@ -885,14 +1122,17 @@ const ArrayValue HL::kNullArrayValue;
 
 // --- StringValue ------------------------------------------------------------
 
-StringValue* HL::CreateStringValue(const char* str, size_t len)
+StringValue* HL::CreateStringValue(const char* str)
 {
-    if (len == 0)
-        len = strlen(str);
+    return CreateStringValue(str, strlen(str));
+}
 
+StringValue* HL::CreateStringValue(const char* str, size_t len)
+{
     StringValue* sv = static_cast<StringValue*>(::operator new(sizeof(ValueRC) + len + 1));
     new (sv) ValueRC();
-    memcpy((char*) sv->data, str, len + 1);
+    memcpy((char*) sv->data, str, len);
+    ((char*) sv->data)[len] = 0;
 
     return sv;
 }
@@ -900,138 +1140,811 @@ StringValue* HL::CreateStringValue(const char* str, size_t len)
 
 // --- ArrayValue ------------------------------------------------------------
 
-ArrayValueHeader::~ArrayValueHeader()
+void ArrayValueHeader::Destroy() const
 {
-    Value* data = (Value*) (((uint8_t*) this) + sizeof(ArrayValueHeader));
-    for (int i = 0; i < count; i++)
-        data[i].~Value();
-}
+    ClearKeyIndexes();
 
-ArrayValue* HL::CreateArrayValue(int n, const Value values[])
-{
-    ArrayValue* av = static_cast<ArrayValue*>(::operator new(sizeof(ArrayValueHeader) + n * sizeof(Value)));
-    new (av) ArrayValueHeader(n);
+    if (IsSlice())
+    {
+        const ArrayValue* source = static_cast<const ArraySliceHeader*>(this)->source;
+        ::operator delete((void*) this);
+        ReleaseContainer(source);  // may be the last reference to a large array
+        return;
+    }
 
-    if (values)
-        for (int i = 0; i < n; i++)
-            new (&av->data[i]) Value(values[i]);
-    else
-        for (int i = 0; i < n; i++)
-            new (&av->data[i]) Value();
+    Value* elts = (Value*) (this + 1);
 
-    return av;
+    for (int64_t i = 0; i < count; i++)
+        elts[i].~Value();
+
+    if (flags.load(std::memory_order_relaxed) & kArrayGrowable)
+        ::operator delete((void*) ((const int64_t*) this - 1));  // see CreateArrayValue()
+    else
+        ::operator delete((void*) this);
 }
 
-ArrayValue* HL::CreateArrayValue(const Values& values)
+ArraySliceHeader::ArraySliceHeader(const ArrayValue* sourceIn, int64_t first, int64_t n) :
+    ArrayValueHeader(n, kArraySlice),
+    source(sourceIn),
+    elts(sourceIn->Elts() + first)
 {
-    HL_ASSERT(values.size() <= INT_MAX);
-    int n = int(values.size());
-
-    ArrayValue* av = static_cast<ArrayValue*>(::operator new(sizeof(ArrayValueHeader) + n * sizeof(Value)));
-    new (av) ArrayValueHeader(n);
-
-    for (int i = 0; i < n; i++)
-        new (&av->data[i]) Value(values[i]);
-
-    return av;
+    source->AddRef();
 }
 
-bool ArrayValue::operator == (const ArrayValue& other) const
+namespace
 {
-    if (count != other.count)
-        return false;
+    inline bool CheckArraySize(int64_t* n)
+    {
+        if (*n >= 0 && *n <= ArrayValueHeader::kMaxCount)
+            return true;
 
-    for (int i = 0; i < count; i++)
-        if (data[i] != other.data[i])
-            return false;
+        HL_ERROR("Array size out of range");
+        *n = 0;
+        return false;
+    }
+}
 
-    return true;
+ArrayValue* HL::CreateArrayValue(int64_t n, const Value values[])
+{
+    return CreateArrayValue(n, n, values);
 }
 
-int ArrayValue::Compare(const ArrayValue& other) const
+ArrayValue* HL::CreateArrayValue(int64_t n, int64_t capacity, const Value values[])
 {
-    int n1 = count;
-    int n2 = other.count;
+    if (!CheckArraySize(&n))
+        values = nullptr;
 
-    if (n1 != n2)
-        return n1 < n2 ? -1 : 1;
+    if (capacity < n)
+        capacity = n;
+    if (capacity > ArrayValueHeader::kMaxCount)
+        capacity = ArrayValueHeader::kMaxCount;
 
-    for (int i = 0; i < n1; i++)
-    {
-        int eltCompare = data[i].Compare(other.data[i]);
+    ArrayValue* av;
 
-        if (eltCompare != 0)
-            return eltCompare;
+    if (capacity > n)
+    {
+        // Prefix the header with the capacity, so only arrays with room to grow need space for it
+        int64_t* block = static_cast<int64_t*>(::operator new(sizeof(int64_t) + sizeof(ArrayValueHeader) + size_t(capacity) * sizeof(Value)));
+        block[0] = capacity;
+        av = static_cast<ArrayValue*>(new (block + 1) ArrayValueHeader(n, ArrayValueHeader::kArrayGrowable));
+    }
+    else
+    {
+        av = static_cast<ArrayValue*>(::operator new(sizeof(ArrayValueHeader) + size_t(n) * sizeof(Value)));
+        new (av) ArrayValueHeader(n);
     }
 
-    return 0;
-}
-
+    Value* elts = av->Elts();
 
-// --- ObjectValue ------------------------------------------------------------
+    if (values)
+        for (int64_t i = 0; i < n; i++)
+            new (&elts[i]) Value(values[i]);
+    else
+        for (int64_t i = 0; i < n; i++)
+            new (&elts[i]) Value();
 
-ObjectValue::~ObjectValue()
-{
+    return av;
 }
 
-const Value& ObjectValue::Member(ValueKey key) const
+ArrayValue* HL::CreateArraySlice(const ArrayValue* source, int64_t first, int64_t n)
 {
-    MemberMap::const_iterator it = mMap.find(key);
+    int64_t count = source->count;
 
-    if (it != mMap.end())
-        return it->second;
+    first = first < 0 ? 0 : first > count ? count : first;
+    n     = n     < 0 ? 0 : n > count - first ? count - first : n;
 
-    return kNullValue;
-}
+    if (n == 0)
+        return CreateArrayValue(0);
 
-Value& ObjectValue::UpdateMember(ValueKey key, StringTable* st)
-{
-    mModCount++;
+    if (n == count)
+        return const_cast<ArrayValue*>(source);  // arrays are read-only once shared, so the whole can stand in for itself
 
-    MemberMap::iterator it = mMap.find(key);
-    if (it != mMap.end())
-        return it->second;
+    // Slices of slices refer directly to the original, so they don't form chains
+    if (const ArrayValue* original = source->SliceSource())
+    {
+        first += source->Elts() - original->Elts();
+        source = original;
+    }
+
+    ArraySliceHeader* slice = new ArraySliceHeader(source, first, n);
+    return static_cast<ArrayValue*>(static_cast<ArrayValueHeader*>(slice));
+}
+
+ArrayValue* HL::CreateArrayValue(const Values& values)
+{
+    int64_t n = int64_t(values.size());
+
+    if (!CheckArraySize(&n))
+        return CreateArrayValue(0);
+
+    ArrayValue* av = static_cast<ArrayValue*>(::operator new(sizeof(ArrayValueHeader) + size_t(n) * sizeof(Value)));
+    new (av) ArrayValueHeader(n);
+
+    Value* elts = av->Elts();
+
+    for (int64_t i = 0; i < n; i++)
+        new (&elts[i]) Value(values[i]);
+
+    return av;
+}
+
+ArrayValue* HL::CreateArrayValue(Values&& values)
+{
+    int64_t n = int64_t(values.size());
+
+    if (!CheckArraySize(&n))
+        return CreateArrayValue(0);
+
+    ArrayValue* av = static_cast<ArrayValue*>(::operator new(sizeof(ArrayValueHeader) + size_t(n) * sizeof(Value)));
+    new (av) ArrayValueHeader(n);
+
+    Value* elts = av->Elts();
+
+    for (int64_t i = 0; i < n; i++)
+        new (&elts[i]) Value(std::move(values[i]));
+
+    values.clear();
+
+    return av;
+}
+
+bool ArrayValue::operator == (const ArrayValue& other) const
+{
+    return count == other.count && CompareContents(Contents(this, &other), true) == 0;
+}
+
+int ArrayValue::Compare(const ArrayValue& other) const
+{
+    if (count != other.count)
+        return count < other.count ? -1 : 1;
+
+    return CompareContents(Contents(this, &other), false);
+}
+
+
+// --- ObjectShape ------------------------------------------------------------
+
+ObjectShapeHeader::~ObjectShapeHeader()
+{
+    StringValue** keys = (StringValue**) (((uint8_t*) this) + sizeof(ObjectShapeHeader));
+    for (int i = 0; i < count; i++)
+        keys[i]->Release();
+}
+
+int ObjectShape::KeyIndex(ValueKey key) const
+{
+    int lo = 0;
+    int hi = count;
+
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        int c = strcmp(keys[mid]->c_str(), key);
+
+        if (c == 0)
+            return mid;
+
+        if (c < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return -1;
+}
+
+int ObjectShape::KeyIndex(ValueKeySpan key) const
+{
+    int lo = 0;
+    int hi = count;
+
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        int c = CompareKey(keys[mid]->c_str(), key);
+
+        if (c == 0)
+            return mid;
+
+        if (c < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return -1;
+}
+
+ObjectShape* HL::CreateObjectShape(int n, StringValue* const keys[])
+{
+    ObjectShape* shape = static_cast<ObjectShape*>(::operator new(sizeof(ObjectShapeHeader) + n * sizeof(StringValue*)));
+    new (shape) ObjectShapeHeader(n);
+
+    for (int i = 0; i < n; i++)
+    {
+        shape->keys[i] = keys[i];
+        shape->keys[i]->AddRef();
+    }
+
+    return shape;
+}
+
+namespace
+{
+    const uint32_t kHashOffset32 = UINT32_C(0x811C9DC5);
+    const uint32_t kHashPrime32 = 0x01000193;
+
+    struct ShapeKeys
+    {
+        int                 count;
+        StringValue* const* keys;
+    };
+
+    struct ShapeSetHash
+    {
+        typedef size_t HashType;
+
+        using is_transparent = void;
+        using is_avalanching = void;
+
+        HashType operator () (const ObjectShapeRef& s) const
+        {
+            return operator()(ShapeKeys{ s->count, s->keys });
+        }
+
+        HashType operator () (const ShapeKeys& s) const
+        {
+            uint32_t hashValue = kHashOffset32;
+
+            for (int i = 0; i < s.count; i++)
+            {
+                const uint8_t* data = (const uint8_t*) s.keys[i]->c_str();
+                uint32_t c;
+
+                while ((c = *data++) != 0)
+                    hashValue = (hashValue ^ c) * kHashPrime32;
+
+                hashValue *= kHashPrime32;  // separator
+            }
+
+            return hashValue * UINT64_C(0x9ddfea08eb382d69);
+        }
+    };
+
+    struct ShapeSetEqual
+    {
+        using is_transparent = void;
+
+        bool operator () (const ShapeKeys& a, const ShapeKeys& b) const
+        {
+            if (a.count != b.count)
+                return false;
+
+            for (int i = 0; i < a.count; i++)
+                if (a.keys[i] != b.keys[i] && strcmp(a.keys[i]->c_str(), b.keys[i]->c_str()) != 0)
+                    return false;
+
+            return true;
+        }
+
+        bool operator () (const ObjectShapeRef& a, const ObjectShapeRef& b) const { return operator()(ShapeKeys{ a->count, a->keys }, ShapeKeys{ b->count, b->keys }); }
+        bool operator () (const ObjectShapeRef& a, const ShapeKeys&      b) const { return operator()(ShapeKeys{ a->count, a->keys }, b); }
+        bool operator () (const ShapeKeys&      a, const ObjectShapeRef& b) const { return operator()(a, ShapeKeys{ b->count, b->keys }); }
+    };
+}
+
+namespace HL
+{
+    struct ObjectShapeTableImpl : public ObjectShapeTable
+    {
+        ankerl::dense_hash_set<ObjectShapeRef, ShapeSetHash, ShapeSetEqual> mShapes;
+
+        ~ObjectShapeTableImpl()
+        {
+            mShapes.clear();
+        }
+    };
+}
+
+ObjectShape* ObjectShapeTable::FindShape(int count, StringValue* const keys[])
+{
+    ObjectShapeTableImpl* self = static_cast<ObjectShapeTableImpl*>(this);
+
+    ShapeKeys shapeKeys = { count, keys };
+
+    auto it = self->mShapes.find(shapeKeys);
+    if (it != self->mShapes.end())
+        return *it;
+
+    // First sighting. Don't bother sharing unless we see the same keys again.
+    self->mShapes.insert(ObjectShapeRef(CreateObjectShape(count, keys)));
+    return 0;
+}
+
+void ObjectShapeTable::Clear()
+{
+    ObjectShapeTableImpl* self = static_cast<ObjectShapeTableImpl*>(this);
+    self->mShapes.clear();
+}
+
+ObjectShapeTable* HL::CreateObjectShapeTable()
+{
+    return new ObjectShapeTableImpl;
+}
+
+
+// --- Array key indexes -------------------------------------------------------
+
+namespace
+{
+    struct KeyIndexHash
+    {
+        typedef size_t HashType;
+
+        using is_transparent = void;
+        using is_avalanching = void;
+
+        HashType operator () (const StringValueRef& s) const { return operator()(s->c_str()); }
+
+        HashType operator () (const char* s) const
+        {
+            const uint8_t* data = (const uint8_t*) s;
+            uint32_t hashValue = kHashOffset32;
+            uint32_t c;
+
+            while ((c = *data++) != 0)
+                hashValue = (hashValue ^ c) * kHashPrime32;
+
+            return hashValue * UINT64_C(0x9ddfea08eb382d69);
+        }
+    };
+
+    struct KeyIndexEqual
+    {
+        using is_transparent = void;
+
+        bool operator () (const StringValueRef& a, const StringValueRef& b) const { return a == b || strcmp(a->c_str(), b->c_str()) == 0; }
+        bool operator () (const StringValueRef& a, const char*           b) const { return strcmp(a->c_str(), b) == 0; }
+        bool operator () (const char*           a, const StringValueRef& b) const { return strcmp(a, b->c_str()) == 0; }
+    };
+
+    struct ArrayKeyIndex
+    {
+        String          key;
+        ArrayKeyIndex*  next = nullptr;
+
+        ankerl::dense_hash_map<StringValueRef, int64_t, KeyIndexHash, KeyIndexEqual> elts;  // Holds refs so entries stay valid even if an element is edited
+    };
+
+    struct ArrayPtrHash
+    {
+        uint64_t operator () (const ArrayValueHeader* a) const
+        {
+            uint64_t h = uint64_t(uintptr_t(a)) * UINT64_C(0x9E3779B97F4A7C15);
+            return h ^ (h >> 29);
+        }
+    };
+
+    struct KeyIndexTable
+    // Indexes built by FindEltIndex(), as lists per array, newest first. Arrays flag whether they have an entry, so
+    // others never need to look here. Each list is only added to once published, and only deleted when its array is
+    // modified or destroyed, so it can be read after the lock is released.
+    {
+        std::shared_mutex mutex;
+        ankerl::dense_hash_map<const ArrayValueHeader*, ArrayKeyIndex*, ArrayPtrHash> lists;
+    };
+
+    KeyIndexTable& KeyIndexes()
+    {
+        static KeyIndexTable* table = new KeyIndexTable;  // never freed, as arrays in static values may outlive it otherwise
+        return *table;
+    }
+}
+
+int64_t ArrayValue::FindEltIndex(ValueKey key, const char* name) const
+{
+    KeyIndexTable& table = KeyIndexes();
+    const ArrayKeyIndex* index = nullptr;
+
+    if (flags.load(std::memory_order_acquire) & kArrayKeyIndexed)
+    {
+        std::shared_lock<std::shared_mutex> lock(table.mutex);
+        auto it = table.lists.find(this);
+
+        if (it != table.lists.end())
+            index = it->second;
+    }
+
+    while (index && index->key != key)
+        index = index->next;
+
+    if (!index)
+    {
+        ArrayKeyIndex* newIndex = new ArrayKeyIndex;
+        newIndex->key = key;
+        const Value* elts = Elts();
+
+        for (int64_t i = 0; i < count; i++)
+        {
+            const Value& v = elts[i].Member(key);
+
+            if (v.IsString())
+                newIndex->elts.emplace(StringValueRef(v.mValue.mString), i);  // first one wins
+        }
+
+        // Another thread may be doing the same, in which case we just wind up with a redundant index
+        std::unique_lock<std::shared_mutex> lock(table.mutex);
+        ArrayKeyIndex*& list = table.lists[this];
+
+        newIndex->next = list;
+        list = newIndex;
+        flags.fetch_or(kArrayKeyIndexed, std::memory_order_release);
+
+        index = newIndex;
+    }
+
+    auto it = index->elts.find(name);
+
+    if (it == index->elts.end())
+        return -1;
+
+    return it->second;
+}
+
+void ArrayValueHeader::DeleteKeyIndexes() const
+{
+    KeyIndexTable& table = KeyIndexes();
+    ArrayKeyIndex* index = nullptr;
+
+    {
+        std::unique_lock<std::shared_mutex> lock(table.mutex);
+        auto it = table.lists.find(this);
+
+        if (it != table.lists.end())
+        {
+            index = it->second;
+            table.lists.erase(it);
+        }
+
+        flags.fetch_and(~uint32_t(kArrayKeyIndexed), std::memory_order_relaxed);
+    }
+
+    while (index)
+    {
+        ArrayKeyIndex* next = index->next;
+        delete index;
+        index = next;
+    }
+}
+
+
+// --- ObjectValue ------------------------------------------------------------
+
+ObjectValue::ObjectValue(const ObjectValue& other) :
+    mModCount(other.mModCount),
+    mMap(other.mMap)
+{
+    if (other.mShape)
+    {
+        int n = other.mShape->count;
+        const Value* values = other.ShapeValues();
+
+        mMap.reserve(n);
+        for (int i = 0; i < n; i++)
+            mMap.emplace_back(StringValueRef(other.mShape->keys[i]), values[i]);
+    }
+}
+
+void ObjectValue::operator = (const ObjectValue& other)
+{
+    if (&other == this)
+        return;
+
+    if (mShape)
+        Unshape();
+
+    if (other.mShape)
+    {
+        int n = other.mShape->count;
+        const Value* values = other.ShapeValues();
+
+        mMap.clear();
+        mMap.reserve(n);
+        for (int i = 0; i < n; i++)
+            mMap.emplace_back(StringValueRef(other.mShape->keys[i]), values[i]);
+    }
+    else
+        mMap = other.mMap;
+
+    mModCount++;
+}
+
+ObjectValue::~ObjectValue()
+{
+    if (mShape)
+    {
+        Value* values = ShapeValues();
+        for (int i = 0, n = mShape->count; i < n; i++)
+            values[i].~Value();
+
+        mShape->Release();
+    }
+}
+
+ObjectValue* ObjectValue::CreateShaped(ObjectShape* shape)
+{
+    int n = shape->count;
+
+    ObjectValue* object = static_cast<ObjectValue*>(::operator new(sizeof(ObjectValue) + n * sizeof(Value)));
+    new (object) ObjectValue;
+
+    object->mShape = shape;
+    shape->AddRef();
+
+    Value* values = object->ShapeValues();
+    for (int i = 0; i < n; i++)
+        new (&values[i]) Value();
+
+    return object;
+}
+
+void ObjectValue::Unshape()
+{
+    // We leave the now-unused value storage in place, it's freed along with the object.
+    int n = mShape->count;
+    Value* values = ShapeValues();
+
+    HL_ASSERT(mMap.empty());
+    mMap.reserve(n);
+
+    for (int i = 0; i < n; i++)
+    {
+        mMap.emplace_back(StringValueRef(mShape->keys[i]), std::move(values[i]));
+        values[i].~Value();
+    }
+
+    mShape->Release();
+    mShape = 0;
+}
+
+ObjectValue* HL::CreateObjectValue(const ObjectValue& other)
+{
+    if (!other.mShape)
+        return new ObjectValue(other);
+
+    ObjectValue* object = ObjectValue::CreateShaped(other.mShape);
+    object->mModCount = other.mModCount;
+
+    Value* values = object->ShapeValues();
+    const Value* otherValues = other.ShapeValues();
+
+    for (int i = 0, n = other.mShape->count; i < n; i++)
+        values[i] = otherValues[i];
+
+    return object;
+}
+
+namespace
+{
+    inline StringValue* CreateKey(ValueKey key, StringTable* st)
+    {
+    #ifdef HL_STRING_TABLE_HPP
+        if (st)
+            return st->GetString(key);
+    #endif
+        return CreateStringValue(key);
+    }
+
+    inline StringValue* CreateKey(ValueKeySpan key, StringTable* st)
+    {
+    #ifdef HL_STRING_TABLE_HPP
+        if (st)
+            return st->GetString(key.data, key.size);
+    #endif
+        return CreateStringValue(key.data, key.size);
+    }
+
+    inline StringValue* CreateKey(StringValue* key, StringTable*)
+    {
+        return key;
+    }
+
+    inline ValueKey AsKey(StringValue* key)
+    {
+        return key->c_str();
+    }
+
+    template<class K> inline K AsKey(K key)
+    {
+        return key;
+    }
+}
+
+template<class K> int ObjectValue::FindIndex(K key) const
+{
+    if (mShape)
+        return mShape->KeyIndex(key);
+
+    auto it = mMap.find(key);
+
+    if (it != mMap.end())
+        return int(it - mMap.begin());
+
+    return -1;
+}
+
+template<class K> Value& ObjectValue::Update(K key, StringTable* st)
+{
+    mModCount++;
+
+    if (mShape)
+    {
+        int i = mShape->KeyIndex(AsKey(key));
+        if (i >= 0)
+            return ShapeValues()[i];
+
+        Unshape();
+    }
+
+    auto it = std::lower_bound(mMap.begin(), mMap.end(), AsKey(key), MemberMap::KeyLess());
+
+    if (it != mMap.end() && !MemberMap::KeyLess()(AsKey(key), *it))
+        return it->second;
+
+    if (mMap.size() >= size_t(kMaxMembers))
+    {
+        HL_ERROR("Object is at its maximum size");
+        kNullValueScratch.MakeNull();
+        return kNullValueScratch;
+    }
+
+    return mMap.insert(it, { StringValueRef(CreateKey(key, st)), Value() })->second;
+}
+
+template<class K> bool ObjectValue::Remove(K key)
+{
+    int i = FindIndex(key);
 
-#ifdef HL_STRING_TABLE_HPP
-    if (st)
-        return mMap[StringValueRef(st->GetString(key))];
-#endif
+    if (i < 0)
+        return false;
+
+    if (mShape)
+        Unshape();
+
+    mMap.erase(mMap.begin() + i);
+    mModCount++;
+
+    return true;
+}
+
+const Value& ObjectValue::Member(ValueKey key) const
+{
+    int i = FindIndex(key);
+    return i >= 0 ? MemberValue(i) : kNullValue;
+}
+
+const Value& ObjectValue::Member(ValueKeySpan key) const
+{
+    int i = FindIndex(key);
+    return i >= 0 ? MemberValue(i) : kNullValue;
+}
 
-    return mMap[StringValueRef(CreateStringValue(key))];
+Value& ObjectValue::UpdateMember(ValueKey key, StringTable* st)
+{
+    return Update(key, st);
+}
+
+Value& ObjectValue::UpdateMember(ValueKeySpan key, StringTable* st)
+{
+    return Update(key, st);
 }
 
 Value& ObjectValue::UpdateMember(StringValue* key)
+{
+    return Update(key, 0);
+}
+
+void ObjectValue::UpdateMembers(int n, const ValueKeySpan keys[], Value* members[], StringTable* st)
 {
     mModCount++;
 
-    MemberMap::iterator it = mMap.find(key);
-    if (it != mMap.end())
-        return it->second;
+    if (mShape)
+    {
+        int j = 0;
+
+        for (; j < n; j++)
+        {
+            int i = mShape->KeyIndex(keys[j]);
+
+            if (i < 0)
+                break;
+
+            members[j] = &ShapeValues()[i];
+        }
 
-    return mMap[AutoRef<StringValue>(key)];
+        if (j == n)
+            return;
+
+        Unshape();
+    }
+
+    // Find how many keys are new via a linear merge against our (sorted) members
+    MemberMap::super& map = mMap;  // for index access
+
+    int numOld = size_i(map);
+    int numNew = 0;
+
+    for (int i = 0, j = 0; j < n; j++)
+    {
+        while (i < numOld && CompareKey(map[i].first->c_str(), keys[j]) < 0)
+            i++;
+
+        if (i == numOld || CompareKey(map[i].first->c_str(), keys[j]) != 0)
+            numNew++;
+    }
+
+    if (numNew > kMaxMembers - numOld)
+    {
+        HL_ERROR("Object is at its maximum size");
+        kNullValueScratch.MakeNull();
+
+        for (int j = 0; j < n; j++)
+            members[j] = &kNullValueScratch;
+        return;
+    }
+
+    // Then merge from the end, so each existing member moves at most once
+    map.resize(numOld + numNew);
+
+    int i = numOld - 1;
+    int dst = numOld + numNew - 1;
+
+    for (int j = n - 1; j >= 0; j--)
+    {
+        int c = -1;
+
+        while (i >= 0 && (c = CompareKey(map[i].first->c_str(), keys[j])) > 0)
+        {
+            if (dst != i)
+                map[dst] = std::move(map[i]);
+            dst--;
+            i--;
+        }
+
+        if (i >= 0 && c == 0)
+        {
+            if (dst != i)
+                map[dst] = std::move(map[i]);
+            i--;
+        }
+        else
+            map[dst] = { StringValueRef(CreateKey(keys[j], st)), Value() };
+
+        members[j] = &map[dst--].second;
+    }
 }
 
 const Value* ObjectValue::MemberPtr(ValueKey key) const
 {
-    auto it = mMap.find(key);
-
-    if (it != mMap.end())
-        return &it->second;
+    int i = FindIndex(key);
+    return i >= 0 ? &MemberValue(i) : 0;
+}
 
-    return 0;
+const Value* ObjectValue::MemberPtr(ValueKeySpan key) const
+{
+    int i = FindIndex(key);
+    return i >= 0 ? &MemberValue(i) : 0;
 }
 
 Value* ObjectValue::UpdateMemberPtr(ValueKey key)
 {
-    auto it = mMap.find(key);
+    int i = FindIndex(key);
 
-    if (it != mMap.end())
-    {
-        mModCount++;
-        return &it->second;
-    }
+    if (i < 0)
+        return 0;
 
-    return 0;
+    mModCount++;
+    return &MemberValue(i);
 }
 
 void ObjectValue::SetMember(ValueKey key, const Value& v)
@@ -1043,85 +1956,291 @@ void ObjectValue::SetMember(ValueKey key, const Value& v)
 
 bool ObjectValue::RemoveMember(ValueKey key)
 {
-    auto it = mMap.find(key);
-
-    if (it == mMap.end())
-        return false;
-
-    mMap.erase(it);
-    mModCount++;
+    return Remove(key);
+}
 
-    return true;
+bool ObjectValue::RemoveMember(ValueKeySpan key)
+{
+    return Remove(key);
 }
 
 bool ObjectValue::HasMember(ValueKey key) const
 {
-    if (mMap.find(key) != mMap.end())
-        return true;
+    return FindIndex(key) >= 0;
+}
 
-    return false;
+bool ObjectValue::HasMember(ValueKeySpan key) const
+{
+    return FindIndex(key) >= 0;
 }
 
 void ObjectValue::Merge(const ObjectValue& overrides)
 {
-    for (ConstNameValue nv : overrides)
-        if (nv.value.IsNull())
-            RemoveMember(nv.name);
+    Merge(overrides, nullptr);
+}
+
+void ObjectValue::Merge(const ObjectValue& overrides, const MergeCallback& callback, const char* path)
+{
+    // Nested objects are merged via an explicit stack rather than recursively, so depth isn't an issue
+    struct MergePair
+    {
+        ObjectValue*       target;
+        const ObjectValue* source;
+        int                i;
+        size_t             pathSize;  // Length of the target's path, if there's a callback
+    };
+
+    String memberPath(callback ? path : "");
+    std::vector<MergePair> stack = { { this, &overrides, 0, memberPath.size() } };
+
+    while (!stack.empty())
+    {
+        MergePair& pair = stack.back();
+
+        if (pair.i == pair.source->NumMembers())
+        {
+            stack.pop_back();
+            continue;
+        }
+
+        int i = pair.i++;
+        ObjectValue* target = pair.target;
+        const char*  name   = pair.source->MemberName(i);
+        const Value& value  = pair.source->MemberValue(i);
+
+        if (callback)
+        {
+            memberPath.resize(pair.pathSize);
+            if (!memberPath.empty())
+                memberPath += '.';
+            memberPath += name;
+        }
+
+        if (value.IsNull())
+        {
+            if (target->RemoveMember(name) && callback)
+                callback(kMergeRemove, memberPath, nullptr);
+        }
         else
-            UpdateMember(nv.name).Merge(nv.value);
+        {
+            Value& member = target->UpdateMember(name);
+
+            if (value.IsObject() && member.IsObject())
+            {
+                if (callback)
+                    callback(kMergeDescend, memberPath, &member);
+
+                stack.push_back({ member.AsObjectPtr(), &value.AsObject(), 0, memberPath.size() });
+            }
+            else
+            {
+                member = value;
+
+                if (callback)
+                    callback(kMergeSet, memberPath, &member);
+            }
+        }
+    }
 }
 
 int ObjectValue::MemberIndex(ValueKey key) const
 {
-    auto it = mMap.find(key);
-    if (it != mMap.end())
-        return int(it - mMap.begin());
+    return FindIndex(key);
+}
 
-    return -1;
+int ObjectValue::MemberIndex(ValueKeySpan key) const
+{
+    return FindIndex(key);
 }
 
 uint32_t ObjectValue::MemberID(int index) const
 {
-    return IDFromString(mMap.at(index).first->c_str());
+    return IDFromString(MemberName(index));
 }
 
 void ObjectValue::Swap(ObjectValue* other)
 {
+    if (mShape)
+        Unshape();
+    if (other->mShape)
+        other->Unshape();
+
     mMap.swap(other->mMap);
 
     mModCount++;
     other->mModCount++;
 }
 
-int ObjectValue::Compare(const ObjectValue& other) const
+bool ObjectValue::operator == (const ObjectValue& other) const
 {
-    const ObjectValue& m1 = *this;
-    const ObjectValue& m2 = other;
+    return NumMembers() == other.NumMembers() && CompareContents(Contents(this, &other), true) == 0;
+}
 
-    int n1 = m1.NumMembers();
-    int n2 = m2.NumMembers();
+int ObjectValue::Compare(const ObjectValue& other) const
+{
+    int n1 = NumMembers();
+    int n2 = other.NumMembers();
 
     if (n1 != n2)
         return n1 < n2 ? -1 : 1;
 
-    for (int i = 0; i < n1; i++)
+    return CompareContents(Contents(this, &other), false);
+}
+
+const ObjectValue HL::kNullObjectValue;
+
+
+// --- Builders ---------------------------------------------------------------
+
+void ArrayBuilder::Reserve(size_t n)
+{
+    mValues.reserve(n);
+}
+
+Value& ArrayBuilder::Add()
+{
+    mValues.emplace_back();
+    return mValues.back();
+}
+
+void ArrayBuilder::Add(const Value& v)
+{
+    mValues.push_back(v);
+}
+
+void ArrayBuilder::Add(Value&& v)
+{
+    mValues.push_back(std::move(v));
+}
+
+ArrayValue* ArrayBuilder::Finish()
+{
+    return CreateArrayValue(std::move(mValues));
+}
+
+void ArrayBuilder::Finish(Value* v)
+{
+    *v = Finish();
+}
+
+ObjectBuilder::ObjectBuilder(StringTable* st, ObjectShapeTable* shapes) :
+    mStringTable(st),
+    mShapeTable(shapes)
+{
+}
+
+void ObjectBuilder::Reserve(size_t n)
+{
+    mMembers.reserve(n);
+}
+
+Value& ObjectBuilder::Add(ValueKey key)
+{
+#ifdef HL_STRING_TABLE_HPP
+    if (mStringTable)
+        return Add(mStringTable->GetString(key));
+#endif
+
+    return Add(CreateStringValue(key));
+}
+
+Value& ObjectBuilder::Add(ValueKeySpan key)
+{
+#ifdef HL_STRING_TABLE_HPP
+    if (mStringTable)
+        return Add(mStringTable->GetString(key.data, key.size));
+#endif
+
+    return Add(CreateStringValue(key.data, key.size));
+}
+
+Value& ObjectBuilder::Add(StringValue* key)
+{
+    mMembers.emplace_back(StringValueRef(key), Value());
+    return mMembers.back().second;
+}
+
+void ObjectBuilder::Add(ValueKey key, const Value& v)
+{
+    Add(key) = v;
+}
+
+void ObjectBuilder::Add(ValueKey key, Value&& v)
+{
+    Add(key) = std::move(v);
+}
+
+namespace
+{
+    inline int CompareKeys(const StringValue* a, const StringValue* b)
+    {
+        return a == b ? 0 : strcmp(a->c_str(), b->c_str());  // interned keys compare by pointer
+    }
+}
+
+ObjectValue* ObjectBuilder::Finish()
+{
+    typedef std::pair<StringValueRef, Value> Member;
+
+    auto keyLess = [](const Member& a, const Member& b) { return CompareKeys(a.first, b.first) < 0; };
+
+    // Sources are usually in order already, so check before sorting. A stable sort keeps duplicates in the order
+    // added, so the last of each run is the one to keep.
+    if (!std::is_sorted(mMembers.begin(), mMembers.end(), keyLess))
+        std::stable_sort(mMembers.begin(), mMembers.end(), keyLess);
+
+    size_t n = mMembers.size();
+    size_t j = 0;
+
+    for (size_t i = 0; i < n; i++)
     {
-        const char* key1 = m1.MemberName(i);
-        const char* key2 = m2.MemberName(i);
+        if (i + 1 < n && CompareKeys(mMembers[i].first, mMembers[i + 1].first) == 0)
+            continue;
 
-        int keyCompare = ::Compare(key1, key2);
-        if (keyCompare != 0)
-            return keyCompare;
+        if (j != i)
+            mMembers[j] = std::move(mMembers[i]);
+        j++;
+    }
 
-        int valueCompare = m1.MemberValue(i).Compare(m2.MemberValue(i));
-        if (valueCompare != 0)
-            return valueCompare;
+    if (j > size_t(ObjectValue::kMaxMembers))
+    {
+        HL_ERROR("Too many members for an object");
+        j = ObjectValue::kMaxMembers;
     }
 
-    return 0;
+    mMembers.resize(j);
+
+    if (mShapeTable && j > 0)
+    {
+        mKeys.clear();
+        for (const Member& m : mMembers)
+            mKeys.push_back(m.first);
+
+        if (ObjectShape* shape = mShapeTable->FindShape(int(j), mKeys.data()))
+        {
+            ObjectValue* object = ObjectValue::CreateShaped(shape);
+            Value* values = object->ShapeValues();
+
+            for (size_t i = 0; i < j; i++)
+                values[i] = std::move(mMembers[i].second);
+
+            mMembers.clear();
+            return object;
+        }
+    }
+
+    // The accumulated members become the object's storage as is
+    ObjectValue* object = new ObjectValue;
+    static_cast<std::vector<Member>&>(object->mMap).swap(mMembers);
+    mMembers.clear();
+
+    return object;
 }
 
-const ObjectValue HL::kNullObjectValue;
+void ObjectBuilder::Finish(Value* v)
+{
+    *v = Finish();
+}
 
 
 // --- Utilities ---------------------------------------------------------------
@@ -1171,7 +2290,7 @@ namespace
 
             v->resize(av.size());
 
-            for (int i = 0, n = size_i(value); i < n; i++)
+            for (size_t i = 0, n = av.size(); i < n; i++)
                 (*v)[i] = asFunc(av[i]);
 
             return true;
@@ -1248,7 +2367,10 @@ template<class T> void HL::SetFromArray(int n, const T array[], Value* v)
 
 template<class T> void HL::SetFromArray(const std::vector<T>& array, Value* v)
 {
-    SetFromArray(size_i(array), array.data(), v);
+    ArrayValue& av = v->MakeArray(array.size());
+
+    for (size_t i = 0, n = av.size(); i < n; i++)
+        av[i] = array[i];
 }
 
 // Instantiate just what we need
@@ -1274,13 +2396,14 @@ template void HL::SetFromArray<Value      >(const std::vector<Value      >& arra
 
 namespace
 {
-    const Value& PathField(const Value& v, const char* key)
+    // Path fields are slices of the full path, e.g., "a", ".b", "[2]"
+    const Value& PathField(const Value& v, const char* key, size_t len)
     {
         if (v.IsArray() && key[0] == '[')
         {
             key++;
             char* end = nullptr;
-            size_t index = strtol(key, &end, 10);
+            size_t index = size_t(strtoll(key, &end, 10));
 
             if (*end != ']' || index >= v.size())
                 return kNullValue;
@@ -1288,19 +2411,16 @@ namespace
             return v[index];
         }
 
-        if (key[0] == '.')
-            key++;
-
-        return v.Member(key);
+        return v.Member(PathFieldKey(key, len));
     }
 
-    Value& UpdatePathField(Value& v, const char* key)
+    Value& UpdatePathField(Value& v, const char* key, size_t len)
     {
         if (v.IsArray() && key[0] == '[')
         {
             key++;
             char* end = nullptr;
-            size_t index = strtol(key, &end, 10);
+            size_t index = size_t(strtoll(key, &end, 10));
 
             if (*end != ']' || index >= v.size())
             {
@@ -1314,35 +2434,121 @@ namespace
             return v[index];
         }
 
-        if (key[0] == '.')
-            key++;
-
-        return v.UpdateMember(key);
+        return v.UpdateMember(PathFieldKey(key, len));
     }
 }
 
 const Value& HL::MemberPath(const Value& v, const char* path)
 {
-    size_t sep_pos = strcspn(path + 1, ".[") + 1;
+    const Value* result = &v;
 
-    if (path[sep_pos] != 0)
+    do
     {
-        String field(path, sep_pos);
-        return MemberPath(PathField(v, field), path + sep_pos);
+        size_t len = PathFieldLength(path);
+
+        result = &PathField(*result, path, len);
+        path += len;
     }
+    while (*path);
 
-    return PathField(v, path);
+    return *result;
 }
 
 Value& HL::UpdateMemberPath(Value& v, const char* path)
 {
-    size_t sep_pos = strcspn(path + 1, ".[") + 1;
+    Value* result = &v;
+
+    do
+    {
+        size_t len = PathFieldLength(path);
+
+        result = &UpdatePathField(*result, path, len);
+        path += len;
+    }
+    while (*path);
+
+    return *result;
+}
+
+
+#ifdef HL_VALUE_COMMENTS
+// --- ValueComments -----------------------------------------------------------
+
+void ValueComments::AppendKey(String* path, const char* key, size_t len)
+{
+    if (!path->empty())
+        *path += '.';
+
+    if (len == 0)
+        *path += '\\';
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (key[i] == '.' || key[i] == '[' || key[i] == '\\')
+            *path += '\\';
+
+        *path += key[i];
+    }
+}
+
+void ValueComments::SetComment(const char* path, const char* comment, CommentPlacement placement)
+{
+    auto it = mComments.find(path);
 
-    if (path[sep_pos] != 0)
+    if (it == mComments.end())
     {
-        String field(path, sep_pos);
-        return UpdateMemberPath(UpdatePathField(v, field), path + sep_pos);
+        if (!comment || !comment[0])
+            return;
+
+        it = mComments.insert({ String(path), Comments() }).first;
     }
 
-    return UpdatePathField(v, path);
+    it->second.mText[placement] = comment ? comment : "";
+}
+
+bool ValueComments::HasComment(const char* path, CommentPlacement placement) const
+{
+    auto it = mComments.find(path);
+
+    return it != mComments.end() && !it->second.mText[placement].empty();
+}
+
+bool ValueComments::HasComment(const char* path) const
+{
+    auto it = mComments.find(path);
+
+    if (it == mComments.end())
+        return false;
+
+    for (const String& text : it->second.mText)
+        if (!text.empty())
+            return true;
+
+    return false;
+}
+
+const char* ValueComments::Comment(const char* path, CommentPlacement placement) const
+{
+    auto it = mComments.find(path);
+
+    if (it != mComments.end())
+        return it->second.mText[placement].c_str();
+
+    return "";
+}
+
+size_t ValueComments::size() const
+{
+    return mComments.size();
+}
+
+bool ValueComments::empty() const
+{
+    return mComments.empty();
 }
+
+void ValueComments::clear()
+{
+    mComments.clear();
+}
+#endif
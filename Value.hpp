@@ -10,11 +10,13 @@
 #define HL_VALUE_H
 
 // #define HL_VALUE_COMMENTS  // Whether to allow preservation of comments from source files
+// #define HL_VALUE_PROFILE   // Whether to count reads of each value, to find hot and unused keys. See ValueProfile.hpp
 
 #include "RefCount.hpp"
 #include "String.hpp"
 #include "vector_map.hpp"
 
+#include <functional>
 #include <stdint.h>
 #include <string.h>
 
@@ -39,6 +41,14 @@ namespace HL
 
     typedef const char* ValueKey;
 
+    struct ValueKeySpan  // Key that needn't be 0-terminated, e.g., a slice of a larger buffer. Use as Member({ s, len }).
+    {
+        const char* data;
+        size_t      size;
+    };
+
+    int CompareKey(const char* s, ValueKeySpan key);  // strcmp() equivalent for a key span
+
 #ifdef HL_VALUE_COMMENTS
     enum CommentPlacement : uint8_t
     {
@@ -59,6 +69,17 @@ namespace HL
     class Value;
     typedef std::vector<Value> Values;
 
+#ifdef HL_VALUE_PROFILE
+    void CountValueAccess(const Value* v);  // Counts a read of 'v' on the calling thread's counters
+    const Value& ValueAccessed(const Value& v);
+
+    #define HL_VALUE_READ(V)   HL::ValueAccessed(V)
+    #define HL_VALUE_COUNT(P)  HL::CountValueAccess(P)
+#else
+    #define HL_VALUE_READ(V)   (V)
+    #define HL_VALUE_COUNT(P)  ((void) 0)
+#endif
+
     class Value
     // Represents a generically typed value, of type Type() = ValueType.
     // Note: this is designed to fail gracefully rather than asserting or crashing.
@@ -69,7 +90,7 @@ namespace HL
     public:
         Value();
         Value(const Value& other);
-        Value(Value&& other);
+        Value(Value&& other) noexcept;  // noexcept so std::vector moves rather than copies on growth
 
         explicit Value(ValueType          type);   // Default value of given type
         explicit Value(bool               value);
@@ -107,7 +128,7 @@ namespace HL
         void operator = (ArrayValue*        value);  // Adds a reference to 'value' rather than copying.
         void operator = (ObjectValue*       value);  // Adds a reference to 'value' rather than copying.
 
-        void Swap(Value& other);  // Swap values. Currently, comments are intentionally not swapped, for both logic and efficiency.
+        void Swap(Value& other);  // Swap values
 
         ValueType      Type() const;
 
@@ -141,9 +162,15 @@ namespace HL
         const ObjectValue& AsObject() const;   // Returns object or kNullObjectValue if not an object
 
         // Array API
-        const Value&   Elt(int index) const; // Access an array element
-        Value&         Elt(int index);       // Access an array element
-        int            NumElts() const;      // Returns number of elements in array
+        const Value&   Elt(int64_t index) const; // Access an array element
+        Value&         Elt(int64_t index);       // Access an array element
+        int64_t        NumElts() const;          // Returns number of elements in array
+        const Value&   FindElt(ValueKey key, const char* name) const;  // Returns first element object whose member 'key' is the string 'name', e.g., passes.FindElt("name", "main"), or null if none. O(1) after the first call for 'key'.
+        Value          Slice(int64_t first, int64_t count = INT64_MAX) const;  // Returns elements [first, first + count), clamped to the array, as an array sharing this one's storage rather than copying them. See CreateArraySlice().
+
+        Value&         AppendElt(const Value& v);  // Append 'v' to the array, converting null to an array, and returning the new element. Amortised O(1); a shared array is copied first.
+        Value&         AppendElt(Value&& v);       // Move variant of the above
+        void           ReserveElts(int64_t n);     // Ensure the array can hold n elements before AppendElt() needs to reallocate
 
         // Object API
         const Value&   Member         (ValueKey key) const;  // Return the member if it exists, kNullValue otherwise.
@@ -155,6 +182,13 @@ namespace HL
         bool           RemoveMember   (ValueKey key);        // Remove the named member, or return false if it doesn't exist.
         bool           HasMember      (ValueKey key) const;  // Return true if the object has a member named key.
 
+        // Variants taking keys that needn't be terminated
+        const Value&   Member         (ValueKeySpan key) const;
+        Value&         UpdateMember   (ValueKeySpan key);
+        const Value*   MemberPtr      (ValueKeySpan key) const;
+        bool           RemoveMember   (ValueKeySpan key);
+        bool           HasMember      (ValueKeySpan key) const;
+
         int            NumMembers() const;         // Returns number of members, or 0 if is not an object.
         const char*    MemberName (int i) const;   // Returns i'th member name
         uint32_t       MemberID   (int i) const;   // Returns i'th member id
@@ -181,14 +215,6 @@ namespace HL
         bool          empty() const;        // Return true if empty array, empty object, or null; otherwise, false.
         void          clear();              // Remove all object members, string characters, or array elements.
 
-    #ifdef HL_VALUE_COMMENTS
-        // Comments
-        void SetComment(const char* comment, CommentPlacement placement);  // Comments must be //... or /* ... */
-        bool HasComment(CommentPlacement placement) const;                 // Returns true if a comment exists in the given place.
-
-        const char* Comment(CommentPlacement placement) const;             // Include delimiters and embedded newlines.
-    #endif
-
         // Comparisons
         bool operator <  (const Value& other) const;
         bool operator <= (const Value& other) const;
@@ -211,7 +237,7 @@ namespace HL
         bool         ToArray();      // If null, convert to a null array, returns true in this case or if array already
         bool         ToObject();     // If null, convert to an object, returns true in this case or if object already
 
-        ArrayValue*  AsArrayPtr();  // Returns modifiable array or nullptr. Be aware arrays may be shared between objects.
+        ArrayValue*  AsArrayPtr();  // Returns modifiable array or nullptr. Be aware arrays may be shared between objects. Slices are first replaced by a copy of their elements.
         ArrayValue*  ToArrayPtr();  // Returns modifiable array or nullptr, auto-converting null value if necessary
 
         ObjectValue* AsObjectPtr();  // Returns modifiable object or nullptr. Be aware objects may be shared between objects.
@@ -240,9 +266,6 @@ namespace HL
         ValueHolder mValue = { 0 };  // mValue is public for efficient access when type is known. Use the AsXXX() methods when the type is unknown, as they handle, e.g., bool/int/float conversions.
 
     protected:
-    #ifdef HL_VALUE_COMMENTS
-        String*     mComments = 0;
-    #endif
         ValueType   mType = kValueNull;
         uint8_t     mDummy[3] = {0};
     };
@@ -273,6 +296,50 @@ namespace HL
     const Value& MemberPath(const Value& v, const char* path);  // v.Member, but handles extended objects/array lookup, e.g. "a.b.c", "a.b[2]"
     Value& UpdateMemberPath(      Value& v, const char* path);  // v.Member, but handles extended objects/array lookup, e.g. "a.b.c", "a.b[2]"
 
+    // Path fields are slices of the full path, e.g., "a", ".b", "[2]". Use these rather than parsing paths directly,
+    // so all modules agree on the syntax.
+    size_t       PathKeyLength  (const char* key);                // Length of the member name starting at 'key', which ends at the next '.' or '['
+    size_t       PathFieldLength(const char* path);               // Length of the field starting at 'path', or 0 at the end
+    ValueKeySpan PathFieldKey   (const char* field, size_t len);  // Member name of the given field, i.e., without any leading '.'
+
+
+#ifdef HL_VALUE_COMMENTS
+    // --- ValueComments ------------------------------------------------------
+
+    class ValueComments
+    // Side table of the comments for a document, keyed by value path in MemberPath() form, e.g., "a.b[2]", with ""
+    // being the root. Keeping these out of Value means only documents that want comments pay for them. Member names
+    // are escaped as per AppendKey(), so a member "c.d" can't be confused with member "d" of "c".
+    {
+    public:
+        static void AppendKey(String* path, const char* key, size_t len);  // Appends a member field to 'path', with any '.', '[', or '\' in 'key' preceded by '\', and an empty key as a lone '\'
+
+        void        SetComment(const char* path, const char* comment, CommentPlacement placement);  // Comments must be //... or /* ... */
+        bool        HasComment(const char* path, CommentPlacement placement) const;  // Returns true if a comment exists in the given place.
+        bool        HasComment(const char* path) const;                              // Returns true if a comment exists in any place.
+        const char* Comment   (const char* path, CommentPlacement placement) const;  // Includes delimiters and embedded newlines.
+
+        size_t      size() const;   // Number of values with comments
+        bool        empty() const;
+        void        clear();
+
+    protected:
+        struct PathLess
+        {
+            bool operator () (const String& a, const String& b) const { return strcmp(a.c_str(), b.c_str()) < 0; }
+            bool operator () (const String& a, const char*   b) const { return strcmp(a.c_str(), b        ) < 0; }
+            bool operator () (const char*   a, const String& b) const { return strcmp(a        , b.c_str()) < 0; }
+        };
+
+        struct Comments
+        {
+            String mText[kNumberOfCommentPlacements];
+        };
+
+        vector_map<String, Comments, PathLess> mComments;
+    };
+#endif
+
 
     // Non-scalar values: String/Array/ObjectValue
 
@@ -299,55 +366,143 @@ namespace HL
 
     typedef AutoRef<StringValue> StringValueRef;
 
-    StringValue* CreateStringValue(const char* str, size_t len = 0); // Creates a new StringValue object
+    StringValue* CreateStringValue(const char* str);              // Creates a new StringValue object
+    StringValue* CreateStringValue(const char* str, size_t len);  // Creates a new StringValue object from the first 'len' characters of 'str', which needn't be terminated
 
 
     // --- ArrayValue --------------------------------------------------------
 
-    struct ArrayValueHeader : public ValueRC
+    struct ArrayValueHeader
+    // Arrays aren't ValueRCs: they keep their own ref count, so as not to pay for a vtable pointer, which keeps the
+    // header to 16 bytes on 64-bit platforms with a 64-bit count. Elements directly follow the header, except for
+    // slices, which keep their extra state in ArraySliceHeader. Arrays grown via AppendElt() or ReserveElts() store
+    // their capacity just before the header, so fixed-size arrays, the majority, don't pay for it either.
     {
-        int count = 0;
+        enum Flags : uint32_t
+        {
+            kArraySlice      = 1,  // Elements belong to another array, as per ArraySliceHeader
+            kArrayKeyIndexed = 2,  // FindEltIndex() has indexed this. The indexes are kept in a side table, as few arrays need them.
+            kArrayGrowable   = 4,  // Allocated with spare capacity, which is stored in the preceding int64_t
+        };
+
+        static constexpr int64_t kMaxCount = PTRDIFF_MAX / sizeof(Value) - 1;  // so the allocation size can't overflow
+
+        mutable _Atomic(int32_t)  refCount = { 0 };
+        mutable _Atomic(uint32_t) flags    = { 0 };  // Atomic as FindEltIndex() can set kArrayKeyIndexed on shared arrays
+        int64_t count = 0;
 
-        ArrayValueHeader(int n = 0) : count(n) {}
-        ~ArrayValueHeader();
+        ArrayValueHeader(int64_t n = 0, uint32_t f = 0) : flags(f), count(n) {}
+
+        int AddRef()   const;  // Adds a reference and returns the new count
+        int Release()  const;  // Removes a reference and returns the new count, destroying the array if it was the last
+        int RefCount() const;  // Current reference count
+
+        Value*       Elts();
+        const Value* Elts() const;
+        int64_t      Capacity() const;  // Allocated element slots, >= count. Only growable arrays have spare ones.
+
+        bool IsSlice() const;          // Returns true if this is a slice of another array, as per CreateArraySlice()
+        void ClearKeyIndexes() const;  // Discards FindEltIndex() indexes. Done automatically by Value's modifying accessors, but needed if elements are edited via an ArrayValue directly.
+
+    protected:
+        void DeleteKeyIndexes() const;
+        void Destroy() const;
     };
 
-    class ArrayValue : public ArrayValueHeader  // Represents a fixed-size array of values
+    class ArrayValue : public ArrayValueHeader  // Represents an array of values. Fixed-size once shared, and read-only if a slice.
     {
     public:
-        Value data[1];  // Actually of size 'count'
-
-        const Value& operator [] (int index) const { return data[index]; }
-        Value&       operator [] (int index)       { return data[index]; }
+        const Value& operator [] (int64_t index) const { return Elts()[index]; }
+        Value&       operator [] (int64_t index)       { return Elts()[index]; }
 
-        const Value& at(int index) const { return data[index]; }
-        Value&       at(int index)       { return data[index]; }
+        const Value& at(int64_t index) const { return Elts()[index]; }
+        Value&       at(int64_t index)       { return Elts()[index]; }
 
         size_t size()  const { return count; }
         bool   empty() const { return count == 0; }
 
-        const Value* begin() const { return data; }
-        const Value* end  () const { return data + count; }
+        const Value* begin() const { return Elts(); }
+        const Value* end  () const { return Elts() + count; }
 
-        Value*       begin()       { return data; }
-        Value*       end  ()       { return data + count; }
+        Value*       begin()       { return Elts(); }
+        Value*       end  ()       { return Elts() + count; }
 
         bool operator == (const ArrayValue& other) const;
         bool operator != (const ArrayValue& other) const { return !(*this == other); }
 
         int Compare(const ArrayValue& other) const;  // Trivalue comparison -- returns -1, 0, or 1
 
-        operator Values () const { return Values(data, data + count); }  // make it easy to pull out data to editable form.
+        int64_t FindEltIndex(ValueKey key, const char* name) const;  // Returns index of the first element whose member 'key' is the string 'name', or -1. The first call for a given 'key' indexes the array, so subsequent calls are O(1).
+
+        operator Values () const { return Values(begin(), end()); }  // make it easy to pull out data to editable form.
+
+        const ArrayValue* SliceSource() const;  // Returns the array whose elements this slice shares, or nullptr if not a slice
+    };
+
+    struct ArraySliceHeader : public ArrayValueHeader
+    // A run of another array's elements. Rather than holding copies, it references the source array and points into
+    // its elements, so creating one is O(1) regardless of its size. Only slices carry these fields.
+    {
+        const ArrayValue* source;
+        const Value*      elts;
+
+        ArraySliceHeader(const ArrayValue* source, int64_t first, int64_t n);
     };
 
     typedef AutoRef<ArrayValue> ArrayValueRef;
 
-    ArrayValue* CreateArrayValue(int count, const Value values[] = 0);  // Creates a new array of the given size, with optional source values
+    ArrayValue* CreateArrayValue(int64_t count, const Value values[] = 0);  // Creates a new array of the given size, with optional source values
+    ArrayValue* CreateArrayValue(int64_t count, int64_t capacity, const Value values[] = 0);  // Variant that reserves space for 'capacity' elements
     ArrayValue* CreateArrayValue(const Values& values);  // Creates a copy of resizable array 'values'. Use ArrayValue.operator Values() for going the other way.
+    ArrayValue* CreateArrayValue(Values&& values);       // Variant that moves the contents of 'values', leaving it empty
+    ArrayValue* CreateArraySlice(const ArrayValue* source, int64_t first, int64_t count);
+    // Creates an array of elements [first, first + count) of 'source', clamped to its size, that shares its storage
+    // rather than copying them. The slice keeps 'source' alive, so beware holding small slices of large arrays.
+    // Slices are read-only: Value's modifying accessors, such as the non-const Elt(), AppendElt() and AsArrayPtr(), first replace
+    // them with a copy of their elements, as with other shared arrays, leaving 'source' untouched.
 
     extern const ArrayValue kNullArrayValue;
 
 
+    // --- ObjectShape --------------------------------------------------------
+
+    struct ObjectShapeHeader : public ValueRC
+    {
+        int count = 0;
+
+        ObjectShapeHeader(int n = 0) : count(n) {}
+        ~ObjectShapeHeader();
+    };
+
+    class ObjectShape : public ObjectShapeHeader  // Sorted set of keys shared between objects with identical keys
+    {
+    public:
+        StringValue* keys[1];  // Actually of size 'count', each referenced
+
+        int KeyIndex(ValueKey     key) const;  // Returns index of the given key, or -1 if not found
+        int KeyIndex(ValueKeySpan key) const;
+    };
+
+    typedef AutoRef<ObjectShape> ObjectShapeRef;
+
+    ObjectShape* CreateObjectShape(int count, StringValue* const keys[]);  // Creates a shape from the given sorted, unique keys
+
+    struct ObjectShapeTable : public RefCounted
+    // Tracks the key sets of objects being built, so that objects with the same keys can share them.
+    {
+        ObjectShape* FindShape(int count, StringValue* const keys[]);  // Returns the shape for the given sorted keys if they've been seen before, otherwise records them and returns 0
+
+        void Clear();  // Clears all entries
+
+    protected:
+        ObjectShapeTable() {} // CreateObjectShapeTable() please
+    };
+
+    typedef AutoRef<ObjectShapeTable> ObjectShapeTableRef;
+
+    ObjectShapeTable* CreateObjectShapeTable();  // Creates a new shape table instance
+
+
     // --- ObjectValue --------------------------------------------------------
 
     struct ConstNameValue { const char* name; const Value& value; };
@@ -356,10 +511,30 @@ namespace HL
     struct MemberIterator;
     struct StringTable;
 
+    enum MergeChange : uint8_t
+    {
+        kMergeSet,      // member was set
+        kMergeRemove,   // member was removed
+        kMergeDescend,  // member is an object about to be merged into. It may be replaced first, e.g., with a copy.
+    };
+
+    typedef std::function<void(MergeChange change, const String& path, Value* member)> MergeCallback;
+
     class ObjectValue : public ValueRC  // Represents an object -- a map from keys to values
+    // Objects may instead share an ObjectShape with others that have identical keys, in which case just the values
+    // are stored, directly after the object. These are created when reading files via ObjectBuilder, and are
+    // converted to the regular form on any key insertion or removal.
     {
     public:
         typedef ValueKey Key;
+
+        static constexpr int kMaxMembers = INT32_MAX;
+        // Member counts and indices are int, unlike arrays', as objects are meant for keyed lookup rather than bulk
+        // data: members are kept sorted in a vector, so each insertion is O(n), and each carries its own key.
+
+        ObjectValue() {}
+        ObjectValue(const ObjectValue& other);        // Note: the copy is always unshaped, see CreateObjectValue()
+        void operator = (const ObjectValue& other);
         ~ObjectValue();
 
         const Value& operator [] (Key key) const;
@@ -371,11 +546,26 @@ namespace HL
 
         Value&          UpdateMember   (StringValue* key);  // Variant that shares 'key' on insertion
 
+        // Variants taking keys that needn't be terminated
+        const Value&    Member         (ValueKeySpan key) const;
+        Value&          UpdateMember   (ValueKeySpan key, StringTable* st = 0);
+        const Value*    MemberPtr      (ValueKeySpan key) const;
+        bool            RemoveMember   (ValueKeySpan key);
+        bool            HasMember      (ValueKeySpan key) const;
+        int             MemberIndex    (ValueKeySpan key) const;
+
         void            SetMember      (Key key, const Value& v);  // Set given member
         bool            RemoveMember   (Key key);        // Remove the named member, or return false if it doesn't exist.
         bool            HasMember      (Key key) const;  // Return true if the object has a member named key.
 
         void            Merge(const ObjectValue& overrides);  // Merge contents of 'overrides' into this
+        void            Merge(const ObjectValue& overrides, const MergeCallback& callback, const char* path = "");
+        // As above, calling 'callback' for each member set, removed, or descended into, with its MemberPath() relative
+        // to this, prefixed by 'path'.
+
+        void            UpdateMembers(int n, const ValueKeySpan keys[], Value* members[], StringTable* st = 0);
+        // Batched UpdateMember() for 'n' distinct keys in ascending order, setting 'members' to the corresponding
+        // members for writing. Any that don't exist are inserted in a single pass rather than one at a time.
 
         bool            IsEmpty() const;             // Returns true if the object has no members.
 
@@ -396,6 +586,8 @@ namespace HL
 
         void            Swap(ObjectValue* other);
 
+        const ObjectShape* Shape() const;            // Returns the shared shape, or 0 if this is a regular object
+
         // ranged for
         ConstMemberIterator begin() const;
         ConstMemberIterator end  () const;
@@ -409,21 +601,38 @@ namespace HL
         int Compare(const ObjectValue& other) const;  // Trivalue comparison -- returns -1, 0, or 1
 
     protected:
+        friend class ObjectBuilder;
+        friend class ValueTransaction;
+        friend class ValueReclaimer;
+        friend ObjectValue* CreateObjectValue(const ObjectValue& other);
+
+        static ObjectValue* CreateShaped(ObjectShape* shape);  // Returns object with the given shape and null values
+        void   Unshape();              // Convert to regular object
+        Value* ShapeValues() const;    // Values of shaped object
+
+        template<class K> int    FindIndex(K key) const;
+        template<class K> Value& Update   (K key, StringTable* st);
+        template<class K> bool   Remove   (K key);
+
         // Data
         struct MemberMapEqual
         {
             bool operator () (const AutoRef<StringValue>& a, const AutoRef<StringValue>& b) const { return strcmp(a->c_str(), b->c_str()) < 0; }
             bool operator () (const AutoRef<StringValue>& a, const char*                 b) const { return strcmp(a->c_str(), b         ) < 0; }
             bool operator () (const char*                 a, const AutoRef<StringValue>& b) const { return strcmp(a         , b->c_str()) < 0; }
+            bool operator () (const AutoRef<StringValue>& a, ValueKeySpan                b) const { return CompareKey(a->c_str(), b) < 0; }
+            bool operator () (ValueKeySpan                a, const AutoRef<StringValue>& b) const { return CompareKey(b->c_str(), a) > 0; }
         };
 
         typedef vector_map<AutoRef<StringValue>, Value, MemberMapEqual> MemberMap;
 
-        MemberMap mMap;
-
-        uint32_t mModCount = 0;
+        uint32_t     mModCount = 0;
+        MemberMap    mMap;             // Members if not shaped
+        ObjectShape* mShape = 0;       // If set, our keys, with values in ShapeValues()
     };
 
+    ObjectValue* CreateObjectValue(const ObjectValue& other);  // Creates a copy of 'other', sharing its shape if it has one
+
     typedef AutoRef<ObjectValue>       ObjectRef;
     typedef AutoRef<const ObjectValue> ConstObjectRef;
 
@@ -449,6 +658,59 @@ namespace HL
         NameValue operator*() const              { return { mObject->MemberInfo(mIndex) }; }
     };
 
+
+    // --- Builders ------------------------------------------------------------
+
+    class ArrayBuilder
+    // Accumulates elements for a new array, which is then allocated exactly once by Finish().
+    // References returned by Add() are only valid until the next Add().
+    {
+    public:
+        void        Reserve(size_t n);
+        Value&      Add();                  // Add a null element, and return it for filling in
+        void        Add(const Value& v);
+        void        Add(Value&& v);
+
+        size_t      size() const { return mValues.size(); }
+        bool        empty() const { return mValues.empty(); }
+
+        ArrayValue* Finish();               // Returns the built array (unreferenced, as per CreateArrayValue) and resets the builder
+        void        Finish(Value* v);       // Replaces 'v' with the built array and resets the builder
+
+    protected:
+        Values mValues;
+    };
+
+    class ObjectBuilder
+    // Accumulates members for a new object. Rather than the search and insert SetMember() does per member, keys are
+    // sorted once in Finish(), with the last of any duplicate keys winning. Keys are interned if a string table is given,
+    // and if a shape table is given, objects whose keys have been seen before share them via an ObjectShape.
+    // References returned by Add() are only valid until the next Add().
+    {
+    public:
+        ObjectBuilder(StringTable* st = 0, ObjectShapeTable* shapes = 0);
+
+        void         Reserve(size_t n);
+        Value&       Add(ValueKey key);     // Add a null member, and return it for filling in
+        Value&       Add(StringValue* key); // Variant that shares 'key'
+        Value&       Add(ValueKeySpan key); // Variant for keys that needn't be terminated
+        void         Add(ValueKey key, const Value& v);
+        void         Add(ValueKey key, Value&& v);
+
+        size_t       size() const { return mMembers.size(); }
+        bool         empty() const { return mMembers.empty(); }
+
+        ObjectValue* Finish();              // Returns the built object (unreferenced) and resets the builder
+        void         Finish(Value* v);      // Replaces 'v' with the built object and resets the builder
+
+    protected:
+        StringTable*      mStringTable = 0;
+        ObjectShapeTable* mShapeTable  = 0;
+        std::vector<std::pair<StringValueRef, Value>> mMembers;
+        std::vector<StringValue*> mKeys;
+    };
+
+
     // --- Function style ------------------------------------------------------
 
     // For consistency with non-built-in AsXXX functions
@@ -466,6 +728,14 @@ namespace HL
 
     // --- Inlines -------------------------------------------------------------
 
+#ifdef HL_VALUE_PROFILE
+    inline const Value& ValueAccessed(const Value& v)
+    {
+        CountValueAccess(&v);
+        return v;
+    }
+#endif
+
     inline Value::Value()
     {}
 
@@ -581,7 +851,7 @@ namespace HL
     {
         MakeNull();
         mType = kValueArray;
-        mValue.mArray = CreateArrayValue(array.count, array.data);
+        mValue.mArray = CreateArrayValue(array.count, array.Elts());
         mValue.mArray->AddRef();
     }
 
@@ -681,6 +951,8 @@ namespace HL
 
     inline const ArrayValue& Value::AsArray() const
     {
+        HL_VALUE_COUNT(this);
+
         if (mType == kValueArray)
             return *mValue.mArray;
 
@@ -689,28 +961,161 @@ namespace HL
 
     inline const ObjectValue& Value::AsObject() const
     {
+        HL_VALUE_COUNT(this);
+
         if (mType == kValueObject)
             return *mValue.mObject;
 
         return kNullObjectValue;
     }
 
-    inline int Value::NumElts() const
+    inline int64_t Value::NumElts() const
     {
         if (mType == kValueArray)
-            return mValue.mArray ? int(mValue.mArray->size()) : 0;
+            return mValue.mArray ? int64_t(mValue.mArray->count) : 0;
 
         return 0;
     }
 
+    inline const Value& Value::FindElt(ValueKey key, const char* name) const
+    {
+        if (mType == kValueArray && mValue.mArray)
+        {
+            int64_t index = mValue.mArray->FindEltIndex(key, name);
+
+            if (index >= 0)
+                return (*mValue.mArray)[index];
+        }
+
+        return kNullValue;
+    }
+
+    inline int ArrayValueHeader::AddRef() const
+    {
+        return ++refCount;
+    }
+
+    inline int ArrayValueHeader::Release() const
+    {
+        int newRefCount = --refCount;
+
+        HL_ASSERT_F(newRefCount >= 0, "Over-Release of array");
+
+        if (newRefCount == 0)
+            Destroy();
+
+        return newRefCount;
+    }
+
+    inline int ArrayValueHeader::RefCount() const
+    {
+        return refCount;
+    }
+
+    inline bool ArrayValueHeader::IsSlice() const
+    {
+        return flags.load(std::memory_order_relaxed) & kArraySlice;
+    }
+
+    inline Value* ArrayValueHeader::Elts()
+    {
+        if (IsSlice())
+            return const_cast<Value*>(static_cast<const ArraySliceHeader*>(this)->elts);  // only modified after unslicing, as per Value::AsArrayPtr()
+
+        return (Value*) (this + 1);
+    }
+
+    inline const Value* ArrayValueHeader::Elts() const
+    {
+        if (IsSlice())
+            return static_cast<const ArraySliceHeader*>(this)->elts;
+
+        return (const Value*) (this + 1);
+    }
+
+    inline int64_t ArrayValueHeader::Capacity() const
+    {
+        if (flags.load(std::memory_order_relaxed) & kArrayGrowable)
+            return ((const int64_t*) this)[-1];
+
+        return count;
+    }
+
+    inline const ArrayValue* ArrayValue::SliceSource() const
+    {
+        return IsSlice() ? static_cast<const ArraySliceHeader*>(static_cast<const ArrayValueHeader*>(this))->source : nullptr;
+    }
+
+    inline void ArrayValueHeader::ClearKeyIndexes() const
+    {
+        if (flags.load(std::memory_order_relaxed) & kArrayKeyIndexed)
+            DeleteKeyIndexes();
+    }
+
     inline const Value& Value::Member(ValueKey key) const
     {
         if (mType == kValueObject)
-            return mValue.mObject->Member(key);
+            return HL_VALUE_READ(mValue.mObject->Member(key));
 
         return kNullValue;
     }
 
+    inline int CompareKey(const char* s, ValueKeySpan key)
+    {
+        int c = strncmp(s, key.data, key.size);
+
+        if (c != 0)
+            return c;
+
+        return s[key.size] == 0 ? 0 : 1;
+    }
+
+    inline const Value& Value::Member(ValueKeySpan key) const
+    {
+        if (mType == kValueObject)
+            return HL_VALUE_READ(mValue.mObject->Member(key));
+
+        return kNullValue;
+    }
+
+    inline Value& Value::UpdateMember(ValueKeySpan key)
+    {
+        if (ToObject())
+            return mValue.mObject->UpdateMember(key);
+
+        HL_ERROR("Can't insert a member on a non-object");
+        kNullValueScratch.MakeNull();
+        return kNullValueScratch;
+    }
+
+    inline const Value* Value::MemberPtr(ValueKeySpan key) const
+    {
+        if (IsObject())
+        {
+            const Value* member = mValue.mObject->MemberPtr(key);
+            HL_VALUE_COUNT(member);
+            return member;
+        }
+
+        return nullptr;
+    }
+
+    inline bool Value::RemoveMember(ValueKeySpan key)
+    {
+        if (mType == kValueObject)
+            return mValue.mObject->RemoveMember(key);
+
+        return false;
+    }
+
+    inline bool Value::HasMember(ValueKeySpan key) const
+    {
+        if (mType == kValueObject)
+            return mValue.mObject->HasMember(key);
+
+        return false;
+    }
+
     inline Value& Value::UpdateMember(ValueKey key)
     {
         if (ToObject())
@@ -724,7 +1129,11 @@ namespace HL
     inline const Value* Value::MemberPtr(ValueKey key) const
     {
         if (IsObject())
-            return mValue.mObject->MemberPtr(key);
+        {
+            const Value* member = mValue.mObject->MemberPtr(key);
+            HL_VALUE_COUNT(member);
+            return member;
+        }
 
         return nullptr;
     }
@@ -786,7 +1195,7 @@ namespace HL
     inline const Value& Value::MemberValue(int index) const
     {
         if (mType == kValueObject)
-            return mValue.mObject->MemberValue(index);
+            return HL_VALUE_READ(mValue.mObject->MemberValue(index));
 
         return kNullValue;
     }
@@ -803,18 +1212,18 @@ namespace HL
 
     inline Value& Value::operator[](size_t index)
     {
-        return Elt((int) index);
+        return Elt(int64_t(index));
     }
 
     inline const Value& Value::operator[](size_t index) const
     {
-        return Elt((int) index);
+        return Elt(int64_t(index));
     }
 
     inline const Value& Value::operator[](ValueKey key) const
     {
         if (mType == kValueObject)
-            return mValue.mObject->Member(key);
+            return HL_VALUE_READ(mValue.mObject->Member(key));
 
         return kNullValue;
     }
@@ -846,12 +1255,21 @@ namespace HL
 
     inline ArrayValue* Value::AsArrayPtr()
     {
-        return mType == kValueArray ? mValue.mArray : nullptr;
+        if (mType != kValueArray)
+            return nullptr;
+
+        if (mValue.mArray && mValue.mArray->IsSlice())  // caller may modify elements, so they mustn't be the source array's
+            *this = Value(CreateArrayValue(mValue.mArray->count, mValue.mArray->Elts()));
+
+        if (mValue.mArray)
+            mValue.mArray->ClearKeyIndexes();  // caller may modify elements
+
+        return mValue.mArray;
     }
 
     inline ArrayValue* Value::ToArrayPtr()
     {
-        return ToArray() ? mValue.mArray : nullptr;
+        return ToArray() ? AsArrayPtr() : nullptr;
     }
 
     inline ObjectValue* Value::AsObjectPtr()
@@ -885,46 +1303,49 @@ namespace HL
 
     inline bool ObjectValue::IsEmpty() const
     {
-        return mMap.empty();
+        return NumMembers() == 0;
     }
 
     inline int ObjectValue::NumMembers() const
     {
-        return size_i(mMap);
+        return mShape ? mShape->count : size_i(mMap);
     }
 
     inline const char* ObjectValue::MemberName(int index) const
     {
-        return mMap.at(index).first->c_str();
+        return mShape ? mShape->keys[index]->c_str() : mMap.at(index).first->c_str();
     }
 
     inline ValueKey ObjectValue::MemberKey(int i) const
     {
-        return mMap.at(i).first->c_str();
+        return MemberName(i);
     }
 
     inline const Value& ObjectValue::MemberValue(int i) const
     {
-        return mMap.at(i).second;
+        return mShape ? ShapeValues()[i] : mMap.at(i).second;
     }
 
     inline Value& ObjectValue::MemberValue(int i)
     {
-        return mMap.at(i).second;
+        return mShape ? ShapeValues()[i] : mMap.at(i).second;
     }
 
     inline ConstNameValue ObjectValue::MemberInfo(int i) const
     {
-        return { mMap.at(i).first->c_str(), mMap.at(i).second };
+        return { MemberName(i), MemberValue(i) };
     }
 
     inline NameValue ObjectValue::MemberInfo(int i)
     {
-        return { mMap.at(i).first->c_str(), mMap.at(i).second };
+        return { MemberName(i), MemberValue(i) };
     }
 
     inline void ObjectValue::RemoveMembers()
     {
+        if (mShape)
+            Unshape();
+
         if (!mMap.empty())
         {
             mModCount++;
@@ -932,6 +1353,16 @@ namespace HL
         }
     }
 
+    inline const ObjectShape* ObjectValue::Shape() const
+    {
+        return mShape;
+    }
+
+    inline Value* ObjectValue::ShapeValues() const
+    {
+        return (Value*) (((uint8_t*) this) + sizeof(ObjectValue));
+    }
+
     inline uint32_t ObjectValue::ModCount() const
     {
         return mModCount;
@@ -942,11 +1373,6 @@ namespace HL
         mModCount++;
     }
 
-    inline bool ObjectValue::operator ==(const ObjectValue& other) const
-    {
-        return mMap == other.mMap;
-    }
-
     inline ConstMemberIterator ObjectValue::begin() const
     {
         return { this, 0 };
@@ -972,7 +1398,7 @@ namespace HL
 
     inline int SetFromValue(const Value& value, int nv, int32_t v[])
     {
-        int n = std::min(size_i(value), nv);
+        int n = int(std::min(value.size(), size_t(nv < 0 ? 0 : nv)));
 
         for (int i = 0; i < n; i++)
             v[i] = value[i].AsInt();
@@ -982,7 +1408,7 @@ namespace HL
 
     inline int SetFromValue(const Value& value, int nv, uint32_t v[])
     {
-        int n = std::min(size_i(value), nv);
+        int n = int(std::min(value.size(), size_t(nv < 0 ? 0 : nv)));
 
         for (int i = 0; i < n; i++)
             v[i] = value[i].AsUInt();
@@ -992,7 +1418,7 @@ namespace HL
 
     inline int SetFromValue(const Value& value, int nv, float v[])
     {
-        int n = std::min(size_i(value), nv);
+        int n = int(std::min(value.size(), size_t(nv < 0 ? 0 : nv)));
 
         for (int i = 0; i < n; i++)
             v[i] = value[i].AsFloat();
@@ -1005,6 +1431,24 @@ namespace HL
         return T(AsEnum(value, enumInfo, int(defaultValue)));
     }
 
+    inline size_t PathKeyLength(const char* key)
+    {
+        return strcspn(key, ".[");
+    }
+
+    inline size_t PathFieldLength(const char* path)
+    {
+        return path[0] ? PathKeyLength(path + 1) + 1 : 0;
+    }
+
+    inline ValueKeySpan PathFieldKey(const char* field, size_t len)
+    {
+        if (field[0] == '.')
+            return { field + 1, len - 1 };
+
+        return { field, len };
+    }
+
     inline bool MemberIsHidden(const char* key)
     {
         return key[0] == '_';
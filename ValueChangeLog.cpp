@@ -0,0 +1,270 @@
+//
+// ValueChangeLog.cpp
+//
+// Versioned log of edits to a value
+//
+
+#include "ValueChangeLog.hpp"
+
+#include "ValueTransaction.hpp"
+
+#include <algorithm>
+#include <stdlib.h>
+
+using namespace HL;
+
+namespace
+{
+    inline const char* LastField(const char* path)
+    {
+        const char* field = path;
+
+        for (const char* p = path; *p; p += PathFieldLength(p))
+            field = p;
+
+        return field;
+    }
+
+    inline const Value& ValueAt(const Value& root, const char* path)
+    {
+        return *path ? MemberPath(root, path) : root;
+    }
+
+    inline Value& UpdateValueAt(Value& root, const char* path)
+    {
+        return *path ? UpdateMemberPath(root, path) : root;
+    }
+
+    bool Exists(const Value& root, const char* path)
+    {
+        const char* field = LastField(path);
+
+        if (!*field)
+            return true;
+
+        const Value& parent = ValueAt(root, String(path, field - path).c_str());
+
+        if (field[0] == '[' && parent.Type() == kValueArray)
+        {
+            char* end = nullptr;
+            long long index = strtoll(field + 1, &end, 10);
+
+            return *end == ']' && index >= 0 && index < parent.NumElts();
+        }
+
+        return parent.HasMember(PathFieldKey(field, strlen(field)));
+    }
+}
+
+ValueChangeLog::ValueChangeLog(Value* root, size_t capacity) :
+    mRoot(root),
+    mCapacity(capacity)
+{
+}
+
+Value& ValueChangeLog::UpdateMember(const char* path)
+{
+    Add(mVersion + 1, kChangeSet, path);
+    Trim();
+
+    return UpdateValueAt(*mRoot, path);
+}
+
+void ValueChangeLog::SetMember(const char* path, const Value& v)
+{
+    UpdateValueAt(*mRoot, path) = v;
+
+    Add(mVersion + 1, kChangeSet, path);
+    Trim();
+}
+
+bool ValueChangeLog::RemoveMember(const char* path)
+{
+    const char* field = LastField(path);
+
+    if (!*field)
+        return false;
+
+    String parentPath(path, field - path);
+    ValueKeySpan key = PathFieldKey(field, strlen(field));
+
+    if (!ValueAt(*mRoot, parentPath.c_str()).HasMember(key))
+        return false;
+
+    UpdateValueAt(*mRoot, parentPath.c_str()).RemoveMember(key);
+
+    Add(mVersion + 1, kChangeRemove, path);
+    Trim();
+
+    return true;
+}
+
+void ValueChangeLog::Merge(const char* path, const Value& overrides)
+{
+    if (overrides.IsNull())
+        return;
+
+    Value& v = UpdateValueAt(*mRoot, path);
+    uint64_t version = mVersion + 1;
+
+    if (overrides.Type() != kValueObject || v.Type() != kValueObject)
+    {
+        v = overrides;
+
+        Add(version, kChangeSet, path);
+        Trim();
+        return;
+    }
+
+    // Log each member set or removed rather than 'path' as a whole
+    v.mValue.mObject->Merge(*overrides.mValue.mObject,
+        [this, version](MergeChange change, const String& memberPath, Value*)
+        {
+            if (change != kMergeDescend)
+                Add(version, change == kMergeRemove ? kChangeRemove : kChangeSet, memberPath.c_str());
+        },
+        path
+    );
+
+    Trim();
+}
+
+void ValueChangeLog::Commit(ValueTransaction* transaction)
+{
+    uint64_t version = mVersion + 1;
+
+    for (const String& path : transaction->Commit())
+        Add(version, Exists(*mRoot, path.c_str()) ? kChangeSet : kChangeRemove, path.c_str());
+
+    Trim();
+}
+
+bool ValueChangeLog::ChangesSince(uint64_t version, std::vector<ValueChange>* changes) const
+{
+    if (version < mDropped)
+        return false;
+
+    auto it = std::upper_bound(mChanges.begin(), mChanges.end(), version,
+        [](uint64_t v, const ValueChange& change) { return v < change.version; });
+
+    changes->insert(changes->end(), it, mChanges.end());
+    return true;
+}
+
+void ValueChangeLog::SetCapacity(size_t capacity)
+{
+    mCapacity = capacity;
+    Trim();
+}
+
+void ValueChangeLog::Add(uint64_t version, ValueChangeType type, const char* path)
+{
+    mChanges.push_back({ version, type, path });
+    mVersion = version;
+}
+
+void ValueChangeLog::Trim()
+{
+    while (mChanges.size() > mCapacity)
+    {
+        mDropped = mChanges.front().version;
+        mChanges.pop_front();
+    }
+}
+
+void HL::DiffValues(const Value& before, const Value& after, std::vector<ValueChange>* changes)
+{
+    // Depth first via an explicit stack. Each frame's parent path is still in place when it's popped, as all its
+    // siblings' descendants are done by then.
+    struct DiffFrame
+    {
+        const Value* before;    // 0 if added
+        const Value* after;     // 0 if removed
+        size_t       pathSize;  // Length of parent's path
+        const char*  name;      // Member name, or 0 for an element
+        int64_t      index;     // Element index, or -1 for the root
+    };
+
+    std::vector<DiffFrame> stack = { { &before, &after, 0, nullptr, -1 } };
+    String path;
+
+    while (!stack.empty())
+    {
+        DiffFrame frame = stack.back();
+        stack.pop_back();
+
+        path.resize(frame.pathSize);
+
+        if (frame.name)
+        {
+            if (!path.empty())
+                path += '.';
+            path += frame.name;
+        }
+        else if (frame.index >= 0)
+            AppendFormat(&path, "[%lld]", (long long) frame.index);
+
+        if (!frame.after)
+        {
+            changes->push_back({ 0, kChangeRemove, path });
+            continue;
+        }
+
+        if (!frame.before)
+        {
+            changes->push_back({ 0, kChangeSet, path });
+            continue;
+        }
+
+        const Value& a = *frame.before;
+        const Value& b = *frame.after;
+        size_t first = stack.size();
+
+        if (a.Type() == kValueObject && b.Type() == kValueObject)
+        {
+            if (a.mValue.mObject == b.mValue.mObject)
+                continue;
+
+            // Members are sorted, so walk both in step
+            const ObjectValue& oa = *a.mValue.mObject;
+            const ObjectValue& ob = *b.mValue.mObject;
+            int ia = 0, na = oa.NumMembers();
+            int ib = 0, nb = ob.NumMembers();
+
+            while (ia < na || ib < nb)
+            {
+                int c = ia == na ? 1 : ib == nb ? -1 : strcmp(oa.MemberName(ia), ob.MemberName(ib));
+
+                if (c < 0)
+                {
+                    stack.push_back({ &oa.MemberValue(ia), nullptr, path.size(), oa.MemberName(ia), 0 });
+                    ia++;
+                }
+                else if (c > 0)
+                {
+                    stack.push_back({ nullptr, &ob.MemberValue(ib), path.size(), ob.MemberName(ib), 0 });
+                    ib++;
+                }
+                else
+                {
+                    stack.push_back({ &oa.MemberValue(ia), &ob.MemberValue(ib), path.size(), ob.MemberName(ib), 0 });
+                    ia++;
+                    ib++;
+                }
+            }
+        }
+        else if (a.Type() == kValueArray && b.Type() == kValueArray && a.NumElts() == b.NumElts())
+        {
+            if (a.mValue.mArray == b.mValue.mArray)
+                continue;
+
+            for (int64_t i = 0, n = a.NumElts(); i < n; i++)
+                stack.push_back({ &a.Elt(i), &b.Elt(i), path.size(), nullptr, i });
+        }
+        else if (a != b)
+            changes->push_back({ 0, kChangeSet, path });
+
+        // Children were pushed in order, so reverse them to pop them in order
+        std::reverse(stack.begin() + first, stack.end());
+    }
+}
@@ -0,0 +1,83 @@
+//
+// ValueChangeLog.hpp
+//
+// Versioned log of edits to a value
+//
+
+#ifndef HL_VALUE_CHANGE_LOG_H
+#define HL_VALUE_CHANGE_LOG_H
+
+#include "Value.hpp"
+
+#include <deque>
+
+namespace HL
+{
+    class ValueTransaction;
+
+    enum ValueChangeType : uint8_t
+    {
+        kChangeSet,     // value at the path was set or modified, so re-read it
+        kChangeRemove,  // value at the path was removed
+    };
+
+    struct ValueChange
+    {
+        uint64_t        version;
+        ValueChangeType type;
+        String          path;   // in MemberPath() form
+    };
+
+    class ValueChangeLog
+    // Records edits to a root value, so consumers can fetch just what changed since the version they last saw, e.g.,
+    // to replicate a config over the network, rather than re-reading whole sections. As a Value doesn't know its own
+    // path, edits must be made via the log's path-based equivalents of UpdateMember() and friends to be recorded, or
+    // via a ValueTransaction handed to Commit(), which logs all its edits under a single version.
+    // The log keeps a limited number of changes. If a consumer has fallen far enough behind that some it needs have
+    // been dropped, ChangesSince() fails, and the consumer should instead DiffValues() its copy against the root.
+    {
+    public:
+        ValueChangeLog(Value* root, size_t capacity = 4096);  // 'root' must outlive the log
+
+        Value&   UpdateMember(const char* path);                          // UpdateMemberPath(), logged as a set of 'path', as the caller may modify it
+        void     SetMember   (const char* path, const Value& v);          // Sets the value at 'path'
+        bool     RemoveMember(const char* path);                          // Removes the member at 'path'. Returns false if it doesn't exist.
+        void     Merge       (const char* path, const Value& overrides);  // Value::Merge() for the value at 'path', logging each member set or removed
+        void     Commit      (ValueTransaction* transaction);             // Commits 'transaction', which must be on our root, and logs its edits as one version
+
+        uint64_t Version() const;   // Version of the latest change, or 0 if there have been none
+        bool     ChangesSince(uint64_t version, std::vector<ValueChange>* changes) const;  // Appends changes made after 'version', oldest first. Returns false if some have been dropped.
+
+        void     SetCapacity(size_t capacity);  // Sets the maximum number of changes kept
+        size_t   NumChanges() const;            // Number of changes currently kept
+
+    protected:
+        Value*                  mRoot;
+        size_t                  mCapacity;
+        uint64_t                mVersion = 0;
+        uint64_t                mDropped = 0;   // Latest version with dropped changes
+        std::deque<ValueChange> mChanges;
+
+        void Add(uint64_t version, ValueChangeType type, const char* path);
+        void Trim();
+    };
+
+    void DiffValues(const Value& before, const Value& after, std::vector<ValueChange>* changes);
+    // Appends the changes, with version 0, that turn 'before' into 'after'. Objects and equal-length arrays are
+    // compared member by member, and anything else that differs is a set of its path.
+
+
+    // --- Inlines -------------------------------------------------------------
+
+    inline uint64_t ValueChangeLog::Version() const
+    {
+        return mVersion;
+    }
+
+    inline size_t ValueChangeLog::NumChanges() const
+    {
+        return mChanges.size();
+    }
+}
+
+#endif
@@ -13,7 +13,9 @@
 #include "ValueJsonInternal.hpp"
 
 #include "Value.hpp"
+#include "Parallel.hpp"
 
+#include <limits.h>
 #include <math.h>
 
 #if HL_WINDOWS
@@ -83,21 +85,34 @@ bool JsonReader::Read(const char* beginDoc, const char* endDoc, Value* root)
     mEnd = endDoc;
     mCurrent = mBegin;
     mLastValueEnd = 0;
-    mLastValue = 0;
     mCommentsBefore.clear();
     mErrors.clear();
-    mNodes.clear();
+    mFrames.clear();    // as the builders depend on the string and shape tables
+    mDepth = 0;
+#ifdef HL_VALUE_COMMENTS
+    mPath.clear();
+    mLastValuePath.clear();
+#endif
 
 #ifdef HL_STRING_TABLE_HPP
     if (!mStringTable && (mUseStringTableForKey || mUseStringTableForValue))
         mStringTable = CreateStringTable();
 #endif
+    if (!mShapeTable && mShareObjectShapes)
+        mShapeTable = CreateObjectShapeTable();
 
     root->MakeNull();
-    mNodes.push_back(root);
+    mNode = root;
     bool successful = ReadValue();
-    mNodes.pop_back();
 
+    // Consume any trailing comments
+    Token token;
+    Location lastEnd = mCurrent;
+
+    while (ReadToken(token) && token.mType == kTokenComment)
+        lastEnd = mCurrent;
+
+    mCurrent = lastEnd;
     SkipSpaces();
 
     if (mErrors.empty() && mCurrent != mEnd)
@@ -109,28 +124,55 @@ bool JsonReader::Read(const char* beginDoc, const char* endDoc, Value* root)
 
 #ifdef HL_VALUE_COMMENTS
     if (mCollectComments && !mCommentsBefore.empty())
-        root->SetComment(mCommentsBefore, kCommentAfter);
+        mComments->SetComment("", mCommentsBefore.c_str(), kCommentAfter);
 #endif
 
     return successful;
 }
 
+void JsonReader::SetMaxDepth(int maxDepth)
+{
+    mMaxDepth = maxDepth;
+}
+
+#ifdef HL_VALUE_COMMENTS
+void JsonReader::SetComments(ValueComments* comments)
+{
+    mComments = comments;
+    mCollectComments = comments != nullptr;
+}
+#endif
+
 bool JsonReader::ReadValue()
 {
+    // Containers are read via mFrames rather than recursively, so nesting is only limited by mMaxDepth. Each time
+    // round, the innermost container either supplies its next member or element to read, or is complete.
     Token token;
     ReadNonCommentToken(token);
 
-    return ReadValue(token);
+    bool ok = StartValue(token);
+
+    while (mDepth > 0)
+    {
+        Frame& frame = mFrames[mDepth - 1];
+
+        if (frame.mIsObject ? NextMember(frame, token, ok) : NextElt(frame, token, ok))
+            ok = StartValue(token);
+        else
+            ok = EndContainer(frame, ok);
+    }
+
+    return ok;
 }
 
-bool JsonReader::ReadValue(Token& token)
+bool JsonReader::StartValue(Token& token)
 {
     bool successful = true;
 
 #ifdef HL_VALUE_COMMENTS
     if (mCollectComments && !mCommentsBefore.empty())
     {
-        mNodes.back()->SetComment(mCommentsBefore, kCommentBefore);
+        mComments->SetComment(mPath.c_str(), mCommentsBefore.c_str(), kCommentBefore);
         mCommentsBefore.clear();
     }
 #endif
@@ -138,11 +180,35 @@ bool JsonReader::ReadValue(Token& token)
     switch (token.mType)
     {
     case kTokenObjectBegin:
-        successful = ReadObject(token);
-        break;
     case kTokenArrayBegin:
-        successful = ReadArray(token);
-        break;
+        if (mDepth >= mMaxDepth)
+        {
+            AddError("Nesting too deep", token);
+            mCurrent = mEnd;  // skip the remainder, as recovering within it would just lead to more errors
+            return false;
+        }
+
+        if (mDepth == size_i(mFrames))
+        {
+            mFrames.emplace_back();
+        #ifdef HL_STRING_TABLE_HPP
+            mFrames.back().mObject = ObjectBuilder(mUseStringTableForKey ? mStringTable : 0, mShapeTable);
+        #else
+            mFrames.back().mObject = ObjectBuilder(0, mShapeTable);
+        #endif
+        }
+
+        {
+            Frame& frame = mFrames[mDepth++];
+
+            frame.mNode = mNode;
+            frame.mIsObject = (token.mType == kTokenObjectBegin);
+            frame.mInChild = false;
+        #ifdef HL_VALUE_COMMENTS
+            frame.mPathSize = mPath.size();
+        #endif
+        }
+        return true;  // contents are read by ReadValue()
     case kTokenNumber:
         successful = DecodeNumber(token);
         break;
@@ -150,34 +216,41 @@ bool JsonReader::ReadValue(Token& token)
         successful = DecodeString(token);
         break;
     case kTokenMinusInfinity:
-        *mNodes.back() = -INFINITY;
+        *mNode = -INFINITY;
         break;
     case kTokenInfinity:
-        *mNodes.back() = INFINITY;
+        *mNode = INFINITY;
         break;
     case kTokenNaN:
-        *mNodes.back() = NAN;
+        *mNode = NAN;
         break;
     case kTokenTrue:
-        *mNodes.back() = true;
+        *mNode = true;
         break;
     case kTokenFalse:
-        *mNodes.back() = false;
+        *mNode = false;
         break;
     case kTokenNull:
-        *mNodes.back() = Value();
+        *mNode = Value();
         break;
     default:
         return AddError("Syntax error: value, object or array expected.", token);
     }
 
+    EndValue();
+
+    return successful;
+}
+
+void JsonReader::EndValue()
+{
     if (mCollectComments)
     {
         mLastValueEnd = mCurrent;
-        mLastValue = mNodes.back();
+    #ifdef HL_VALUE_COMMENTS
+        mLastValuePath = mPath;
+    #endif
     }
-
-    return successful;
 }
 
 bool JsonReader::ReadNonCommentToken(Token& token)
@@ -445,43 +518,21 @@ bool JsonReader::ReadUnquotedString()
     return true;
 }
 
-bool JsonReader::ReadObject(Token& tokenStart)
+bool JsonReader::NextMember(Frame& frame, Token& token, bool& ok)
 {
-    Token tokenName;
-    String name;
-
-    Value* destValue = mNodes.back();
-
-    ObjectValue& objectValue = destValue->MakeObject();
-
-    while (ReadNonCommentToken(tokenName))
+    if (frame.mInChild)
     {
-        if (tokenName.mType == kTokenObjectEnd && (name.empty() || mAllowTrailingCommas))  // empty object
-            break;
-
-        if (tokenName.mType != kTokenString)
-            return AddErrorAndRecover("Object member name isn't a String", tokenName, kTokenObjectEnd);
-
-        name.clear();
-        if (!DecodeString(tokenName, name))
-            return RecoverFromError(kTokenObjectEnd);
+        frame.mInChild = false;
 
-        Token colon;
-        if (!ReadNonCommentToken(colon) || colon.mType != kTokenMemberSeparator)
-            return AddErrorAndRecover("Missing ':' after object member name", colon, kTokenObjectEnd);
-
-    #ifdef HL_STRING_TABLE_HPP
-        Value* value = &objectValue.UpdateMember(name, mUseStringTableForKey ? mStringTable : 0);
-    #else
-        Value* value = &objectValue.UpdateMember(name);
+    #ifdef HL_VALUE_COMMENTS
+        mPath.resize(frame.mPathSize);
     #endif
 
-        mNodes.push_back(value);
-        bool ok = ReadValue();
-        mNodes.pop_back();
-
         if (!ok) // error already set
-            return RecoverFromError(kTokenObjectEnd);
+        {
+            ok = RecoverFromError(kTokenObjectEnd);
+            return false;
+        }
 
         Token comma;
         if
@@ -489,59 +540,133 @@ bool JsonReader::ReadObject(Token& tokenStart)
             || (comma.mType != kTokenObjectEnd && comma.mType != kTokenArraySeparator)
         )
         {
-            return AddErrorAndRecover("Missing ',' or '}' in object declaration", comma, kTokenObjectEnd);
+            ok = AddErrorAndRecover("Missing ',' or '}' in object declaration", comma, kTokenObjectEnd);
+            return false;
         }
 
         if (comma.mType == kTokenObjectEnd)
-            break;
+            return false;
     }
 
-    return true;
-}
+    Token tokenName;
 
-bool JsonReader::ReadArray(Token& tokenStart)
-{
-    Values array;
+    if (!ReadNonCommentToken(tokenName))
+        return false;
 
-    int index = 0;
-    Token token;
+    if (tokenName.mType == kTokenObjectEnd && (frame.mObject.empty() || mAllowTrailingCommas))  // empty object
+        return false;
 
-    while (true)
+    if (tokenName.mType != kTokenString)
     {
-        if (!ReadNonCommentToken(token))
-            return AddErrorAndRecover("Missing remainder of array", token, kTokenArrayEnd);
+        ok = AddErrorAndRecover("Object member name isn't a String", tokenName, kTokenObjectEnd);
+        return false;
+    }
 
-        // Allow ] next if empty array or we support trailing commas
-        if (token.mType == kTokenArrayEnd && (mAllowTrailingCommas || index == 0))
-            break;
+    // Use the key directly from the source where possible
+    String name;
+    ValueKeySpan key;
+
+    if (!RawString(tokenName, &key))
+    {
+        if (!DecodeString(tokenName, name))
+        {
+            ok = RecoverFromError(kTokenObjectEnd);
+            return false;
+        }
 
-        array.push_back({});
+        key = { name.data(), name.size() };
+    }
 
-        mNodes.push_back(&array.back());
-        bool ok = ReadValue(token);
-        mNodes.pop_back();
+    Token colon;
+    if (!ReadNonCommentToken(colon) || colon.mType != kTokenMemberSeparator)
+    {
+        ok = AddErrorAndRecover("Missing ':' after object member name", colon, kTokenObjectEnd);
+        return false;
+    }
+
+#ifdef HL_VALUE_COMMENTS
+    if (mCollectComments)
+        PushPath(key.data, key.size);
+#endif
+
+    mNode = &frame.mObject.Add(key);
+    frame.mInChild = true;
+
+    ReadNonCommentToken(token);
+    return true;
+}
+
+bool JsonReader::NextElt(Frame& frame, Token& token, bool& ok)
+{
+    if (frame.mInChild)
+    {
+        frame.mInChild = false;
+
+    #ifdef HL_VALUE_COMMENTS
+        mPath.resize(frame.mPathSize);
+    #endif
 
         if (!ok) // error already set
-            return RecoverFromError(kTokenArrayEnd);
+        {
+            ok = RecoverFromError(kTokenArrayEnd);
+            return false;
+        }
 
         if (!ReadNonCommentToken(token))
-            return AddErrorAndRecover("Missing remainder of array", token, kTokenArrayEnd);
+        {
+            ok = AddErrorAndRecover("Missing remainder of array", token, kTokenArrayEnd);
+            return false;
+        }
 
         if (token.mType == kTokenArrayEnd)
-            break;
+            return false;
 
         if (token.mType != kTokenArraySeparator)
-            return AddErrorAndRecover("Expecting ',' in array declaration", token, kTokenArrayEnd);
+        {
+            ok = AddErrorAndRecover("Expecting ',' in array declaration", token, kTokenArrayEnd);
+            return false;
+        }
+    }
 
-        if (token.mType == kTokenArrayEnd)
-            break;
+    if (!ReadNonCommentToken(token))
+    {
+        ok = AddErrorAndRecover("Missing remainder of array", token, kTokenArrayEnd);
+        return false;
     }
 
-    *mNodes.back() = array;
+    // Allow ] next if empty array or we support trailing commas
+    if (token.mType == kTokenArrayEnd && (mAllowTrailingCommas || frame.mArray.empty()))
+        return false;
+
+#ifdef HL_VALUE_COMMENTS
+    if (mCollectComments)
+        PushPath(int64_t(frame.mArray.size()));
+#endif
 
+    mNode = &frame.mArray.Add();
+    frame.mInChild = true;
     return true;
 }
 
+bool JsonReader::EndContainer(Frame& frame, bool ok)
+{
+    // Keep whatever members we managed to read, even on error, but not partial arrays
+    if (frame.mIsObject)
+        frame.mObject.Finish(frame.mNode);
+    else if (ok)
+        frame.mArray.Finish(frame.mNode);
+    else
+    {
+        Value partial;
+        frame.mArray.Finish(&partial);  // resets the builder for reuse
+    }
+
+    mDepth--;
+    EndValue();
+
+    return ok;
+}
+
 bool JsonReader::DecodeNumber(Token& token)
 {
     bool isDouble = false;
@@ -590,20 +715,20 @@ bool JsonReader::DecodeNumber(Token& token)
     if (isNegative)
     {
         if (value <= 2147483648)  // -INT32_MIN
-        *mNodes.back() = -int32_t(value);
+        *mNode = -int32_t(value);
         else if (value <= 9223372036854775808u) // -INT64_MIN
-            *mNodes.back() = -int64_t(value);
+            *mNode = -int64_t(value);
         else
-            *mNodes.back() = -double(value);
+            *mNode = -double(value);
     }
     else if (value <= INT32_MAX)
-        *mNodes.back() = int32_t(value);
+        *mNode = int32_t(value);
     else if (value <= UINT32_MAX)
-        *mNodes.back() = uint32_t(value);
+        *mNode = uint32_t(value);
     else if (value <= INT64_MAX)
-        *mNodes.back() = int64_t(value);
+        *mNode = int64_t(value);
     else
-        *mNodes.back() = value;
+        *mNode = value;
 
     return true;
 }
@@ -632,27 +757,51 @@ bool JsonReader::DecodeDouble(Token& token)
     if (count != 1)
         return AddError(("'" + String(token.mStart, token.mEnd) + "' is not a number.").c_str(), token);
 
-    *mNodes.back() = value;
+    *mNode = value;
     return true;
 }
 
 bool JsonReader::DecodeString(Token& token)
 {
+    ValueKeySpan span;
     String decoded;
 
-    if (!DecodeString(token, decoded))
-        return false;
+    if (!RawString(token, &span))
+    {
+        if (!DecodeString(token, decoded))
+            return false;
+
+        span = { decoded.data(), decoded.size() };
+    }
 
 #ifdef HL_STRING_TABLE_HPP
     if (mUseStringTableForValue && mStringTable)
-        *mNodes.back() = mStringTable->GetString(decoded);
+        *mNode = mStringTable->GetString(span.data, span.size);
     else
 #endif
-        *mNodes.back() = decoded.c_str();
+        *mNode = CreateStringValue(span.data, span.size);
 
     return true;
 }
 
+bool JsonReader::RawString(const Token& token, ValueKeySpan* span) const
+{
+    Location current = token.mStart;
+    Location end = token.mEnd;
+
+    if (*current == '"')
+    {
+        current++;
+        end--;
+    }
+
+    if (memchr(current, '\\', end - current))
+        return false;
+
+    *span = { current, size_t(end - current) };
+    return true;
+}
+
 bool JsonReader::DecodeString(Token& token, String& decoded)
 {
     Location current = token.mStart;
@@ -811,7 +960,7 @@ inline char JsonReader::GetNextChar()
     return *mCurrent++;
 }
 
-void JsonReader::GetLocationLineAndColumn(Location location, int& line, int& column) const
+void JsonReader::GetLocationLineAndColumn(Location location, int64_t& line, int64_t& column) const
 {
     Location current = mBegin;
     Location lastLineStart = current;
@@ -837,17 +986,17 @@ void JsonReader::GetLocationLineAndColumn(Location location, int& line, int& col
     }
 
     // column & line start at 1
-    column = int(location - lastLineStart) + 1;
+    column = int64_t(location - lastLineStart) + 1;
     ++line;
 }
 
 void JsonReader::AddLocationLineAndColumn(Location location, String* str) const
 {
-    int line, column;
+    int64_t line, column;
     GetLocationLineAndColumn(location, line, column);
 
-    char buffer[18 + 16 + 16 + 1];
-    snprintf(buffer, sizeof(buffer), "Line %d, Column %d", line, column);
+    char buffer[18 + 20 + 20 + 1];
+    snprintf(buffer, sizeof(buffer), "Line %lld, Column %lld", (long long) line, (long long) column);
 
     *str += buffer;
 }
@@ -882,10 +1031,10 @@ int JsonReader::GetFirstErrorLine() const
 
     if (it != mErrors.end())
     {
-        int line, column;
+        int64_t line, column;
         GetLocationLineAndColumn(it->mToken.mStart, line, column);
 
-        return line;
+        return line <= INT_MAX ? int(line) : INT_MAX;
     }
 
     return -1;
@@ -898,14 +1047,24 @@ void JsonReader::AddComment(Location begin, Location end, int placement)
 
     if (placement == kCommentAfterOnSameLine)
     {
-        HL_ASSERT(mLastValue != 0);
-        mLastValue->SetComment(String(begin, end), CommentPlacement(placement));
+        HL_ASSERT(mLastValueEnd != 0);
+        mComments->SetComment(mLastValuePath.c_str(), String(begin, end).c_str(), CommentPlacement(placement));
     }
     else
     {
         mCommentsBefore += String(begin, end);
     }
 }
+
+void JsonReader::PushPath(const char* key, size_t len)
+{
+    ValueComments::AppendKey(&mPath, key, len);
+}
+
+void JsonReader::PushPath(int64_t index)
+{
+    AppendFormat(&mPath, "[%lld]", (long long) index);
+}
 #endif
 
 
@@ -934,7 +1093,6 @@ namespace
         if (!IsStartTokenChar(*name))
             return false;
 
-        name++;
         while (*++name != 0)
             if (!IsTokenChar(*name))
                 return false;
@@ -1146,13 +1304,20 @@ void JsonWriter::Write(const Value& root, String* outString)
     mIndent = 0;
 
 #ifdef HL_VALUE_COMMENTS
-    WriteCommentBeforeValue(root);
+    mPath.clear();
+    WriteCommentBeforeValue();
+
+    if (!mComments)
 #endif
+        WriteParts(root);
+
     WriteValue(root);
 #ifdef HL_VALUE_COMMENTS
-    WriteCommentAfterValueOnSameLine(root);
+    WriteCommentAfterValueOnSameLine();
 #endif
 
+    mParts.clear();
+
     mDocument.swap(*outString);
     mDocument.clear();
 }
@@ -1165,18 +1330,154 @@ const char* JsonWriter::Write(const Value& root)
     mIndent = 0;
 
 #ifdef HL_VALUE_COMMENTS
-    WriteCommentBeforeValue(root);
+    mPath.clear();
+    WriteCommentBeforeValue();
+
+    if (!mComments)
 #endif
+        WriteParts(root);
+
     WriteValue(root);
 #ifdef HL_VALUE_COMMENTS
-    WriteCommentAfterValueOnSameLine(root);
+    WriteCommentAfterValueOnSameLine();
 #endif
 
+    mParts.clear();
+
     return mDocument.c_str();
 }
 
+namespace
+{
+    int64_t NumSplittableChildren(const Value& value)
+    {
+        // Non-empty objects and arrays can be written independently, given their indent and preceding character
+        int64_t count = 0;
+
+        if (value.Type() == kValueObject)
+        {
+            for (ConstNameValue nv : value.AsObject())
+                if ((nv.value.IsObject() || nv.value.IsArray()) && !nv.value.empty())
+                    count++;
+        }
+        else if (value.Type() == kValueArray)
+        {
+            for (const Value& elt : value.AsArray())
+                if ((elt.IsObject() || elt.IsArray()) && !elt.empty())
+                    count++;
+        }
+
+        return count;
+    }
+}
+
+void JsonWriter::WriteParts(const Value& root)
+{
+    // Split the tree into subtrees in document order, repeatedly expanding the one with the most children until there
+    // are enough to keep the threads busy. These are written in parallel, and WriteValue() then splices them in.
+    mParts.clear();
+    mNextPart = 0;
+
+    int numThreads = NumThreadsToUse(mFormat.threads);
+
+    if (numThreads <= 1)
+        return;
+
+    struct Node
+    {
+        const Value* value;
+        int          indent;
+        char         context;
+    };
+
+    int indentStep = mFormat.indent >= 0 ? mFormat.indent : 0;
+
+    auto addChildren = [indentStep, this](const Node& node, std::vector<Node>* children)
+    {
+        // Each child is preceded by ": " if an object member, or a newline and indent if an element of a multi-line
+        // array. (Arrays containing objects/arrays are always multi-line.) When the indent is negative, all that
+        // matters is that something precedes it.
+        const Value& value = *node.value;
+        int indent = node.indent + indentStep;
+        char context = (value.Type() == kValueArray && indent == 0 && mFormat.indent >= 0) ? '\n' : ' ';
+
+        for (int64_t i = 0, n = value.Type() == kValueObject ? value.NumMembers() : value.NumElts(); i < n; i++)
+        {
+            const Value& child = value.Type() == kValueObject ? value.MemberValue(int(i)) : value.Elt(i);
+
+            if ((child.IsObject() || child.IsArray()) && !child.empty())
+                children->push_back({ &child, indent, context });
+        }
+    };
+
+    // The root isn't itself a part, as it has no preceding context
+    std::vector<Node> nodes;
+    std::vector<Node> children;
+
+    if (NumSplittableChildren(root) < 2)
+        return;
+
+    addChildren({ &root, 0, 0 }, &nodes);
+
+    while (nodes.size() < size_t(8 * numThreads))
+    {
+        int best = -1;
+        int64_t bestCount = 1;
+
+        for (int i = 0, n = size_i(nodes); i < n; i++)
+        {
+            int64_t count = NumSplittableChildren(*nodes[i].value);
+
+            if (bestCount < count)
+            {
+                bestCount = count;
+                best = i;
+            }
+        }
+
+        if (best < 0)
+            break;
+
+        children.clear();
+        addChildren(nodes[best], &children);
+
+        nodes.erase(nodes.begin() + best);
+        nodes.insert(nodes.begin() + best, children.begin(), children.end());
+    }
+
+    mParts.resize(nodes.size());
+
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        mParts[i].value   = nodes[i].value;
+        mParts[i].indent  = nodes[i].indent;
+        mParts[i].context = nodes[i].context;
+    }
+
+    ParallelFor(size_i(mParts), numThreads,
+        [this](int i)
+        {
+            Part& part = mParts[i];
+
+            JsonWriter writer(mFormat);
+            writer.mIndent = part.indent;
+            writer.mDocument += part.context;
+
+            writer.WriteValue(*part.value);
+            part.text.swap(writer.mDocument);
+        }
+    );
+}
+
 void JsonWriter::WriteValue(const Value& value)
 {
+    if (mNextPart < mParts.size() && &value == mParts[mNextPart].value && mIndent == mParts[mNextPart].indent)
+    {
+        const String& text = mParts[mNextPart++].text;
+        mDocument.append(text, 1, String::npos);  // skip context
+        return;
+    }
+
     switch (value.Type())
     {
     case kValueNull:
@@ -1239,7 +1540,10 @@ void JsonWriter::WriteValue(const Value& value)
                 const Value& childValue = objectValue.MemberValue(i);
 
             #ifdef HL_VALUE_COMMENTS
-                WriteCommentBeforeValue(childValue);
+                size_t pathSize = mPath.size();
+                if (mComments)
+                    PushPath(name);
+                WriteCommentBeforeValue();
             #endif
 
                 WriteIndent();
@@ -1259,7 +1563,8 @@ void JsonWriter::WriteValue(const Value& value)
                     mDocument += ',';
 
             #ifdef HL_VALUE_COMMENTS
-                WriteCommentAfterValueOnSameLine(childValue);
+                WriteCommentAfterValueOnSameLine();
+                mPath.resize(pathSize);
             #endif
             }
 
@@ -1273,7 +1578,7 @@ void JsonWriter::WriteValue(const Value& value)
 
 void JsonWriter::WriteArrayValue(const Value& value)
 {
-    int size = size_i(value);
+    int64_t size = int64_t(value.size());
 
     if (size == 0)
     {
@@ -1290,12 +1595,15 @@ void JsonWriter::WriteArrayValue(const Value& value)
 
         Indent();
 
-        for (int i = 0; ; i++)
+        for (int64_t i = 0; ; i++)
         {
             const Value& childValue = value[i];
 
         #ifdef HL_VALUE_COMMENTS
-            WriteCommentBeforeValue(childValue);
+            size_t pathSize = mPath.size();
+            if (mComments)
+                PushPath(i);
+            WriteCommentBeforeValue();
         #endif
 
             if (hasChildValues)
@@ -1309,14 +1617,16 @@ void JsonWriter::WriteArrayValue(const Value& value)
             if (i + 1 == size)
             {
             #ifdef HL_VALUE_COMMENTS
-                WriteCommentAfterValueOnSameLine(childValue);
+                WriteCommentAfterValueOnSameLine();
+                mPath.resize(pathSize);
             #endif
                 break;
             }
 
             mDocument += ',';
         #ifdef HL_VALUE_COMMENTS
-            WriteCommentAfterValueOnSameLine(childValue);
+            WriteCommentAfterValueOnSameLine();
+            mPath.resize(pathSize);
         #endif
         }
 
@@ -1326,11 +1636,11 @@ void JsonWriter::WriteArrayValue(const Value& value)
     }
     else
     {
-        HL_ASSERT(!hasChildValues || size_i(mChildValues) == size);
+        HL_ASSERT(!hasChildValues || int64_t(mChildValues.size()) == size);
 
         mDocument += '[';
 
-        for (int i = 0; i < size; i++)
+        for (int64_t i = 0; i < size; i++)
         {
             if (i > 0)
             {
@@ -1356,18 +1666,23 @@ bool JsonWriter::IsMultiLineArray(const Value& value)
     if (mFormat.arrayMargin == 0)
         return true;
 
-    int size = size_i(value);
+    int64_t size = int64_t(value.size());
     bool isMultiLine = size * 3 >= mFormat.arrayMargin;
 
-    for (int index = 0; index < size && !isMultiLine; index++)
+    for (int64_t index = 0; index < size && !isMultiLine; index++)
     {
         const Value& childValue = value[index];
 
     #ifdef HL_VALUE_COMMENTS
-        if (childValue.HasComment(kCommentBefore) || childValue.HasComment(kCommentAfterOnSameLine) || childValue.HasComment(kCommentAfter))
-            isMultiLine = true;
-        else
+        if (mComments)
+        {
+            size_t pathSize = mPath.size();
+            PushPath(index);
+            isMultiLine = mComments->HasComment(mPath.c_str());
+            mPath.resize(pathSize);
+        }
     #endif
+
         if ((childValue.IsArray() || childValue.IsObject()) && !childValue.empty())
             isMultiLine = true;
     }
@@ -1378,12 +1693,12 @@ bool JsonWriter::IsMultiLineArray(const Value& value)
         mChildValues.reserve(size);
         mAddChildValues = true;
 
-        int lineLength = 2 + (size - 1) * 2; // '[' + ', ' * (n - 1) + ']'
+        int64_t lineLength = 2 + (size - 1) * 2; // '[' + ', ' * (n - 1) + ']'
 
-        for (int i = 0; i < size; i++)
+        for (int64_t i = 0; i < size; i++)
         {
             WriteValue(value[i]);
-            lineLength += int(mChildValues[i].length());
+            lineLength += int64_t(mChildValues[i].length());
         }
 
         mAddChildValues = false;
@@ -1442,21 +1757,46 @@ void JsonWriter::Unindent()
 }
 
 #ifdef HL_VALUE_COMMENTS
-void JsonWriter::WriteCommentBeforeValue(const Value& root)
+void JsonWriter::SetComments(const ValueComments* comments)
+{
+    mComments = comments;
+}
+
+void JsonWriter::WriteCommentBeforeValue()
 {
-    if (!root.HasComment(kCommentBefore))
+    if (!mComments || !mComments->HasComment(mPath.c_str(), kCommentBefore))
         return;
 
-    NormalizeEOL(root.Comment(kCommentBefore), &mDocument);
+    WriteIndent();
+    NormalizeEOL(mComments->Comment(mPath.c_str(), kCommentBefore), &mDocument);
 }
 
-void JsonWriter::WriteCommentAfterValueOnSameLine(const Value& root)
+void JsonWriter::WriteCommentAfterValueOnSameLine()
 {
-    if (root.HasComment(kCommentAfterOnSameLine))
+    if (!mComments)
+        return;
+
+    if (mComments->HasComment(mPath.c_str(), kCommentAfterOnSameLine))
+    {
         mDocument += ' ';
+        NormalizeEOL(mComments->Comment(mPath.c_str(), kCommentAfterOnSameLine), &mDocument);
+    }
 
-    if (root.HasComment(kCommentAfter))
-        NormalizeEOL(root.Comment(kCommentAfter), &mDocument);
+    if (mComments->HasComment(mPath.c_str(), kCommentAfter))
+    {
+        mDocument += '\n';
+        NormalizeEOL(mComments->Comment(mPath.c_str(), kCommentAfter), &mDocument);
+    }
+}
+
+void JsonWriter::PushPath(const char* key)
+{
+    ValueComments::AppendKey(&mPath, key, strlen(key));
+}
+
+void JsonWriter::PushPath(int64_t index)
+{
+    AppendFormat(&mPath, "[%lld]", (long long) index);
 }
 #endif
 
@@ -1483,20 +1823,43 @@ bool HL::LoadJsonFile(const char* path, Value* value, String* errors, StringTabl
     return fclose(file) == 0 && result;
 }
 
-bool HL::LoadJsonFile(FILE* file, Value* value, String* errors, StringTable* st)
+namespace
 {
-    long fileSize = 0;
+    int64_t FileSize(FILE* file)
+    {
+        // Returns -1 if the file can't be seeked, leaving it positioned at the start. ftell() returns a long, which
+        // is only 32 bits on Windows and 32-bit platforms.
+    #if HL_WINDOWS
+        int64_t size = _fseeki64(file, 0, SEEK_END) == 0 ? _ftelli64(file) : -1;
+
+        if (_fseeki64(file, 0, SEEK_SET) != 0)
+            size = -1;
+    #else
+        int64_t size = fseeko(file, 0, SEEK_END) == 0 ? int64_t(ftello(file)) : -1;
 
-    if (fseek(file, 0, SEEK_END) == 0)
-        fileSize = ftell(file);
+        if (fseeko(file, 0, SEEK_SET) != 0)
+            size = -1;
+    #endif
 
-    if (fseek(file, 0, SEEK_SET) != 0)
-        fileSize = 0;
+        return size;
+    }
+}
+
+bool HL::LoadJsonFile(FILE* file, Value* value, String* errors, StringTable* st)
+{
+    int64_t fileSize = FileSize(file);
+
+    if (fileSize < 0 || uint64_t(fileSize) > SIZE_MAX - 1)
+    {
+        if (errors)
+            *errors += "Couldn't determine file size\n";
+        return false;
+    }
 
     String text;
-    text.resize(fileSize);
+    text.resize(size_t(fileSize));
 
-    if (fread((char*) text.data(), 1, fileSize, file) != (size_t) fileSize)
+    if (fread((char*) text.data(), 1, size_t(fileSize), file) != size_t(fileSize))
     {
         if (errors)
             *errors += "Couldn't read file data\n";
@@ -1532,6 +1895,24 @@ bool HL::LoadJsonText(const char* textBegin, const char* textEnd, Value* value,
     return false;
 }
 
+#ifdef HL_VALUE_COMMENTS
+bool HL::LoadJsonTextWithComments(const char* text, Value* value, ValueComments* comments, String* errors, StringTable* st)
+{
+    JsonReader reader(st);
+    reader.SetComments(comments);
+
+    if (reader.Read(text, value))
+        return true;
+
+    if (errors)
+        reader.GetErrors(errors);
+
+    return false;
+}
+#endif
+
+
+int HL::kJsonMaxDepth = 20000;
 
 JsonFormat HL::kJsonFormatDefault;
 JsonFormat HL::kJsonFormatStrict = { 2, true, 0, 6, true, kInfNanNull };
@@ -1569,3 +1950,12 @@ void HL::SaveAsJson(String* text, const Value& v, const JsonFormat& format)
     JsonWriter writer(format);
     writer.Write(v, text);
 }
+
+#ifdef HL_VALUE_COMMENTS
+void HL::SaveAsJsonWithComments(String* text, const Value& v, const ValueComments& comments, const JsonFormat& format)
+{
+    JsonWriter writer(format);
+    writer.SetComments(&comments);
+    writer.Write(v, text);
+}
+#endif
@@ -22,6 +22,8 @@ namespace HL
     bool LoadJsonText(const char* text, Value* value, String* errors = 0, StringTable* st = 0);
     bool LoadJsonText(const char* textBegin, const char* textEnd, Value* value, String* errors = 0, StringTable* st = 0);
 
+    extern int kJsonMaxDepth;  // Maximum nesting depth when loading, beyond which the remainder is skipped with an error
+
     // File/string saving
 
     enum InfNanType { kInfNanC, kInfNanJS, kInfNanNull };  // How to emit floating point specials: inf/nan (C), Infinity/NaN (Javascript), or as a null value.
@@ -35,6 +37,8 @@ namespace HL
         bool trimZeroes    = true;   // Remove trailing zeroes for a minimal text representation
 
         InfNanType infNaN  = kInfNanJS;  // How to emit floating point specials
+
+        int  threads       = 1;      // Threads to use when writing large values, or 0 for one per core. The output is the same regardless.
     };
 
     extern JsonFormat kJsonFormatDefault; // json5 compatible
@@ -45,6 +49,14 @@ namespace HL
     bool SaveAsJson(const char*  path, const Value& v, const JsonFormat& format = kJsonFormatDefault);
     bool SaveAsJson(FILE*        out,  const Value& v, const JsonFormat& format = kJsonFormatDefault);
     void SaveAsJson(String*      text, const Value& v, const JsonFormat& format = kJsonFormatDefault);
+
+#ifdef HL_VALUE_COMMENTS
+    // Comment-preserving variants. Comments are held in a separate side table rather than in the Values themselves.
+    class ValueComments;
+
+    bool LoadJsonTextWithComments(const char* text, Value* value, ValueComments* comments, String* errors = 0, StringTable* st = 0);
+    void SaveAsJsonWithComments  (String*     text, const Value& v, const ValueComments& comments, const JsonFormat& format = kJsonFormatDefault);
+#endif
 }
 
 #endif
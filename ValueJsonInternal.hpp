@@ -7,6 +7,7 @@
 //
 
 #include "ValueJson.hpp"
+#include "Value.hpp"
 #include "RefCount.hpp"
 #include <vector>
 
@@ -17,6 +18,11 @@
 namespace HL
 {
     class Value;
+    struct ObjectShapeTable;
+    struct ValueKeySpan;
+#ifdef HL_VALUE_COMMENTS
+    class ValueComments;
+#endif
 
     //
     // Json parser. Supports:
@@ -43,6 +49,12 @@ namespace HL
 
         int GetFirstErrorLine() const;  // Returns line number of the first error, or -1 if none.
 
+        void SetMaxDepth(int maxDepth);  // Nesting beyond 'maxDepth' is reported as an error. Defaults to kJsonMaxDepth.
+
+    #ifdef HL_VALUE_COMMENTS
+        void SetComments(ValueComments* comments);  // If non-null, subsequent Read() calls collect comments into 'comments'
+    #endif
+
     protected:
         typedef const char* Location;
 
@@ -81,8 +93,18 @@ namespace HL
             Location mExtra;
         };
 
+        struct Frame
+        {
+            Value*        mNode;            // Where the container goes once read
+            bool          mIsObject;
+            bool          mInChild;         // Whether a member or element is being read
+            size_t        mPathSize;        // Length of mPath for the container
+            ArrayBuilder  mArray;
+            ObjectBuilder mObject;
+        };
+
         typedef std::vector<ErrorInfo> Errors;
-        typedef std::vector<Value*> Nodes;
+        typedef std::vector<Frame> Frames;
 
         // Utils
         bool ExpectToken(TokenType type, Token& token, const char* message);
@@ -98,13 +120,16 @@ namespace HL
         void ReadNumber();
         bool ReadValue();
 
-        bool ReadValue(Token& token);
-        bool ReadObject(Token& token);
-        bool ReadArray(Token& token);
+        bool StartValue(Token& token);
+        bool NextMember(Frame& frame, Token& token, bool& ok);
+        bool NextElt   (Frame& frame, Token& token, bool& ok);
+        bool EndContainer(Frame& frame, bool ok);
+        void EndValue();
 
         bool DecodeNumber(Token& token);
         bool DecodeString(Token& token);
         bool DecodeString(Token& token, String& decoded);
+        bool RawString(const Token& token, ValueKeySpan* span) const;  // Returns true if the string token needs no decoding, with 'span' set to its contents
         bool DecodeDouble(Token& token);
         bool DecodeUnicodeEscapeSequence(Token& token, Location& current, Location end, uint32_t& unicode);
 
@@ -113,17 +138,22 @@ namespace HL
         bool AddErrorAndRecover(const String& message, Token& token, TokenType skipUntilToken);
 
         char GetNextChar();
-        void GetLocationLineAndColumn(Location location, int& line, int& column) const;
+        void GetLocationLineAndColumn(Location location, int64_t& line, int64_t& column) const;
         void AddLocationLineAndColumn(Location location, String* str) const;
         bool ReadNonCommentToken(Token& token);
 
     #ifdef HL_VALUE_COMMENTS
         void AddComment(Location begin, Location end, int placement);
+        void PushPath(const char* key, size_t len);
+        void PushPath(int64_t index);
     #endif
 
     protected:
         // Data
-        Nodes       mNodes;
+        Value*      mNode = 0;       // value currently being read
+        Frames      mFrames;         // containers being read, from the outermost. Entries past mDepth are kept for reuse.
+        int         mDepth = 0;
+        int         mMaxDepth = kJsonMaxDepth;
         Errors      mErrors;
         Location    mBegin   = 0;
         Location    mEnd     = 0;
@@ -132,11 +162,16 @@ namespace HL
     #ifdef HL_STRING_TABLE_HPP
         AutoRef<StringTable> mStringTable;
     #endif
+        AutoRef<ObjectShapeTable> mShapeTable;
 
         // Comments handling
         Location    mLastValueEnd = 0;
-        Value*      mLastValue = 0;
         String      mCommentsBefore;
+    #ifdef HL_VALUE_COMMENTS
+        ValueComments* mComments = 0;
+        String      mPath;           // path of the value currently being read
+        String      mLastValuePath;  // path of the value ending at mLastValueEnd
+    #endif
 
         // Options
         bool        mCollectComments      = false;
@@ -144,6 +179,7 @@ namespace HL
         bool        mAllowTrailingCommas  = true;
         bool        mUseStringTableForKey   = true;
         bool        mUseStringTableForValue = true;
+        bool        mShareObjectShapes      = true;
     };
 
 
@@ -158,7 +194,12 @@ namespace HL
         void        Write(const Value& value, String* jsonText);  // Fill 'jsonText' with the json representation of 'value'
         const char* Write(const Value& value);  // Return the json representation of 'value' as a C string, valid until the next Write() call.
 
+    #ifdef HL_VALUE_COMMENTS
+        void        SetComments(const ValueComments* comments);  // If non-null, subsequent Write() calls include the given comments
+    #endif
+
     protected:
+        void WriteParts(const Value& root);
         void WriteValue(const Value& value);
         void WriteArrayValue(const Value& value);
         bool IsMultiLineArray(const Value& value);
@@ -169,9 +210,10 @@ namespace HL
         void Unindent();
 
     #ifdef HL_VALUE_COMMENTS
-        void WriteCommentedValue(const Value& value);
-        void WriteCommentBeforeValue(const Value& root);
-        void WriteCommentAfterValueOnSameLine(const Value& root);
+        void WriteCommentBeforeValue();
+        void WriteCommentAfterValueOnSameLine();
+        void PushPath(const char* key);
+        void PushPath(int64_t index);
     #endif
 
         // Data
@@ -184,5 +226,21 @@ namespace HL
         JsonFormat mFormat;
 
         String mScratch;
+
+        struct Part  // Subtree written in parallel ahead of the main pass
+        {
+            const Value* value;
+            int          indent;    // Indent of 'value' in the main document
+            char         context;   // Last character written before 'value', which determines how it starts
+            String       text;      // Written value, prefixed by 'context'
+        };
+
+        std::vector<Part> mParts;
+        size_t            mNextPart = 0;
+
+    #ifdef HL_VALUE_COMMENTS
+        const ValueComments* mComments = 0;
+        String  mPath;  // path of the value currently being written
+    #endif
     };
 }
@@ -0,0 +1,884 @@
+//
+// ValuePack.cpp
+//
+// Block-compressed binary values, with random access to top-level members
+//
+
+#include "ValuePack.hpp"
+
+#include <algorithm>
+
+using namespace HL;
+
+size_t HL::kPackBlockSize = 256 * 1024;
+
+namespace
+{
+    // File layout, with all integers little endian:
+    //   "HLPK", version (4)     header
+    //   blocks                  each in the LZ4 block format
+    //   index                   root type, then block sizes and entries, as varints
+    //   index offset (8)        trailer, so the file can be written in a single pass
+    const char     kPackMagic[4] = { 'H', 'L', 'P', 'K' };
+    const uint32_t kPackVersion  = 1;
+    const size_t   kHeaderSize   = 8;
+    const size_t   kTrailerSize  = 8;
+
+    // --- Compression -----------------------------------------------------------
+
+    // Blocks are a series of sequences, each a token byte with the literal count in its top nibble and the match
+    // length - 4 in its bottom, either extended by following bytes if 15, then the literals themselves, and a 2-byte
+    // offset back to the match. The last 5 bytes are always literals, and no match starts in the last 12, as per the
+    // LZ4 block format, so standard LZ4 decoders can read them too.
+    const size_t kMinMatch     = 4;
+    const size_t kLastLiterals = 5;
+    const size_t kMatchLimit   = 12;
+    const size_t kMaxOffset    = 65535;
+    const int    kHashBits     = 16;
+
+    inline uint32_t Read32(const uint8_t* p)
+    {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline uint64_t Read64(const uint8_t* p)
+    {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline uint32_t Hash4(uint32_t v)
+    {
+        return (v * 2654435761u) >> (32 - kHashBits);
+    }
+
+    void WriteLength(String* out, size_t n)
+    {
+        for (; n >= 255; n -= 255)
+            out->push_back(char(255));
+
+        out->push_back(char(n));
+    }
+
+    void WriteSequence(String* out, const uint8_t* literals, size_t numLiterals, size_t offset, size_t matchLength)
+    // Writes the literals followed by the given match, or if 'matchLength' is 0, just the literals, to end the block
+    {
+        size_t matchCode = matchLength ? matchLength - kMinMatch : 0;
+
+        out->push_back(char((std::min<size_t>(numLiterals, 15) << 4) | std::min<size_t>(matchCode, 15)));
+
+        if (numLiterals >= 15)
+            WriteLength(out, numLiterals - 15);
+
+        out->append((const char*) literals, numLiterals);
+
+        if (matchLength == 0)
+            return;
+
+        out->push_back(char(offset & 0xFF));
+        out->push_back(char(offset >> 8));
+
+        if (matchCode >= 15)
+            WriteLength(out, matchCode - 15);
+    }
+
+    void Compress(const uint8_t* src, size_t size, uint32_t table[], String* out)
+    // Greedy LZ77 with a single-entry hash table of recent positions. The table isn't cleared between blocks, as any
+    // candidate match is checked against the actual data before use.
+    {
+        size_t anchor = 0;
+
+        if (size > kMatchLimit)
+        {
+            size_t startLimit = size - kMatchLimit;
+            size_t endLimit   = size - kLastLiterals;
+            size_t i = 0;
+
+            while (i < startLimit)
+            {
+                uint32_t  sequence  = Read32(src + i);
+                uint32_t& slot      = table[Hash4(sequence)];
+                size_t    candidate = slot;
+
+                slot = uint32_t(i);
+
+                if (candidate >= i || i - candidate > kMaxOffset || Read32(src + candidate) != sequence)
+                {
+                    i += 1 + ((i - anchor) >> 6);  // step faster through incompressible data
+                    continue;
+                }
+
+                size_t distance = i - candidate;
+                size_t end = i + kMinMatch;
+
+                while (end + 8 <= endLimit && Read64(src + end) == Read64(src + end - distance))
+                    end += 8;
+                while (end < endLimit && src[end] == src[end - distance])
+                    end++;
+
+                WriteSequence(out, src + anchor, i - anchor, distance, end - i);
+                i = anchor = end;
+            }
+        }
+
+        WriteSequence(out, src + anchor, size - anchor, 0, 0);
+    }
+
+    bool ReadLength(const uint8_t** p, const uint8_t* end, size_t* n)
+    {
+        uint8_t b;
+
+        do
+        {
+            if (*p == end)
+                return false;
+
+            b = *(*p)++;
+            *n += b;
+        }
+        while (b == 255);
+
+        return true;
+    }
+
+    bool Decompress(const uint8_t* src, size_t size, uint8_t* dst, size_t rawSize)
+    // Returns false rather than reading or writing out of bounds if the data is corrupt
+    {
+        const uint8_t* ip    = src;
+        const uint8_t* ipEnd = src + size;
+        uint8_t*       op    = dst;
+        uint8_t*       opEnd = dst + rawSize;
+
+        while (ip < ipEnd)
+        {
+            uint8_t token = *ip++;
+            size_t numLiterals = token >> 4;
+
+            if (numLiterals == 15 && !ReadLength(&ip, ipEnd, &numLiterals))
+                return false;
+
+            if (numLiterals > size_t(ipEnd - ip) || numLiterals > size_t(opEnd - op))
+                return false;
+
+            memcpy(op, ip, numLiterals);
+            ip += numLiterals;
+            op += numLiterals;
+
+            if (ip == ipEnd)  // the last sequence is literals only
+                break;
+
+            if (ipEnd - ip < 2)
+                return false;
+
+            size_t offset = ip[0] | (ip[1] << 8);
+            size_t length = token & 15;
+            ip += 2;
+
+            if (length == 15 && !ReadLength(&ip, ipEnd, &length))
+                return false;
+
+            length += kMinMatch;
+
+            if (offset == 0 || offset > size_t(op - dst) || length > size_t(opEnd - op))
+                return false;
+
+            const uint8_t* match = op - offset;
+
+            if (offset >= length)
+                memcpy(op, match, length);
+            else
+                for (size_t j = 0; j < length; j++)  // overlapping, i.e., a repeating pattern
+                    op[j] = match[j];
+
+            op += length;
+        }
+
+        return op == opEnd;
+    }
+
+
+    // --- Encoding --------------------------------------------------------------
+
+    void WriteVarint(String* out, uint64_t v)
+    {
+        for (; v >= 0x80; v >>= 7)
+            out->push_back(char(v | 0x80));
+
+        out->push_back(char(v));
+    }
+
+    void WriteString(String* out, const char* s, size_t len)
+    {
+        WriteVarint(out, len);
+        out->append(s, len);
+    }
+
+    inline uint64_t ZigZag(int64_t v)
+    {
+        return (uint64_t(v) << 1) ^ uint64_t(v >> 63);
+    }
+
+    inline int64_t UnZigZag(uint64_t v)
+    {
+        return int64_t(v >> 1) ^ -int64_t(v & 1);
+    }
+
+    void EncodeValue(String* out, const Value& root)
+    // Each value is its type byte followed by its contents, with containers giving their size and then their
+    // members or elements. As with the text writers, containers are handled iteratively rather than recursively.
+    {
+        struct Frame
+        {
+            const Value* value;
+            int64_t      i;
+            int64_t      n;
+        };
+
+        std::vector<Frame> stack;
+        const Value* v = &root;
+
+        while (v)
+        {
+            out->push_back(char(v->Type()));
+
+            switch (v->Type())
+            {
+            case kValueBool:
+                out->push_back(char(v->AsBool()));
+                break;
+            case kValueInt:
+            case kValueInt64:
+                WriteVarint(out, ZigZag(v->AsInt64()));
+                break;
+            case kValueUInt:
+            case kValueUInt64:
+                WriteVarint(out, v->AsUInt64());
+                break;
+            case kValueDouble:
+                {
+                    double d = v->AsDouble();
+                    out->append((const char*) &d, sizeof(d));
+                }
+                break;
+            case kValueString:
+                WriteString(out, v->AsString(), v->size());
+                break;
+            case kValueArray:
+            case kValueObject:
+                WriteVarint(out, v->size());
+                stack.push_back({ v, 0, int64_t(v->size()) });
+                break;
+            default:
+                break;
+            }
+
+            v = nullptr;
+
+            while (!v && !stack.empty())
+            {
+                Frame& frame = stack.back();
+
+                if (frame.i == frame.n)
+                {
+                    stack.pop_back();
+                    continue;
+                }
+
+                int64_t i = frame.i++;
+
+                if (frame.value->Type() == kValueObject)
+                {
+                    const char* name = frame.value->MemberName(int(i));
+                    WriteString(out, name, strlen(name));
+                    v = &frame.value->MemberValue(int(i));
+                }
+                else
+                    v = &frame.value->Elt(i);
+            }
+        }
+    }
+
+    struct PackReader
+    {
+        const uint8_t* p;
+        const uint8_t* end;
+
+        bool ReadByte(uint8_t* b)
+        {
+            if (p == end)
+                return false;
+
+            *b = *p++;
+            return true;
+        }
+
+        bool ReadVarint(uint64_t* v)
+        {
+            *v = 0;
+
+            for (int shift = 0; shift < 64; shift += 7)
+            {
+                if (p == end)
+                    return false;
+
+                uint8_t b = *p++;
+                *v |= uint64_t(b & 0x7F) << shift;
+
+                if (b < 0x80)
+                    return true;
+            }
+
+            return false;
+        }
+
+        bool ReadString(ValueKeySpan* s)
+        {
+            uint64_t len;
+
+            if (!ReadVarint(&len) || len > uint64_t(end - p))
+                return false;
+
+            *s = { (const char*) p, size_t(len) };
+            p += len;
+            return true;
+        }
+
+        bool ReadCount(uint64_t* n)  // Every element takes at least a byte, so larger counts are corrupt
+        {
+            return ReadVarint(n) && *n <= uint64_t(end - p);
+        }
+    };
+
+    bool DecodeValue(const uint8_t* data, size_t size, Value* root)
+    {
+        struct Frame
+        {
+            Value*        node;        // Where the container goes once read
+            bool          isObject;
+            uint64_t      remaining;
+            ArrayBuilder  array;
+            ObjectBuilder object;
+        };
+
+        PackReader reader = { data, data + size };
+        std::vector<Frame> frames;
+        Value* v = root;
+
+        while (v)
+        {
+            uint8_t type;
+            uint64_t n;
+            ValueKeySpan s;
+
+            if (!reader.ReadByte(&type))
+                return false;
+
+            switch (type)
+            {
+            case kValueNull:
+                v->MakeNull();
+                break;
+            case kValueBool:
+                {
+                    uint8_t b;
+
+                    if (!reader.ReadByte(&b))
+                        return false;
+
+                    *v = b != 0;
+                }
+                break;
+            case kValueInt:
+                if (!reader.ReadVarint(&n))
+                    return false;
+                *v = int32_t(UnZigZag(n));
+                break;
+            case kValueInt64:
+                if (!reader.ReadVarint(&n))
+                    return false;
+                *v = UnZigZag(n);
+                break;
+            case kValueUInt:
+                if (!reader.ReadVarint(&n))
+                    return false;
+                *v = uint32_t(n);
+                break;
+            case kValueUInt64:
+                if (!reader.ReadVarint(&n))
+                    return false;
+                *v = n;
+                break;
+            case kValueDouble:
+                {
+                    double d;
+
+                    if (size_t(reader.end - reader.p) < sizeof(d))
+                        return false;
+
+                    memcpy(&d, reader.p, sizeof(d));
+                    reader.p += sizeof(d);
+                    *v = d;
+                }
+                break;
+            case kValueString:
+                if (!reader.ReadString(&s))
+                    return false;
+                *v = Value(CreateStringValue(s.data, s.size));
+                break;
+            case kValueArray:
+            case kValueObject:
+                if (!reader.ReadCount(&n))
+                    return false;
+
+                frames.emplace_back();
+                frames.back().node      = v;
+                frames.back().isObject  = type == kValueObject;
+                frames.back().remaining = n;
+
+                if (type == kValueObject)
+                    frames.back().object.Reserve(size_t(n));
+                else
+                    frames.back().array.Reserve(size_t(n));
+                break;
+            default:
+                return false;
+            }
+
+            v = nullptr;
+
+            while (!v && !frames.empty())
+            {
+                Frame& frame = frames.back();
+
+                if (frame.remaining == 0)
+                {
+                    if (frame.isObject)
+                        frame.object.Finish(frame.node);
+                    else
+                        frame.array.Finish(frame.node);
+
+                    frames.pop_back();
+                    continue;
+                }
+
+                frame.remaining--;
+
+                if (!frame.isObject)
+                    v = &frame.array.Add();
+                else if (reader.ReadString(&s))
+                    v = &frame.object.Add(s);
+                else
+                    return false;
+            }
+        }
+
+        return reader.p == reader.end;
+    }
+
+
+    // --- Files -----------------------------------------------------------------
+
+    void WriteLE(uint8_t* p, uint64_t v, int numBytes)
+    {
+        for (int i = 0; i < numBytes; i++)
+            p[i] = uint8_t(v >> (8 * i));
+    }
+
+    uint64_t ReadLE(const uint8_t* p, int numBytes)
+    {
+        uint64_t v = 0;
+
+        for (int i = 0; i < numBytes; i++)
+            v |= uint64_t(p[i]) << (8 * i);
+
+        return v;
+    }
+
+    bool Seek(FILE* file, int64_t offset, int origin)
+    {
+    #if HL_WINDOWS
+        return _fseeki64(file, offset, origin) == 0;
+    #else
+        return fseeko(file, off_t(offset), origin) == 0;
+    #endif
+    }
+
+    int64_t Tell(FILE* file)
+    {
+    #if HL_WINDOWS
+        return _ftelli64(file);
+    #else
+        return int64_t(ftello(file));
+    #endif
+    }
+}
+
+bool HL::SaveAsPacked(const char* path, const Value& v, String* errors)
+{
+    FILE* file = fopen(path, "wb");
+
+    if (!file)
+    {
+        if (errors)
+        {
+            *errors += "Couldn't write ";
+            *errors += path;
+            *errors += '\n';
+        }
+        return false;
+    }
+
+    bool result = SaveAsPacked(file, v, errors);
+    return fclose(file) == 0 && result;
+}
+
+bool HL::SaveAsPacked(FILE* out, const Value& v, String* errors)
+{
+    // The entries are the top-level members or elements, or a scalar itself. These are encoded in order, and grouped
+    // into blocks of at least kPackBlockSize, so small members compress well, while large ones get a block each.
+    bool   isObject   = v.IsObject();
+    size_t numEntries = (isObject || v.IsArray()) ? v.size() : 1;
+
+    String   blockSizes;
+    String   entries;
+    uint64_t numBlocks = 0;
+    uint64_t offset    = kHeaderSize;
+
+    String raw;
+    String compressed;
+    std::vector<uint32_t> table(size_t(1) << kHashBits, 0);
+
+    uint8_t header[kHeaderSize];
+    memcpy(header, kPackMagic, 4);
+    WriteLE(header + 4, kPackVersion, 4);
+
+    bool ok = fwrite(header, 1, kHeaderSize, out) == kHeaderSize;
+
+    for (size_t i = 0; i <= numEntries && ok; i++)
+    {
+        if (i < numEntries)
+        {
+            const Value& entry = isObject ? v.MemberValue(int(i)) : v.IsArray() ? v.Elt(int64_t(i)) : v;
+            size_t start = raw.size();
+
+            if (isObject)
+                WriteString(&entries, v.MemberName(int(i)), strlen(v.MemberName(int(i))));
+
+            EncodeValue(&raw, entry);
+
+            WriteVarint(&entries, numBlocks);
+            WriteVarint(&entries, start);
+            WriteVarint(&entries, raw.size() - start);
+
+            if (raw.size() < kPackBlockSize)
+                continue;
+        }
+
+        if (raw.empty())
+            continue;
+
+        compressed.clear();
+        Compress((const uint8_t*) raw.data(), raw.size(), table.data(), &compressed);
+
+        ok = fwrite(compressed.data(), 1, compressed.size(), out) == compressed.size();
+
+        WriteVarint(&blockSizes, compressed.size());
+        WriteVarint(&blockSizes, raw.size());
+        offset += compressed.size();
+        numBlocks++;
+
+        raw.clear();
+    }
+
+    String index;
+    index.push_back(char(v.Type()));
+    WriteVarint(&index, numBlocks);
+    index += blockSizes;
+    WriteVarint(&index, numEntries);
+    index += entries;
+
+    uint8_t trailer[kTrailerSize];
+    WriteLE(trailer, offset, 8);
+
+    ok = ok
+        && fwrite(index.data(), 1, index.size(), out) == index.size()
+        && fwrite(trailer, 1, kTrailerSize, out) == kTrailerSize;
+
+    if (!ok && errors)
+        *errors += "Couldn't write packed data\n";
+
+    return ok;
+}
+
+
+// --- ValuePack ---------------------------------------------------------------
+
+ValuePack::~ValuePack()
+{
+    Close();
+}
+
+bool ValuePack::Open(const char* path, String* errors)
+{
+    Close();
+
+    mFile = fopen(path, "rb");
+
+    if (!mFile)
+    {
+        if (errors)
+        {
+            *errors += "Couldn't read ";
+            *errors += path;
+            *errors += '\n';
+        }
+        return false;
+    }
+
+    auto fail = [this, path, errors](const char* problem)
+    {
+        if (errors)
+            AppendFormat(errors, "%s: %s\n", path, problem);
+
+        Close();
+        return false;
+    };
+
+    uint8_t header[kHeaderSize];
+    uint8_t trailer[kTrailerSize];
+
+    if (fread(header, 1, kHeaderSize, mFile) != kHeaderSize || memcmp(header, kPackMagic, 4) != 0)
+        return fail("not a packed value");
+
+    if (ReadLE(header + 4, 4) != kPackVersion)
+        return fail("unsupported version");
+
+    if (!Seek(mFile, -int64_t(kTrailerSize), SEEK_END) || fread(trailer, 1, kTrailerSize, mFile) != kTrailerSize)
+        return fail("truncated");
+
+    int64_t  indexEnd    = Tell(mFile) - int64_t(kTrailerSize);
+    uint64_t indexOffset = ReadLE(trailer, 8);
+
+    if (indexEnd < int64_t(kHeaderSize) || indexOffset < kHeaderSize || indexOffset > uint64_t(indexEnd))
+        return fail("truncated");
+
+    String index;
+    index.resize(size_t(uint64_t(indexEnd) - indexOffset));
+
+    if (!Seek(mFile, int64_t(indexOffset), SEEK_SET) || fread((char*) index.data(), 1, index.size(), mFile) != index.size())
+        return fail("couldn't read index");
+
+    // Check everything up front, so later access only has to worry about the block contents
+    PackReader reader = { (const uint8_t*) index.data(), (const uint8_t*) index.data() + index.size() };
+    uint8_t type;
+    uint64_t numBlocks;
+    uint64_t numEntries;
+
+    if (!reader.ReadByte(&type) || type > kValueObject || !reader.ReadCount(&numBlocks))
+        return fail("corrupt index");
+
+    mType = ValueType(type);
+    mBlocks.resize(size_t(numBlocks));
+
+    uint64_t offset = kHeaderSize;
+
+    for (Block& block : mBlocks)
+    {
+        if (!reader.ReadVarint(&block.size) || !reader.ReadVarint(&block.rawSize))
+            return fail("corrupt index");
+
+        // Each byte of compressed data expands to at most 255 or so, which also guards against absurd allocations
+        if (block.size > indexOffset - offset || block.rawSize / 256 > block.size)
+            return fail("corrupt index");
+
+        block.offset = offset;
+        offset += block.size;
+    }
+
+    bool isContainer = mType == kValueObject || mType == kValueArray;
+
+    if (!reader.ReadCount(&numEntries) || (!isContainer && numEntries != 1))
+        return fail("corrupt index");
+
+    mEntries.resize(size_t(numEntries));
+
+    for (PackEntry& entry : mEntries)
+    {
+        ValueKeySpan key = { "", 0 };
+        uint64_t block;
+
+        if (mType == kValueObject && !reader.ReadString(&key))
+            return fail("corrupt index");
+
+        if (mKeys.size() > UINT32_MAX || !reader.ReadVarint(&block) || !reader.ReadVarint(&entry.offset) || !reader.ReadVarint(&entry.size))
+            return fail("corrupt index");
+
+        if (block >= numBlocks || entry.offset > mBlocks[size_t(block)].rawSize || entry.size > mBlocks[size_t(block)].rawSize - entry.offset)
+            return fail("corrupt index");
+
+        entry.key    = uint32_t(mKeys.size());
+        entry.block  = uint32_t(block);
+        entry.loaded = false;
+
+        mKeys.append(key.data, key.size);
+        mKeys.push_back(0);
+    }
+
+    if (reader.p != reader.end)
+        return fail("corrupt index");
+
+    mValues.resize(mEntries.size());
+    return true;
+}
+
+void ValuePack::Close()
+{
+    if (mFile)
+        fclose(mFile);
+
+    mFile = nullptr;
+    mType = kValueNull;
+    mBlocks.clear();
+    mEntries.clear();
+    mValues.clear();
+    mKeys.clear();
+    mErrors.clear();
+    mCachedBlock = -1;
+    mBlockData.clear();
+}
+
+int64_t ValuePack::MemberIndex(ValueKeySpan key) const
+{
+    if (mType != kValueObject)
+        return -1;
+
+    auto it = std::lower_bound(mEntries.begin(), mEntries.end(), key,
+        [this](const PackEntry& entry, ValueKeySpan key)
+        {
+            return CompareKey(mKeys.c_str() + entry.key, key) < 0;
+        }
+    );
+
+    if (it == mEntries.end() || CompareKey(mKeys.c_str() + it->key, key) != 0)
+        return -1;
+
+    return it - mEntries.begin();
+}
+
+const Value& ValuePack::Entry(size_t i)
+{
+    if (i >= mEntries.size())
+        return kNullValue;
+
+    if (!mEntries[i].loaded)
+    {
+        mEntries[i].loaded = true;  // whether or not it succeeds, so problems are only reported once
+        LoadEntry(i, &mValues[i]);
+    }
+
+    return mValues[i];
+}
+
+const Value& ValuePack::Member(ValueKeySpan key)
+{
+    int64_t i = MemberIndex(key);
+
+    if (i < 0)
+        return kNullValue;
+
+    return Entry(size_t(i));
+}
+
+bool ValuePack::Load(Value* v)
+{
+    // Entries not already loaded are decoded directly into 'v', rather than being kept as well
+    size_t numErrors = mErrors.size();
+    size_t n = mEntries.size();
+
+    if (mType == kValueObject)
+    {
+        ObjectBuilder builder;
+        builder.Reserve(n);
+
+        for (size_t i = 0; i < n; i++)
+        {
+            Value& member = builder.Add(MemberName(i));
+
+            if (mEntries[i].loaded)
+                member = mValues[i];
+            else
+                LoadEntry(i, &member);
+        }
+
+        builder.Finish(v);
+    }
+    else if (mType == kValueArray)
+    {
+        ArrayBuilder builder;
+        builder.Reserve(n);
+
+        for (size_t i = 0; i < n; i++)
+        {
+            Value& elt = builder.Add();
+
+            if (mEntries[i].loaded)
+                elt = mValues[i];
+            else
+                LoadEntry(i, &elt);
+        }
+
+        builder.Finish(v);
+    }
+    else
+        *v = Entry(0);
+
+    return mErrors.size() == numErrors;
+}
+
+bool ValuePack::LoadEntry(size_t i, Value* v)
+{
+    const PackEntry& entry = mEntries[i];
+
+    if (!ReadBlock(entry.block))
+        return false;
+
+    if (!DecodeValue((const uint8_t*) mBlockData.data() + entry.offset, size_t(entry.size), v))
+    {
+        v->MakeNull();
+        AppendFormat(&mErrors, "Corrupt data for entry %zu\n", i);
+        return false;
+    }
+
+    return true;
+}
+
+bool ValuePack::ReadBlock(uint32_t index)
+{
+    if (mCachedBlock == index)
+        return true;
+
+    const Block& block = mBlocks[index];
+    String compressed;
+
+    compressed.resize(size_t(block.size));
+    mBlockData.resize(size_t(block.rawSize));
+    mCachedBlock = -1;
+
+    if (!Seek(mFile, int64_t(block.offset), SEEK_SET) || fread((char*) compressed.data(), 1, compressed.size(), mFile) != compressed.size())
+    {
+        AppendFormat(&mErrors, "Couldn't read block %u\n", index);
+        return false;
+    }
+
+    if (!Decompress((const uint8_t*) compressed.data(), compressed.size(), (uint8_t*) mBlockData.data(), mBlockData.size()))
+    {
+        AppendFormat(&mErrors, "Corrupt block %u\n", index);
+        return false;
+    }
+
+    mCachedBlock = index;
+    return true;
+}
@@ -0,0 +1,114 @@
+//
+// ValuePack.hpp
+//
+// Block-compressed binary values, with random access to top-level members
+//
+
+#ifndef HL_VALUE_PACK_H
+#define HL_VALUE_PACK_H
+
+#include "Value.hpp"
+
+#include <stdio.h>
+
+namespace HL
+{
+    // Saving
+
+    extern size_t kPackBlockSize;  // Top-level members or elements are grouped into blocks of at least this many bytes before compression
+
+    bool SaveAsPacked(const char* path, const Value& v, String* errors = nullptr);
+    bool SaveAsPacked(FILE*       out,  const Value& v, String* errors = nullptr);
+    // Writes 'v' in a compact binary form, with its top-level members (or elements) grouped into blocks, each
+    // compressed separately with an LZ4-style coder, and followed by an index of which block holds each member.
+    // Output is sequential, so 'out' can be a pipe. Types are preserved exactly, unlike with the text formats.
+
+    // Loading
+
+    class ValuePack
+    // Reader for packed values. Open() reads only the index, and each top-level member is then decompressed and
+    // decoded the first time it's accessed, so a program needing a few subtrees of a large config only pays for those.
+    // Loaded members are kept until Close(). Not thread safe, as access can load.
+    {
+    public:
+        ValuePack() = default;
+        ~ValuePack();
+
+        bool Open(const char* path, String* errors = nullptr);  // Opens the given packed file, returning false if it can't be read or isn't one
+        void Close();
+
+        ValueType    Type() const;                 // Type of the packed value as a whole
+        size_t       size() const;                 // Number of top-level members or elements, or 1 for a scalar
+
+        const char*  MemberName (size_t i) const;  // Name of the i'th member if an object, otherwise ""
+        int64_t      MemberIndex(ValueKeySpan key) const;  // Returns the index of the named member, or -1. O(log n).
+
+        const Value& Entry (size_t i);             // The i'th member's value or element, or a scalar's value, loading it if necessary. Null on error.
+        const Value& Member(ValueKey key);         // The named member, loading it if necessary, or null if there's no such member
+        const Value& Member(ValueKeySpan key);
+
+        bool         Load(Value* v);               // Loads the entire value, e.g., for unpacking
+        const String& Errors() const;              // Problems encountered when loading members
+
+    protected:
+        struct Block
+        {
+            uint64_t offset;      // Position in the file
+            uint64_t size;        // Compressed size
+            uint64_t rawSize;     // Decompressed size
+        };
+
+        struct PackEntry
+        {
+            uint32_t key;         // Offset of the member name in mKeys
+            uint32_t block;
+            uint64_t offset;      // Position of the encoded value in the decompressed block
+            uint64_t size;
+            bool     loaded;
+        };
+
+        FILE*                  mFile = nullptr;
+        ValueType              mType = kValueNull;
+        std::vector<Block>     mBlocks;
+        std::vector<PackEntry> mEntries;
+        std::vector<Value>     mValues;            // Loaded entries
+        String                 mKeys;              // 0-terminated member names
+        String                 mErrors;
+
+        int64_t                mCachedBlock = -1;  // Index of the block in mBlockData, as members often share one
+        String                 mBlockData;
+
+        bool ReadBlock(uint32_t block);
+        bool LoadEntry(size_t i, Value* v);
+    };
+
+
+    // --- Inlines -------------------------------------------------------------
+
+    inline ValueType ValuePack::Type() const
+    {
+        return mType;
+    }
+
+    inline size_t ValuePack::size() const
+    {
+        return mEntries.size();
+    }
+
+    inline const char* ValuePack::MemberName(size_t i) const
+    {
+        return mKeys.c_str() + mEntries[i].key;
+    }
+
+    inline const Value& ValuePack::Member(ValueKey key)
+    {
+        return Member({ key, strlen(key) });
+    }
+
+    inline const String& ValuePack::Errors() const
+    {
+        return mErrors;
+    }
+}
+
+#endif
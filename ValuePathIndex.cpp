@@ -0,0 +1,349 @@
+//
+// ValuePathIndex.cpp
+//
+// Flattened index from full value paths to values
+//
+
+#include "ValuePathIndex.hpp"
+
+#include "external/unordered_dense.h" // requires 64-bit well-mixed hash
+
+using namespace HL;
+
+namespace
+{
+    const uint32_t kHashOffset32 = UINT32_C(0x811C9DC5);
+    const uint32_t kHashPrime32 = 0x01000193;
+
+    inline uint32_t StrHashU32(const char* s)
+    {
+        const uint8_t* data = (const uint8_t*) s;
+        uint32_t hashValue = kHashOffset32;
+        uint32_t c;
+
+        while ((c = *data++) != 0)
+            hashValue = (hashValue ^ c) * kHashPrime32;
+
+        return hashValue;
+    }
+
+    struct PathHash
+    {
+        typedef size_t HashType;
+
+        using is_transparent = void;
+        using is_avalanching = void;
+
+        HashType operator () (const String& s) const { return operator()(s.c_str()); }
+        HashType operator () (const char*   s) const { return StrHashU32(s) * UINT64_C(0x9ddfea08eb382d69); }
+    };
+
+    struct PathEqual
+    {
+        using is_transparent = void;
+
+        bool operator () (const String& a, const String& b) const { return a == b; }
+        bool operator () (const String& a, const char*   b) const { return strcmp(a.c_str(), b) == 0; }
+        bool operator () (const char*   a, const String& b) const { return strcmp(a, b.c_str()) == 0; }
+    };
+
+    struct Container  // An object or array holding indexed values
+    {
+        const Value* slot;      // The Value holding this container, which lives in the parent container
+        const void*  data;      // The ObjectValue or ArrayValue 'slot' held when indexed
+        uint32_t     modCount;  // Object's mod count when indexed
+        int          parent;    // Index of parent container, or -1 for the root
+    };
+
+    struct Entry
+    {
+        const Value* value;
+        int          container;  // Index of container holding 'value', or -1 if it is the root
+    };
+
+    inline const void* ContainerData(const Value& v)
+    {
+        if (v.Type() == kValueObject)
+            return v.mValue.mObject;
+        if (v.Type() == kValueArray)
+            return v.mValue.mArray;
+        return 0;
+    }
+
+    inline size_t StringMemory(const String& s)
+    {
+        return s.capacity() > 15 ? s.capacity() + 1 : 0;  // assume small string optimisation
+    }
+}
+
+namespace HL
+{
+    struct ValuePathIndexImpl : public ValuePathIndex
+    {
+        const Value*    mRoot = 0;
+        Strings         mPrefixes;
+        std::vector<Container> mContainers;
+
+        ankerl::dense_hash_map<String, Entry, PathHash, PathEqual> mEntries;
+
+        int  AddContainer(const Value& v, int parent);
+        void IndexPrefix (const char* prefix);
+        void AddValue    (String* path, const Value& v, int container);
+        bool IsUnchanged (const Container& c) const;
+        bool IsValid     (int container) const;
+        bool IsStale     () const;
+        bool IsIndexed   (const char* path) const;
+    };
+}
+
+int ValuePathIndexImpl::AddContainer(const Value& v, int parent)
+{
+    const void* data = ContainerData(v);
+
+    if (!data)
+        return parent;
+
+    uint32_t modCount = v.IsObject() ? v.AsObject().ModCount() : 0;
+
+    mContainers.push_back({ &v, data, modCount, parent });
+    return int(mContainers.size()) - 1;
+}
+
+void ValuePathIndexImpl::IndexPrefix(const char* prefix)
+{
+    // Find the value at 'prefix', tracking the containers on the way so edits to them are noticed.
+    const Value* v = mRoot;
+    int container = -1;
+
+    for (const char* field = prefix; *field; )
+    {
+        size_t len = PathFieldLength(field);
+
+        container = AddContainer(*v, container);
+
+        if (field[0] == '[')
+        {
+            char* end = nullptr;
+            size_t index = size_t(strtoll(field + 1, &end, 10));
+
+            if (!v->IsArray() || *end != ']' || index >= v->size())
+                return;
+
+            v = &v->Elt(int64_t(index));
+        }
+        else
+        {
+            v = v->MemberPtr(PathFieldKey(field, len));
+
+            if (!v)
+                return;
+        }
+
+        field += len;
+    }
+
+    String path(prefix);
+    AddValue(&path, *v, container);
+}
+
+void ValuePathIndexImpl::AddValue(String* path, const Value& v, int container)
+{
+    mEntries[*path] = { &v, container };
+
+    if (v.IsObject())
+    {
+        int objectContainer = AddContainer(v, container);
+        size_t pathSize = path->size();
+
+        for (ConstNameValue nv : v.AsObject())
+        {
+            if (pathSize > 0)
+                *path += '.';
+            *path += nv.name;
+
+            AddValue(path, nv.value, objectContainer);
+            path->resize(pathSize);
+        }
+    }
+    else if (v.IsArray())
+    {
+        int arrayContainer = AddContainer(v, container);
+        size_t pathSize = path->size();
+
+        for (int64_t i = 0, n = v.NumElts(); i < n; i++)
+        {
+            AppendFormat(path, "[%lld]", (long long) i);
+
+            AddValue(path, v.Elt(i), arrayContainer);
+            path->resize(pathSize);
+        }
+    }
+}
+
+bool ValuePathIndexImpl::IsUnchanged(const Container& c) const
+{
+    if (ContainerData(*c.slot) != c.data)
+        return false;
+
+    return !c.slot->IsObject() || c.slot->AsObject().ModCount() == c.modCount;
+}
+
+bool ValuePathIndexImpl::IsValid(int container) const
+{
+    // Check from the root down, as if an ancestor has changed, its descendants may no longer exist.
+    if (container < 0)
+        return true;
+
+    const Container& c = mContainers[container];
+
+    return IsValid(c.parent) && IsUnchanged(c);
+}
+
+bool ValuePathIndexImpl::IsStale() const
+{
+    // Containers are added parent first, so by the time we get to a container its ancestors have been checked.
+    for (const Container& c : mContainers)
+        if (!IsUnchanged(c))
+            return true;
+
+    return false;
+}
+
+bool ValuePathIndexImpl::IsIndexed(const char* path) const
+{
+    if (mPrefixes.empty())
+        return true;
+
+    for (const String& prefix : mPrefixes)
+    {
+        size_t len = prefix.size();
+
+        if (strncmp(path, prefix.c_str(), len) == 0 && (path[len] == 0 || path[len] == '.' || path[len] == '['))
+            return true;
+    }
+
+    return false;
+}
+
+void ValuePathIndex::AddPrefix(const char* prefix)
+{
+    ValuePathIndexImpl* self = static_cast<ValuePathIndexImpl*>(this);
+
+    self->mPrefixes.push_back(prefix);
+
+    if (self->mRoot)
+        Build(*self->mRoot);
+}
+
+void ValuePathIndex::Build(const Value& root)
+{
+    ValuePathIndexImpl* self = static_cast<ValuePathIndexImpl*>(this);
+
+    Clear();
+    self->mRoot = &root;
+
+    if (self->mPrefixes.empty())
+    {
+        String path;
+        self->AddValue(&path, root, -1);
+    }
+    else
+        for (const String& prefix : self->mPrefixes)
+            self->IndexPrefix(prefix.c_str());
+}
+
+void ValuePathIndex::Clear()
+{
+    ValuePathIndexImpl* self = static_cast<ValuePathIndexImpl*>(this);
+
+    self->mRoot = 0;
+    self->mContainers.clear();
+    self->mEntries.clear();
+}
+
+const Value* ValuePathIndex::Find(const char* path)
+{
+    ValuePathIndexImpl* self = static_cast<ValuePathIndexImpl*>(this);
+
+    if (!self->mRoot)
+        return 0;
+
+    // Edits made via UpdateMember() bump the mod count of every object on the way down, so if the root object
+    // hasn't changed, nothing below it has either.
+    if (self->mRoot->IsObject() && !self->mContainers.empty())
+    {
+        if (!self->IsUnchanged(self->mContainers[0]))
+            Build(*self->mRoot);
+
+        auto it = self->mEntries.find(path);
+
+        if (it != self->mEntries.end())
+            return it->second.value;
+
+        const Value& v = HL::MemberPath(*self->mRoot, path);
+        return &v != &kNullValue ? &v : 0;
+    }
+
+    auto it = self->mEntries.find(path);
+
+    if (it != self->mEntries.end())
+    {
+        if (self->IsValid(it->second.container))
+            return it->second.value;
+
+        // Part of the value has changed since we indexed it
+        Build(*self->mRoot);
+
+        it = self->mEntries.find(path);
+        return it != self->mEntries.end() ? it->second.value : 0;
+    }
+
+    // Not indexed, either because it's not covered, doesn't exist, or has been added since we
+    // indexed. Fall back to a walk, and re-index if it's the last case.
+    const Value& v = HL::MemberPath(*self->mRoot, path);
+
+    if (&v == &kNullValue)
+        return 0;
+
+    if (self->IsIndexed(path) && self->IsStale())
+        Build(*self->mRoot);
+
+    return &v;
+}
+
+const Value& ValuePathIndex::MemberPath(const char* path)
+{
+    const Value* v = Find(path);
+    return v ? *v : kNullValue;
+}
+
+size_t ValuePathIndex::NumEntries() const
+{
+    const ValuePathIndexImpl* self = static_cast<const ValuePathIndexImpl*>(this);
+    return self->mEntries.size();
+}
+
+size_t ValuePathIndex::MemoryUsed() const
+{
+    const ValuePathIndexImpl* self = static_cast<const ValuePathIndexImpl*>(this);
+
+    size_t result = sizeof(ValuePathIndexImpl);
+
+    result += self->mEntries.values().capacity() * sizeof(self->mEntries.values()[0]);
+    result += self->mEntries.bucket_count() * sizeof(decltype(self->mEntries)::bucket_type);
+
+    for (const auto& entry : self->mEntries.values())
+        result += StringMemory(entry.first);
+
+    result += self->mContainers.capacity() * sizeof(Container);
+
+    for (const String& prefix : self->mPrefixes)
+        result += sizeof(String) + StringMemory(prefix);
+
+    return result;
+}
+
+ValuePathIndex* HL::CreateValuePathIndex()
+{
+    return new ValuePathIndexImpl;
+}
@@ -0,0 +1,41 @@
+//
+// ValuePathIndex.hpp
+//
+// Flattened index from full value paths to values
+//
+
+#ifndef HL_VALUE_PATH_INDEX_H
+#define HL_VALUE_PATH_INDEX_H
+
+#include "Value.hpp"
+
+namespace HL
+{
+    struct ValuePathIndex : public RefCounted
+    // Maps full paths in MemberPath() form, e.g., "materials.default.albedo" or "passes[2].name", to values, so a
+    // lookup is a single hash probe rather than a search per path level.
+    // The index is checked against the root object's mod count, which UpdateMember() and friends bump on the way
+    // down to any edited value, so edits and reloads since Build() are picked up by re-indexing on the next lookup.
+    // Thus it's best to batch edits between lookups. Edits made via a Value& held from before Build() bypass the
+    // root, so call Build() again after those. (For non-object roots, each entry's containers are checked instead.)
+    {
+        void         AddPrefix(const char* prefix);  // Restrict the index to the value at 'prefix' and below, e.g., "materials". By default everything is indexed.
+        void         Build(const Value& root);       // Index 'root'. This must outlive the index, or be re-Built.
+        void         Clear();                        // Clear index, but not the prefixes
+
+        const Value* Find(const char* path);         // Returns the value at 'path', or 0 if there isn't one
+        const Value& MemberPath(const char* path);   // Equivalent to HL::MemberPath(root, path)
+
+        size_t       NumEntries() const;             // Number of indexed paths
+        size_t       MemoryUsed() const;             // Approximate heap memory used by the index
+
+    protected:
+        ValuePathIndex() {} // CreateValuePathIndex() please
+    };
+
+    typedef AutoRef<ValuePathIndex> ValuePathIndexRef;
+
+    ValuePathIndex* CreateValuePathIndex();  // Creates a new, empty, path index
+}
+
+#endif
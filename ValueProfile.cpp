@@ -0,0 +1,253 @@
+//
+// ValueProfile.cpp
+//
+// Per-value read counts, for finding hot and unused config keys
+//
+
+#include "ValueProfile.hpp"
+
+#include "external/unordered_dense.h" // requires 64-bit well-mixed hash
+
+#include <algorithm>
+#include <mutex>
+
+using namespace HL;
+
+namespace
+{
+    struct ValuePtrHash
+    {
+        uint64_t operator () (const Value* v) const
+        {
+            uint64_t h = uint64_t(uintptr_t(v)) * UINT64_C(0x9E3779B97F4A7C15);
+            return h ^ (h >> 29);
+        }
+    };
+
+    typedef ankerl::dense_hash_map<const Value*, uint64_t, ValuePtrHash> ReadCounts;
+
+    struct ThreadReadCounts;
+
+    struct ProfileRegistry
+    {
+        std::mutex                     mutex;
+        std::vector<ThreadReadCounts*> threads;  // Counts of each live thread
+        ReadCounts                     exited;   // Merged counts of threads that have finished
+    };
+
+    ProfileRegistry& Registry()
+    {
+        static ProfileRegistry registry;
+        return registry;
+    }
+
+    struct ThreadReadCounts
+    // Registers itself on a thread's first read, and hands its counts on when the thread exits. The owning thread
+    // takes 'mutex' for each count, which is uncontended unless another thread is gathering counts, so others can
+    // safely read or clear them while it runs. Lock order is the registry's mutex, then this.
+    {
+        std::mutex mutex;
+        ReadCounts counts;
+
+        ThreadReadCounts()
+        {
+            ProfileRegistry& registry = Registry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+
+            registry.threads.push_back(this);
+        }
+
+        ~ThreadReadCounts()
+        {
+            ProfileRegistry& registry = Registry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+
+            for (const auto& entry : counts)
+                registry.exited[entry.first] += entry.second;
+
+            registry.threads.erase(std::find(registry.threads.begin(), registry.threads.end(), this));
+        }
+    };
+
+    thread_local ThreadReadCounts tReadCounts;
+
+    void MergeCounts(ReadCounts* merged)
+    {
+        ProfileRegistry& registry = Registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+
+        *merged = registry.exited;
+
+        for (ThreadReadCounts* thread : registry.threads)
+        {
+            std::lock_guard<std::mutex> threadLock(thread->mutex);
+
+            for (const auto& entry : thread->counts)
+                (*merged)[entry.first] += entry.second;
+        }
+    }
+
+    struct ProfileNode
+    {
+        const Value* value;
+        int64_t      parent;    // Index of the containing node, or -1 for the root
+        int64_t      index;     // Member or element index within the parent
+        uint64_t     reads;
+        uint64_t     subtreeReads;
+    };
+
+    String NodePath(const std::vector<ProfileNode>& nodes, int64_t i)
+    {
+        std::vector<int64_t> chain;
+
+        for (; nodes[i].parent >= 0; i = nodes[i].parent)
+            chain.push_back(i);
+
+        String path;
+
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+        {
+            const ProfileNode& node   = nodes[*it];
+            const Value&       parent = *nodes[node.parent].value;
+
+            // Via the containers directly, as Value's own accessors would count these reads
+            if (parent.Type() == kValueObject)
+            {
+                if (!path.empty())
+                    path += '.';
+                path += parent.mValue.mObject->MemberName(int(node.index));
+            }
+            else
+                AppendFormat(&path, "[%lld]", (long long) node.index);
+        }
+
+        return path;
+    }
+}
+
+void HL::CountValueAccess(const Value* v)
+{
+    ThreadReadCounts& thread = tReadCounts;
+    std::lock_guard<std::mutex> lock(thread.mutex);
+
+    thread.counts[v]++;
+}
+
+uint64_t HL::ValueReadCount(const Value& v)
+{
+    ProfileRegistry& registry = Registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    uint64_t count = 0;
+
+    for (ThreadReadCounts* thread : registry.threads)
+    {
+        std::lock_guard<std::mutex> threadLock(thread->mutex);
+        auto it = thread->counts.find(&v);
+
+        if (it != thread->counts.end())
+            count += it->second;
+    }
+
+    auto it = registry.exited.find(&v);
+
+    if (it != registry.exited.end())
+        count += it->second;
+
+    return count;
+}
+
+void HL::ResetValueProfile()
+{
+    ProfileRegistry& registry = Registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    registry.exited.clear();
+
+    for (ThreadReadCounts* thread : registry.threads)
+    {
+        std::lock_guard<std::mutex> threadLock(thread->mutex);
+        thread->counts.clear();
+    }
+}
+
+void HL::GetValueProfile(const Value& root, ValueProfile* profile, size_t maxHot)
+{
+    ReadCounts counts;
+    MergeCounts(&counts);
+
+    // Gather the tree breadth first, so each node comes after its parent, and subtree totals can be summed in reverse
+    std::vector<ProfileNode> nodes = { { &root, -1, 0, 0, 0 } };
+
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        const Value* v = nodes[i].value;
+        auto it = counts.find(v);
+
+        nodes[i].reads = nodes[i].subtreeReads = it != counts.end() ? it->second : 0;
+
+        if (v->Type() == kValueObject)
+        {
+            const ObjectValue* object = v->mValue.mObject;
+
+            for (int j = 0, n = object->NumMembers(); j < n; j++)
+                nodes.push_back({ &object->MemberValue(j), int64_t(i), j, 0, 0 });
+        }
+        else if (v->Type() == kValueArray && v->mValue.mArray)
+        {
+            const ArrayValue* array = v->mValue.mArray;
+
+            for (int64_t j = 0, n = array->count; j < n; j++)
+                nodes.push_back({ &(*array)[j], int64_t(i), j, 0, 0 });
+        }
+    }
+
+    for (size_t i = nodes.size(); i-- > 1; )
+        nodes[nodes[i].parent].subtreeReads += nodes[i].subtreeReads;
+
+    profile->hot.clear();
+    profile->unused.clear();
+    profile->reads = nodes[0].subtreeReads;
+
+    std::vector<int64_t> hot;
+
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        if (nodes[i].reads > 0)
+            hot.push_back(int64_t(i));
+        else if (nodes[i].subtreeReads == 0 && (nodes[i].parent < 0 || nodes[nodes[i].parent].subtreeReads > 0))
+            profile->unused.push_back(NodePath(nodes, int64_t(i)));
+    }
+
+    auto busier = [&nodes](int64_t a, int64_t b)
+    {
+        return nodes[a].reads != nodes[b].reads ? nodes[a].reads > nodes[b].reads : a < b;
+    };
+
+    size_t numHot = std::min(maxHot, hot.size());
+    std::partial_sort(hot.begin(), hot.begin() + numHot, hot.end(), busier);
+
+    for (size_t i = 0; i < numHot; i++)
+        profile->hot.push_back({ NodePath(nodes, hot[i]), nodes[hot[i]].reads });
+}
+
+void HL::AppendReport(String* report, const ValueProfile& profile)
+{
+    if (profile.reads == 0)
+    {
+        *report += "No reads recorded -- is HL_VALUE_PROFILE defined?\n";
+        return;
+    }
+
+    AppendFormat(report, "Reads: %llu\n", (unsigned long long) profile.reads);
+
+    *report += "\nHottest:\n";
+
+    for (const auto& entry : profile.hot)
+        AppendFormat(report, "%12llu  %s\n", (unsigned long long) entry.second, entry.first.empty() ? "(root)" : entry.first.c_str());
+
+    AppendFormat(report, "\nUnused (%zu):\n", profile.unused.size());
+
+    for (const String& path : profile.unused)
+        AppendFormat(report, "    %s\n", path.empty() ? "(root)" : path.c_str());
+}
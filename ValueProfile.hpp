@@ -0,0 +1,41 @@
+//
+// ValueProfile.hpp
+//
+// Per-value read counts, for finding hot and unused config keys
+//
+
+#ifndef HL_VALUE_PROFILE_H
+#define HL_VALUE_PROFILE_H
+
+#include "Value.hpp"
+
+namespace HL
+{
+    // When HL_VALUE_PROFILE is defined, the read side of the Value API -- Member(), MemberPtr(), MemberValue(),
+    // operator[], Elt(), MemberPath(), and the AsXXX() conversions -- counts each read of the value concerned. Counts
+    // go into a table per thread, so readers don't contend with each other, and are only merged when asked for.
+    // Values are identified by address, so counts apply to a config that's no longer being modified. Reads that
+    // bypass the API, e.g., via mValue or ValueQuery, aren't seen, while the library's own reads, e.g., when saving,
+    // are, so call ResetValueProfile() once set up.
+
+    struct ValueProfile
+    {
+        std::vector<std::pair<String, uint64_t>> hot;        // Most read paths and their counts, busiest first
+        std::vector<String>                      unused;     // Paths of values never read, nor anything within them. Only the topmost of each such subtree is listed.
+        uint64_t                                 reads = 0;  // Total reads of values in the tree
+    };
+
+    void GetValueProfile(const Value& root, ValueProfile* profile, size_t maxHot = 20);
+    // Merges all threads' counts, and fills in 'profile' with the hottest and unused paths under 'root', in
+    // MemberPath() form. This is safe while other threads are reading values, e.g., in a running server, though
+    // their counts are gathered one thread at a time, so aren't a snapshot of a single instant.
+
+    void     AppendReport(String* report, const ValueProfile& profile);  // Appends a readable version of 'profile'
+
+    uint64_t ValueReadCount(const Value& v);  // Reads of 'v' so far, across all threads
+    void     ResetValueProfile();             // Clears all counts, e.g., after loading, so only the program's own reads are seen
+
+    void     CountValueAccess(const Value* v);  // Counts a read of 'v'. Called by Value itself when HL_VALUE_PROFILE is defined.
+}
+
+#endif
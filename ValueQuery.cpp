@@ -0,0 +1,396 @@
+//
+// ValueQuery.cpp
+//
+// Wildcard and filter queries over values
+//
+
+#include "ValueQuery.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace HL;
+
+namespace
+{
+    inline bool IsSpace(char c)
+    {
+        return c == ' ' || c == '\t';
+    }
+
+    String Trimmed(const char* s, const char* end)
+    {
+        while (s < end && IsSpace(s[0]))
+            s++;
+        while (end > s && IsSpace(end[-1]))
+            end--;
+
+        return String(s, end - s);
+    }
+
+    const char* FindFilterEnd(const char* s)
+    {
+        // Find closing ']', skipping over quoted literals and any [n] in the filter path
+        char quote = 0;
+        int depth = 0;
+
+        for (; *s; s++)
+        {
+            if (quote)
+            {
+                if (*s == quote)
+                    quote = 0;
+            }
+            else if (*s == '"' || *s == '\'')
+                quote = *s;
+            else if (*s == '[')
+                depth++;
+            else if (*s == ']' && depth-- == 0)
+                return s;
+        }
+
+        return nullptr;
+    }
+
+    Value ParseLiteral(const String& s)
+    {
+        if (s.size() >= 2 && (s[0] == '"' || s[0] == '\'') && s.back() == s[0])
+            return Value(s.substr(1, s.size() - 2).c_str());
+
+        if (s == "true")
+            return Value(true);
+        if (s == "false")
+            return Value(false);
+        if (s == "null")
+            return Value();
+
+        char* end = nullptr;
+        double d = strtod(s.c_str(), &end);
+
+        if (!s.empty() && *end == 0)
+            return Value(d);
+
+        return Value(s.c_str());
+    }
+}
+
+bool ValueQuery::Compile(const char* query, String* errors)
+{
+    mSteps.clear();
+    mValid = false;
+
+    const char* s = query;
+
+    auto error = [query, &s, errors](const char* message)
+    {
+        if (errors)
+            AppendFormat(errors, "Query error: %s at column %d of '%s'\n", message, int(s - query) + 1, query);
+
+        return false;
+    };
+
+    while (*s)
+    {
+        // Each step is .name, .*, [n], [*], or [?...], optionally preceded by .. for any depth. A leading '.' is optional.
+        bool bracket = false;
+
+        if (s[0] == '.' && s[1] == '.')
+        {
+            mSteps.push_back({ kStepDescend });
+            s += 2;
+            bracket = (s[0] == '[');
+        }
+        else if (s[0] == '.')
+            s++;
+        else if (s[0] == '[')
+            bracket = true;
+        else if (!mSteps.empty())
+            return error("expected '.' or '['");
+
+        if (bracket)
+        {
+            const char* start = s++;
+
+            if (s[0] == '*' && s[1] == ']')
+            {
+                mSteps.push_back({ kStepAny });
+                s += 2;
+            }
+            else if (s[0] == '?')
+            {
+                const char* end = FindFilterEnd(++s);
+
+                if (!end)
+                    return error("missing ']'");
+
+                Step step = { kStepFilter };
+
+                const char* opStart = strpbrk(s, "=!<>");
+
+                if (!opStart || opStart > end)
+                    step.key = Trimmed(s, end);
+                else
+                {
+                    const char* opEnd = opStart + 1;
+
+                    if (opEnd[0] == '=')
+                        opEnd++;
+
+                    String op(opStart, opEnd - opStart);
+
+                    if      (op == "==") step.op = kOpEqual;
+                    else if (op == "!=") step.op = kOpNotEqual;
+                    else if (op == "<" ) step.op = kOpLess;
+                    else if (op == "<=") step.op = kOpLessEqual;
+                    else if (op == ">" ) step.op = kOpGreater;
+                    else if (op == ">=") step.op = kOpGreaterEqual;
+                    else
+                    {
+                        s = opStart;
+                        return error("unknown operator");
+                    }
+
+                    step.key = Trimmed(s, opStart);
+                    step.literal = ParseLiteral(Trimmed(opEnd, end));
+                }
+
+                if (step.key == "@")
+                    step.key.clear();
+                else if (step.key.compare(0, 2, "@.") == 0)
+                    step.key.erase(0, 2);
+                else if (step.key.empty())
+                    return error("missing filter path");
+
+                mSteps.push_back(std::move(step));
+                s = end + 1;
+            }
+            else
+            {
+                char* end = nullptr;
+                long long index = strtoll(s, &end, 10);
+
+                if (end == s || *end != ']' || index < 0)
+                {
+                    s = start;
+                    return error("expected [n], [*], or [?...]");
+                }
+
+                Step step = { kStepIndex };
+                step.index = int64_t(index);
+
+                mSteps.push_back(std::move(step));
+                s = end + 1;
+            }
+        }
+        else
+        {
+            size_t len = PathKeyLength(s);
+
+            if (len == 0)
+                return error("expected member name");
+
+            if (len == 1 && s[0] == '*')
+                mSteps.push_back({ kStepAny });
+            else
+            {
+                Step step = { kStepMember };
+                step.key.assign(s, len);
+
+                mSteps.push_back(std::move(step));
+            }
+
+            s += len;
+        }
+    }
+
+    mValid = true;
+    return true;
+}
+
+int64_t ValueQuery::Count(const Value& root) const
+{
+    int64_t count = 0;
+
+    for (ValueQueryIterator it = Run(root).begin(), end; it != end; ++it)
+        count++;
+
+    return count;
+}
+
+const Value& ValueQuery::First(const Value& root) const
+{
+    ValueQueryIterator it = Run(root).begin();
+
+    if (it != ValueQueryIterator())
+        return (*it).value;
+
+    return kNullValue;
+}
+
+bool ValueQuery::Matches(const Step& step, const Value& v) const
+{
+    const Value& m = step.key.empty() ? v : MemberPath(v, step.key.c_str());
+
+    if (step.op == kOpExists)
+        return !m.IsNull();
+
+    const Value& literal = step.literal;
+    int cmp;
+
+    if (m.IsNumeric() && literal.IsNumeric())
+    {
+        double a = m.AsDouble();
+        double b = literal.AsDouble();
+
+        cmp = (a > b) - (a < b);
+    }
+    else if (m.IsString() && literal.IsString())
+        cmp = strcmp(m.AsString(), literal.AsString());
+    else if (m.IsNull() && literal.IsNull())
+        cmp = 0;
+    else
+        return step.op == kOpNotEqual;  // not comparable
+
+    switch (step.op)
+    {
+    case kOpEqual:          return cmp == 0;
+    case kOpNotEqual:       return cmp != 0;
+    case kOpLess:           return cmp <  0;
+    case kOpLessEqual:      return cmp <= 0;
+    case kOpGreater:        return cmp >  0;
+    case kOpGreaterEqual:   return cmp >= 0;
+    default:                return false;
+    }
+}
+
+ValueQueryIterator::ValueQueryIterator(const ValueQuery* query, const Value* root) :
+    mQuery(query)
+{
+    if (!query->IsValid())
+        return;
+
+    mFrames.push_back({ root, 0, 0, 0 });
+    Next();
+}
+
+void ValueQueryIterator::Next()
+{
+    int numSteps = size_i(mQuery->mSteps);
+
+    while (!mFrames.empty())
+    {
+        Frame& frame = mFrames.back();
+        mPath.resize(frame.pathSize);
+
+        if (frame.step == numSteps)
+        {
+            if (frame.cursor++ == 0)
+                return;     // this is our next result
+
+            mFrames.pop_back();
+            continue;
+        }
+
+        // A descend step first applies the following step to the value itself, and then continues into its children
+        int childStep = frame.step + 1;
+
+        if (mQuery->mSteps[frame.step].type == ValueQuery::kStepDescend && frame.cursor > 0)
+            childStep = frame.step;
+
+        const Value* child;
+
+        if (!NextChild(frame, &child))
+        {
+            mFrames.pop_back();
+            continue;
+        }
+
+        mFrames.push_back({ child, childStep, 0, mPath.size() });
+    }
+}
+
+bool ValueQueryIterator::ChildAt(const Value& v, int64_t i, const Value** child)
+{
+    if (v.Type() == kValueObject)
+    {
+        if (i >= v.NumMembers())
+            return false;
+
+        if (!mPath.empty())
+            mPath += '.';
+        mPath += v.MemberName(int(i));
+
+        *child = &v.MemberValue(int(i));
+        return true;
+    }
+
+    if (v.Type() == kValueArray)
+    {
+        if (i >= v.NumElts())
+            return false;
+
+        AppendFormat(&mPath, "[%lld]", (long long) i);
+
+        *child = &v.Elt(i);
+        return true;
+    }
+
+    return false;
+}
+
+bool ValueQueryIterator::NextChild(Frame& frame, const Value** child)
+{
+    const ValueQuery::Step& step = mQuery->mSteps[frame.step];
+    const Value& v = *frame.value;
+
+    switch (step.type)
+    {
+    case ValueQuery::kStepMember:
+        if (frame.cursor++ > 0)
+            return false;
+
+        *child = v.MemberPtr(step.key.c_str());
+
+        if (!*child)
+            return false;
+
+        if (!mPath.empty())
+            mPath += '.';
+        mPath += step.key;
+        return true;
+
+    case ValueQuery::kStepIndex:
+        if (frame.cursor++ > 0 || v.Type() != kValueArray || step.index >= v.NumElts())
+            return false;
+
+        AppendFormat(&mPath, "[%lld]", (long long) step.index);
+
+        *child = &v.Elt(step.index);
+        return true;
+
+    case ValueQuery::kStepAny:
+        return ChildAt(v, frame.cursor++, child);
+
+    case ValueQuery::kStepDescend:
+        if (frame.cursor++ == 0)
+        {
+            *child = &v;
+            return true;
+        }
+
+        return ChildAt(v, frame.cursor - 2, child);
+
+    case ValueQuery::kStepFilter:
+        while (ChildAt(v, frame.cursor++, child))
+        {
+            if (mQuery->Matches(step, **child))
+                return true;
+
+            mPath.resize(frame.pathSize);
+        }
+
+        return false;
+    }
+
+    return false;
+}
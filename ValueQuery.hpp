@@ -0,0 +1,141 @@
+//
+// ValueQuery.hpp
+//
+// Wildcard and filter queries over values
+//
+
+#ifndef HL_VALUE_QUERY_H
+#define HL_VALUE_QUERY_H
+
+#include "Value.hpp"
+
+namespace HL
+{
+    struct ValueQueryResult { const char* path; const Value& value; };  // 'path' is in MemberPath() form, and only valid until the next result
+    class ValueQueryIterator;
+    struct ValueQueryResults;
+
+    class ValueQuery
+    // Extends MemberPath() syntax with:
+    //   *                      any member or element, e.g., "materials.*.albedo", "pipelines.*.passes[*].fb"
+    //   [*]                    any element, same as .*
+    //   ..name                 'name' at any depth, e.g., "..albedo". Also ..* and ..[n]
+    //   [?path]                elements or members where 'path' (relative to them) exists, e.g., "spawns[?boss]"
+    //   [?path op literal]     ditto, where the value at 'path' compares against 'literal' via one of == != < <= > >=
+    //                          e.g., "spawns[?type == orc].name", "spawns[?count >= 3]", "lights[*].colour[?@ > 0.5]"
+    //                          '@' refers to the element itself. Literals are numbers, true/false/null, or strings,
+    //                          which can optionally be quoted.
+    // A query is compiled once, and can then be run any number of times. Running it walks the source value directly,
+    // producing results on demand, so nothing is copied.
+    {
+    public:
+        ValueQuery() = default;
+        ValueQuery(const char* query, String* errors = nullptr) { Compile(query, errors); }
+
+        bool Compile(const char* query, String* errors = nullptr);  // Returns false and appends to 'errors' if the query is malformed
+        bool IsValid() const;                                       // True if successfully compiled
+        bool IsSinglePath() const;                                  // True if the query is a plain MemberPath() path, with at most one result
+
+        ValueQueryResults Run(const Value& root) const;             // Returns range of (path, value) results, found depth first. 'root' and 'this' must outlive it.
+        int64_t           Count(const Value& root) const;           // Returns number of results
+        const Value&      First(const Value& root) const;           // Returns first result, or kNullValue if none
+
+    protected:
+        enum StepType : uint8_t
+        {
+            kStepMember,    // .name
+            kStepIndex,     // [n]
+            kStepAny,       // .* or [*]
+            kStepDescend,   // .., the following step is then applied at every depth
+            kStepFilter,    // [?...]
+        };
+
+        enum FilterOp : uint8_t
+        {
+            kOpExists,
+            kOpEqual,
+            kOpNotEqual,
+            kOpLess,
+            kOpLessEqual,
+            kOpGreater,
+            kOpGreaterEqual,
+        };
+
+        struct Step
+        {
+            StepType type;
+            FilterOp op    = kOpExists;
+            int64_t  index = 0;     // kStepIndex
+            String   key;           // kStepMember member name, or kStepFilter relative path, with "" meaning '@'
+            Value    literal;       // kStepFilter comparison value
+        };
+
+        std::vector<Step> mSteps;
+        bool              mValid = false;
+
+        bool Matches(const Step& step, const Value& v) const;
+
+        friend class ValueQueryIterator;
+    };
+
+    class ValueQueryIterator
+    {
+    public:
+        ValueQueryIterator() = default;
+        ValueQueryIterator(const ValueQuery* query, const Value* root);
+
+        bool operator != (const ValueQueryIterator& it) const { return !(mFrames.empty() && it.mFrames.empty()); }
+        void operator ++ ()                                     { Next(); }
+        ValueQueryResult operator * () const                    { return { mPath.c_str(), *mFrames.back().value }; }
+
+    protected:
+        struct Frame
+        {
+            const Value* value;
+            int          step;      // Step to apply to 'value', or the number of steps if 'value' is a result
+            int64_t      cursor;    // Next child of 'value' to consider
+            size_t       pathSize;  // Length of mPath for 'value'
+        };
+
+        const ValueQuery*  mQuery = nullptr;
+        std::vector<Frame> mFrames;     // Explicit stack for a depth-first walk
+        String             mPath;
+
+        void Next();
+        bool NextChild(Frame& frame, const Value** child);      // Returns next child of 'frame' to visit, and appends its path
+        bool ChildAt(const Value& v, int64_t i, const Value** child); // Returns i'th member or element of 'v', and appends its path
+    };
+
+    struct ValueQueryResults
+    {
+        const ValueQuery* mQuery;
+        const Value*      mRoot;
+
+        ValueQueryIterator begin() const { return ValueQueryIterator(mQuery, mRoot); }
+        ValueQueryIterator end()   const { return ValueQueryIterator(); }
+    };
+
+
+    // --- Inlines -------------------------------------------------------------
+
+    inline bool ValueQuery::IsValid() const
+    {
+        return mValid;
+    }
+
+    inline bool ValueQuery::IsSinglePath() const
+    {
+        for (const Step& step : mSteps)
+            if (step.type != kStepMember && step.type != kStepIndex)
+                return false;
+
+        return mValid;
+    }
+
+    inline ValueQueryResults ValueQuery::Run(const Value& root) const
+    {
+        return { this, &root };
+    }
+}
+
+#endif
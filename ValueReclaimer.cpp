@@ -0,0 +1,194 @@
+//
+// ValueReclaimer.cpp
+//
+// Deferred release of large values
+//
+
+#include "ValueReclaimer.hpp"
+
+#include <chrono>
+
+using namespace HL;
+
+namespace
+{
+    const int kReleaseChunk = 256;
+
+    inline bool IsContainer(const Value& v)
+    {
+        return (v.Type() == kValueArray && v.mValue.mArray) || v.Type() == kValueObject;
+    }
+}
+
+ValueReclaimer::~ValueReclaimer()
+{
+    StopThread();
+    mPending.clear();
+}
+
+void ValueReclaimer::Defer(Value* v)
+{
+    if (!IsContainer(*v))
+    {
+        v->MakeNull();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mPending.push_back({ std::move(*v) });
+    }
+
+    mWake.notify_one();
+}
+
+size_t ValueReclaimer::Reclaim(double maxSeconds)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<Pending> released;
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    while (!mPending.empty())
+    {
+        Pending p(std::move(mPending.back()));
+        mPending.pop_back();
+
+        // The lock is only held to update mPending, so Defer() and other threads' Reclaim() aren't held up
+        lock.unlock();
+        ReleaseOne(&p, &released);
+        lock.lock();
+
+        for (Pending& r : released)
+            mPending.push_back(std::move(r));
+
+        released.clear();
+
+        if (std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() >= maxSeconds)
+            break;
+    }
+
+    return mPending.size();
+}
+
+size_t ValueReclaimer::NumPending() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mPending.size();
+}
+
+void ValueReclaimer::StartThread()
+{
+    if (mThread.joinable())
+        return;
+
+    mStop = false;
+
+    mThread = std::thread(
+        [this]()
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+
+            while (true)
+            {
+                mWake.wait(lock, [this]() { return mStop || !mPending.empty(); });
+
+                if (mStop)
+                    break;
+
+                Value v(std::move(mPending.back().value));
+                mPending.pop_back();
+
+                lock.unlock();
+                v.MakeNull();  // releases iteratively, so depth isn't an issue
+                lock.lock();
+            }
+        }
+    );
+}
+
+void ValueReclaimer::StopThread()
+{
+    if (!mThread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop = true;
+    }
+
+    mWake.notify_one();
+    mThread.join();
+}
+
+void ValueReclaimer::ReleaseOne(Pending* p, std::vector<Pending>* pending)
+{
+    Value* v = &p->value;
+
+    // If this is the last reference, move the child containers to the pending list, so releasing 'v' only has to
+    // deal with its immediate contents. Otherwise releasing it just drops a reference.
+    if (v->Type() == kValueArray && v->mValue.mArray && v->mValue.mArray->RefCount() == 1 && v->mValue.mArray->IsSlice())
+    {
+        // The slice has no elements of its own, but may hold the last reference to its source, so queue that instead
+        Value source(const_cast<ArrayValue*>(v->mValue.mArray->SliceSource()));
+        v->MakeNull();
+        pending->push_back({ std::move(source) });
+        return;
+    }
+    else if (v->Type() == kValueArray && v->mValue.mArray && v->mValue.mArray->RefCount() == 1)
+    {
+        // Large arrays are trimmed from the end a chunk at a time, to keep each step short. The remainder goes
+        // below the chunk's children, so they're released first, and the pending list stays small.
+        ArrayValue* array = v->mValue.mArray;
+        int64_t first = array->count > kReleaseChunk ? array->count - kReleaseChunk : 0;
+        size_t remainderSlot = pending->size();
+        Value* elts = array->Elts();
+
+        for (int64_t i = first; i < array->count; i++)
+        {
+            if (IsContainer(elts[i]))
+                pending->push_back({ std::move(elts[i]) });
+
+            elts[i].~Value();
+        }
+
+        array->count = first;
+
+        if (first > 0)
+        {
+            pending->insert(pending->begin() + remainderSlot, std::move(*p));
+            return;
+        }
+    }
+    else if (v->Type() == kValueObject && v->mValue.mObject->RefCount() == 1)
+    {
+        // Objects are likewise released a chunk of members at a time. Members can't be removed from a shaped object,
+        // whose keys belong to the shape, so each chunk is nulled in place, and the number left tracked alongside.
+        ObjectValue* object = v->mValue.mObject;
+        int end = p->members >= 0 ? p->members : object->NumMembers();
+        int first = end > kReleaseChunk ? end - kReleaseChunk : 0;
+        size_t remainderSlot = pending->size();
+
+        for (int i = first; i < end; i++)
+        {
+            Value& member = object->MemberValue(i);
+
+            if (IsContainer(member))
+                pending->push_back({ std::move(member) });
+            else
+                member.MakeNull();
+        }
+
+        if (!object->mShape)
+            object->mMap.erase(object->mMap.begin() + first, object->mMap.end());
+
+        if (first > 0)
+        {
+            p->members = first;
+            pending->insert(pending->begin() + remainderSlot, std::move(*p));
+            return;
+        }
+    }
+
+    v->MakeNull();
+}
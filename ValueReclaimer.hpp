@@ -0,0 +1,51 @@
+//
+// ValueReclaimer.hpp
+//
+// Deferred release of large values
+//
+
+#ifndef HL_VALUE_RECLAIMER_H
+#define HL_VALUE_RECLAIMER_H
+
+#include "Value.hpp"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace HL
+{
+    class ValueReclaimer
+    // Takes values off the caller's hands so that releasing a large tree, e.g., the old config after a hot reload,
+    // doesn't cause a hitch. Either call Reclaim() regularly with a time budget, or StartThread() to release them in
+    // the background. Only the last reference to a container does any real work; shared parts are just unreferenced.
+    {
+    public:
+        ValueReclaimer() = default;
+        ~ValueReclaimer();                  // Stops any thread, and releases everything outstanding
+
+        void   Defer(Value* v);             // Takes over v's contents, leaving it null
+        size_t Reclaim(double maxSeconds);  // Release deferred values for up to 'maxSeconds'. Returns the number of containers still outstanding.
+        size_t NumPending() const;          // Number of containers waiting to be released
+
+        void   StartThread();               // Release deferred values on a background thread as they arrive
+        void   StopThread();                // Stop background thread, leaving anything outstanding for Reclaim()
+
+    protected:
+        struct Pending
+        {
+            Value value;
+            int   members = -1;             // For an object being released in chunks, the number of members still to go
+        };
+
+        void   ReleaseOne(Pending* p, std::vector<Pending>* pending);  // Releases p->value, or a chunk of it, adding its children to 'pending' if it's the last reference, and then anything left of it
+
+        mutable std::mutex      mMutex;
+        std::condition_variable mWake;
+        std::vector<Pending>    mPending;   // Containers still to release
+        std::thread             mThread;
+        bool                    mStop = false;
+    };
+}
+
+#endif
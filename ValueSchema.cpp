@@ -0,0 +1,1064 @@
+//
+// ValueSchema.cpp
+//
+// Validation of values against a schema
+//
+
+#include "ValueSchema.hpp"
+
+#include "ValueJson.hpp"
+#include "vector_set.hpp"
+
+#include <algorithm>
+#include <ctype.h>
+#include <stdarg.h>
+
+using namespace HL;
+
+namespace
+{
+    const uint32_t kNumericTypes = (1u << kValueInt) | (1u << kValueUInt) | (1u << kValueInt64) | (1u << kValueUInt64) | (1u << kValueDouble);
+
+    struct TypeAlias
+    {
+        const char* name;
+        uint32_t    types;
+    };
+
+    const TypeAlias kTypeAliases[] =
+    {
+        { "any",     ~0u },
+        { "float",   1u << kValueDouble },
+        { "number",  1u << kValueDouble },
+        { "boolean", 1u << kValueBool },
+        { "integer", (1u << kValueInt64) | (1u << kValueUInt64) },
+    };
+
+    bool AddType(const char* name, uint32_t* types)
+    {
+        for (int t = kValueNull; t <= kValueObject; t++)
+            if (strcmp(name, TypeName(ValueType(t))) == 0)
+            {
+                *types |= 1u << t;
+                return true;
+            }
+
+        for (const TypeAlias& alias : kTypeAliases)
+            if (strcmp(name, alias.name) == 0)
+            {
+                *types |= alias.types;
+                return true;
+            }
+
+        return false;
+    }
+
+    String TypeNames(uint32_t types)
+    {
+        String names;
+
+        for (int t = kValueNull; t <= kValueObject; t++)
+            if (types & (1u << t))
+            {
+                if (!names.empty())
+                    names += " or ";
+                names += TypeName(ValueType(t));
+            }
+
+        return names;
+    }
+
+    void AddError(bool* ok, String* errors, const String& path, const char* format, ...)
+    {
+        *ok = false;
+
+        if (!errors)
+            return;
+
+        AppendFormat(errors, "%s: ", path.empty() ? "root" : path.c_str());
+
+        va_list args;
+        va_start(args, format);
+        AppendVFormat(errors, format, args);
+        va_end(args);
+
+        *errors += '\n';
+    }
+
+    inline bool LessName(const char* a, const char* b)
+    {
+        return strcmp(a, b) < 0;
+    }
+}
+
+bool ValueSchema::Compile(const Value& schema, String* errors)
+{
+    mNodes.clear();
+    mRoot  = kNodeAny;
+    mValid = false;
+
+    struct PendingNode
+    {
+        const Value* schema;
+        int          node;
+        String       path;
+    };
+
+    std::vector<PendingNode> pending;
+    bool ok = true;
+
+    auto AddNode = [this, &pending, &ok, errors](const Value& s, const String& path) -> int
+    {
+        if (s.Type() == kValueBool)
+            return s.AsBool() ? kNodeAny : kNodeNone;
+
+        if (s.Type() != kValueObject)
+        {
+            AddError(&ok, errors, path, "schema error: expected an object or bool, got %s", TypeName(s.Type()));
+            return kNodeAny;
+        }
+
+        if (s.NumMembers() == 0)
+            return kNodeAny;
+
+        mNodes.emplace_back();
+        pending.push_back({ &s, int(mNodes.size() - 1), path });
+
+        return int(mNodes.size() - 1);
+    };
+
+    mRoot = AddNode(schema, String());
+
+    while (!pending.empty())
+    {
+        PendingNode p = std::move(pending.back());
+        pending.pop_back();
+
+        Node node;
+        std::vector<const char*> required;
+
+        auto SizeLimit = [&](const char* keyword, const Value& v) -> uint64_t
+        {
+            if (!v.IsNumeric() || v.IsBool() || v.AsDouble() < 0.0)
+                AddError(&ok, errors, p.path, "schema error: '%s' must be a non-negative number", keyword);
+
+            return v.AsUInt64();
+        };
+
+        for (int i = 0, n = p.schema->NumMembers(); i < n; i++)
+        {
+            const char*  keyword = p.schema->MemberName(i);
+            const Value& v       = p.schema->MemberValue(i);
+
+            if (strcmp(keyword, "type") == 0)
+            {
+                node.types = 0;
+
+                if (v.IsString())
+                {
+                    if (!AddType(v.AsString(), &node.types))
+                        AddError(&ok, errors, p.path, "schema error: unknown type '%s'", v.AsString());
+                }
+                else if (v.IsArray())
+                {
+                    for (int64_t j = 0, nj = v.NumElts(); j < nj; j++)
+                        if (!AddType(v.Elt(j).AsString(), &node.types))
+                            AddError(&ok, errors, p.path, "schema error: unknown type '%s'", v.Elt(j).AsString());
+                }
+                else
+                    AddError(&ok, errors, p.path, "schema error: 'type' must be a string or array of strings");
+            }
+            else if (strcmp(keyword, "minimum") == 0 || strcmp(keyword, "maximum") == 0)
+            {
+                if (!v.IsNumeric() || v.IsBool())
+                    AddError(&ok, errors, p.path, "schema error: '%s' must be a number", keyword);
+
+                (keyword[1] == 'i' ? node.minimum : node.maximum) = v.AsDouble();
+            }
+            else if (strcmp(keyword, "minLength") == 0)
+                node.minLength = SizeLimit(keyword, v);
+            else if (strcmp(keyword, "maxLength") == 0)
+                node.maxLength = SizeLimit(keyword, v);
+            else if (strcmp(keyword, "minItems") == 0)
+                node.minItems = SizeLimit(keyword, v);
+            else if (strcmp(keyword, "maxItems") == 0)
+                node.maxItems = SizeLimit(keyword, v);
+            else if (strcmp(keyword, "enum") == 0)
+            {
+                if (v.IsArray())
+                    node.enumValues = v;
+                else
+                    AddError(&ok, errors, p.path, "schema error: 'enum' must be an array");
+            }
+            else if (strcmp(keyword, "items") == 0)
+                node.items = AddNode(v, p.path + "[*]");
+            else if (strcmp(keyword, "additionalProperties") == 0)
+                node.additional = AddNode(v, p.path + ".*");
+            else if (strcmp(keyword, "properties") == 0)
+            {
+                if (!v.IsObject())
+                    AddError(&ok, errors, p.path, "schema error: 'properties' must be an object");
+
+                // Already sorted, as Value keeps members sorted
+                for (int j = 0, nj = v.NumMembers(); j < nj; j++)
+                {
+                    String path(p.path);
+
+                    if (!path.empty())
+                        path += '.';
+                    path += v.MemberName(j);
+
+                    node.members.push_back({ v.MemberName(j), AddNode(v.MemberValue(j), path), false });
+                }
+            }
+            else if (strcmp(keyword, "required") == 0)
+            {
+                if (!v.IsArray())
+                    AddError(&ok, errors, p.path, "schema error: 'required' must be an array of strings");
+
+                for (int64_t j = 0, nj = v.NumElts(); j < nj; j++)
+                    required.push_back(v.Elt(j).AsString());
+            }
+            else if (strcmp(keyword, "default") == 0)
+                node.defaultValue = v;
+            else if (strcmp(keyword, "title") == 0)
+                node.title = v.AsString();
+            else if (strcmp(keyword, "description") != 0 && strcmp(keyword, "$schema") != 0 && strcmp(keyword, "$comment") != 0)
+                AddError(&ok, errors, p.path, "schema error: unknown keyword '%s'", keyword);
+        }
+
+        // Fold required names into the sorted members, adding any without a schema of their own
+        for (const char* name : required)
+        {
+            auto it = std::lower_bound(node.members.begin(), node.members.end(), name,
+                [](const Member& m, const char* key) { return LessName(m.name.c_str(), key); });
+
+            if (it != node.members.end() && it->name == name)
+                it->required = true;
+            else
+                node.members.insert(it, { name, kNodeAny, true });
+        }
+
+        mNodes[p.node] = std::move(node);
+    }
+
+    mValid = ok;
+
+    if (!ok)
+        mNodes.clear();
+
+    return ok;
+}
+
+bool ValueSchema::Validate(const Value& v, String* errors) const
+{
+    if (!mValid)
+    {
+        HL_ERROR("Schema hasn't been compiled");
+        return false;
+    }
+
+    // Depth first via an explicit stack, as per DiffValues(), so errors are reported in member order
+    struct ValidateFrame
+    {
+        const Value* v;
+        int          node;
+        size_t       pathSize;  // Length of parent's path
+        const char*  name;      // Member name, or 0 for an element
+        int64_t      index;     // Element index, or -1 for the root
+    };
+
+    std::vector<ValidateFrame> stack;
+    String path;
+    bool ok = true;
+
+    if (mRoot != kNodeAny)
+        stack.push_back({ &v, mRoot, 0, nullptr, -1 });
+
+    while (!stack.empty())
+    {
+        ValidateFrame frame = stack.back();
+        stack.pop_back();
+
+        path.resize(frame.pathSize);
+
+        if (frame.name)
+        {
+            if (!path.empty())
+                path += '.';
+            path += frame.name;
+        }
+        else if (frame.index >= 0)
+            AppendFormat(&path, "[%lld]", (long long) frame.index);
+
+        if (frame.node == kNodeNone)
+        {
+            AddError(&ok, errors, path, frame.name ? "unexpected member" : "not allowed");
+            continue;
+        }
+
+        const Node&  node = mNodes[frame.node];
+        const Value& value = *frame.v;
+
+        if (!MatchesType(node, value))
+        {
+            AddError(&ok, errors, path, "expected %s, got %s", TypeNames(node.types).c_str(), TypeName(value.Type()));
+            continue;
+        }
+
+        if (!node.enumValues.IsNull())
+        {
+            bool found = false;
+
+            for (int64_t i = 0, n = node.enumValues.NumElts(); i < n && !found; i++)
+                found = node.enumValues.Elt(i) == value;
+
+            if (!found)
+                AddError(&ok, errors, path, "%s is not one of the allowed values", AsJson(value).c_str());
+        }
+
+        size_t first = stack.size();
+
+        switch (value.Type())
+        {
+        case kValueInt:
+        case kValueUInt:
+        case kValueInt64:
+        case kValueUInt64:
+        case kValueDouble:
+        {
+            double d = value.AsDouble();
+
+            if (d < node.minimum)
+                AddError(&ok, errors, path, "%g is less than the minimum of %g", d, node.minimum);
+            if (d > node.maximum)
+                AddError(&ok, errors, path, "%g is greater than the maximum of %g", d, node.maximum);
+            break;
+        }
+
+        case kValueString:
+        {
+            uint64_t length = strlen(value.AsString());
+
+            if (length < node.minLength)
+                AddError(&ok, errors, path, "length %llu is less than minLength %llu", (unsigned long long) length, (unsigned long long) node.minLength);
+            if (length > node.maxLength)
+                AddError(&ok, errors, path, "length %llu is greater than maxLength %llu", (unsigned long long) length, (unsigned long long) node.maxLength);
+            break;
+        }
+
+        case kValueArray:
+        {
+            uint64_t count = value.NumElts();
+
+            if (count < node.minItems)
+                AddError(&ok, errors, path, "%llu elements is fewer than minItems %llu", (unsigned long long) count, (unsigned long long) node.minItems);
+            if (count > node.maxItems)
+                AddError(&ok, errors, path, "%llu elements is more than maxItems %llu", (unsigned long long) count, (unsigned long long) node.maxItems);
+
+            if (node.items != kNodeAny)
+                for (int64_t i = 0, n = value.NumElts(); i < n; i++)
+                    stack.push_back({ &value.Elt(i), node.items, path.size(), nullptr, i });
+            break;
+        }
+
+        case kValueObject:
+        {
+            // Both value members and expected members are sorted, so walk them in step
+            const ObjectValue& object = *value.mValue.mObject;
+            const std::vector<Member>& members = node.members;
+            int ia = 0, na = object.NumMembers();
+            int ib = 0, nb = int(members.size());
+
+            while (ia < na || ib < nb)
+            {
+                int c = ia == na ? 1 : ib == nb ? -1 : strcmp(object.MemberName(ia), members[ib].name.c_str());
+
+                if (c < 0)
+                {
+                    if (node.additional != kNodeAny)
+                        stack.push_back({ &object.MemberValue(ia), node.additional, path.size(), object.MemberName(ia), 0 });
+                    ia++;
+                }
+                else if (c > 0)
+                {
+                    if (members[ib].required)
+                    {
+                        String memberPath(path);
+
+                        if (!memberPath.empty())
+                            memberPath += '.';
+                        memberPath += members[ib].name;
+
+                        AddError(&ok, errors, memberPath, "required member is missing");
+                    }
+                    ib++;
+                }
+                else
+                {
+                    if (members[ib].node != kNodeAny)
+                        stack.push_back({ &object.MemberValue(ia), members[ib].node, path.size(), object.MemberName(ia), 0 });
+                    ia++;
+                    ib++;
+                }
+            }
+            break;
+        }
+
+        default:
+            break;
+        }
+
+        // Children were pushed in order, so reverse them to pop them in order
+        std::reverse(stack.begin() + first, stack.end());
+    }
+
+    return ok;
+}
+
+bool ValueSchema::MatchesType(const Node& node, const Value& v) const
+{
+    ValueType type = v.Type();
+
+    if (node.types & (1u << type))
+        return true;
+
+    // Numbers match any numeric type they convert to without loss
+    if ((1u << type) & kNumericTypes)
+        for (int t = kValueInt; t <= kValueDouble; t++)
+            if ((node.types & (1u << t)) && v.IsConvertibleTo(ValueType(t)))
+                return true;
+
+    return false;
+}
+
+
+// --- Struct generation -------------------------------------------------------
+
+namespace
+{
+    const char* const kCppKeywords[] =
+    {
+        "alignas", "alignof", "and", "asm", "auto", "bool", "break", "case", "catch", "char", "class", "const",
+        "constexpr", "continue", "decltype", "default", "delete", "do", "double", "else", "enum", "explicit", "export",
+        "extern", "false", "float", "for", "friend", "goto", "if", "inline", "int", "long", "mutable", "namespace",
+        "new", "noexcept", "not", "nullptr", "operator", "or", "private", "protected", "public", "register", "return",
+        "short", "signed", "sizeof", "static", "struct", "switch", "template", "this", "throw", "true", "try",
+        "typedef", "typeid", "typename", "union", "unsigned", "using", "virtual", "void", "volatile", "while", "xor",
+    };
+
+    String Identifier(const char* name)
+    // Returns 'name' as a valid C++ identifier
+    {
+        String id;
+
+        if (!isalpha(uint8_t(name[0])) && name[0] != '_')
+            id += '_';
+
+        for (const char* s = name; *s; s++)
+            id += isalnum(uint8_t(*s)) ? *s : '_';
+
+        for (const char* keyword : kCppKeywords)
+            if (id == keyword)
+                id += '_';
+
+        return id;
+    }
+
+    String CamelCase(const char* name)
+    // e.g., "depth_test" -> "DepthTest"
+    {
+        String result;
+        bool upper = true;
+
+        for (const char* s = name; *s; s++)
+        {
+            if (!isalnum(uint8_t(*s)))
+                upper = true;
+            else
+            {
+                result += upper ? char(toupper(uint8_t(*s))) : *s;
+                upper = false;
+            }
+        }
+
+        return result;
+    }
+
+    String CppString(const char* s)
+    // Returns 's' as a C++ string literal
+    {
+        String result("\"");
+
+        for (; *s; s++)
+        {
+            if (*s == '"' || *s == '\\')
+            {
+                result += '\\';
+                result += *s;
+            }
+            else if (uint8_t(*s) >= 32 && uint8_t(*s) < 127)
+                result += *s;
+            else
+                AppendFormat(&result, "\\%03o", uint8_t(*s));
+        }
+
+        return result + "\"";
+    }
+
+    inline String Indent(int indent)
+    {
+        return String(indent, ' ');
+    }
+}
+
+struct ValueSchema::StructGenerator
+{
+    enum FieldKind
+    {
+        kFieldValue,    // anything else is kept as a Value
+        kFieldBool,
+        kFieldInt,
+        kFieldUInt,
+        kFieldInt64,
+        kFieldUInt64,
+        kFieldDouble,
+        kFieldString,
+        kFieldArray,    // std::vector of 'items'
+        kFieldMap,      // vector_map of name -> 'additionalProperties'
+        kFieldStruct,   // struct of 'properties'
+    };
+
+    const ValueSchema&  mSchema;
+    String*             mText;
+    std::vector<String> mStructNames;   // Per node, or empty if not a struct
+    std::vector<int>    mStructs;       // Struct nodes, in the order they're to be written
+
+    StructGenerator(const ValueSchema& schema, String* text) :
+        mSchema(schema),
+        mText(text),
+        mStructNames(schema.mNodes.size())
+    {
+    }
+
+    FieldKind Kind(int node) const
+    {
+        if (node < 0)
+            return kFieldValue;
+
+        const Node& n = mSchema.mNodes[node];
+
+        if (n.types == ~0u)
+        {
+            if (!n.members.empty())
+                return kFieldStruct;
+            if (n.items != kNodeAny)
+                return kFieldArray;
+            if (n.additional >= 0)
+                return kFieldMap;
+
+            return kFieldValue;
+        }
+
+        switch (n.types & ~(1u << kValueNull))
+        {
+        case 1u << kValueBool:
+            return kFieldBool;
+        case 1u << kValueInt:
+            return kFieldInt;
+        case 1u << kValueUInt:
+            return kFieldUInt;
+        case 1u << kValueInt64:
+        case (1u << kValueInt64) | (1u << kValueUInt64):
+            return kFieldInt64;
+        case 1u << kValueUInt64:
+            return kFieldUInt64;
+        case 1u << kValueDouble:
+            return kFieldDouble;
+        case 1u << kValueString:
+            return kFieldString;
+        case 1u << kValueArray:
+            return kFieldArray;
+        case 1u << kValueObject:
+            if (!n.members.empty())
+                return kFieldStruct;
+            if (n.additional >= 0)
+                return kFieldMap;
+            return kFieldValue;
+        default:
+            return kFieldValue;
+        }
+    }
+
+    String CppType(int node) const
+    {
+        switch (Kind(node))
+        {
+        case kFieldBool:
+            return "bool";
+        case kFieldInt:
+            return "int32_t";
+        case kFieldUInt:
+            return "uint32_t";
+        case kFieldInt64:
+            return "int64_t";
+        case kFieldUInt64:
+            return "uint64_t";
+        case kFieldDouble:
+            return "double";
+        case kFieldString:
+            return "HL::String";
+        case kFieldArray:
+            return "std::vector<" + CppType(mSchema.mNodes[node].items) + ">";
+        case kFieldMap:
+            return "HL::vector_map<HL::String, " + CppType(mSchema.mNodes[node].additional) + ">";
+        case kFieldStruct:
+            return mStructNames[node];
+        default:
+            return "HL::Value";
+        }
+    }
+
+    String Initialiser(int node) const
+    // Returns " = <default>" for scalar fields
+    {
+        FieldKind kind = Kind(node);
+
+        if (kind < kFieldBool || kind > kFieldString)
+            return String();
+
+        const Value& v = mSchema.mNodes[node].defaultValue;
+        String result(" = ");
+
+        switch (kind)
+        {
+        case kFieldBool:
+            result += v.AsBool() ? "true" : "false";
+            break;
+        case kFieldInt:
+        case kFieldInt64:
+            AppendFormat(&result, "%lld", (long long) v.AsInt64());
+            break;
+        case kFieldUInt:
+        case kFieldUInt64:
+            AppendFormat(&result, "%llu", (unsigned long long) v.AsUInt64());
+            if (v.AsUInt64() > UINT32_MAX)
+                result += 'u';
+            break;
+        case kFieldDouble:
+            AppendFormat(&result, "%.17g", v.AsDouble());
+            if (!strpbrk(result.c_str() + 3, ".en"))
+                result += ".0";
+            break;
+        case kFieldString:
+            if (!v.IsString())
+                return String();
+            result += CppString(v.AsString());
+            break;
+        default:
+            break;
+        }
+
+        return result;
+    }
+
+    bool AssignNames(int root, const char* name)
+    {
+        // Breadth first, so reversing gives an order where each struct follows those it uses
+        struct NameFrame
+        {
+            int    node;
+            String name;
+        };
+
+        std::vector<NameFrame> frames = { { root, name } };
+        vector_set<String> used;
+
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            int node = frames[i].node;
+            String structName = frames[i].name;
+
+            switch (Kind(node))
+            {
+            case kFieldArray:
+                frames.push_back({ mSchema.mNodes[node].items, structName });
+                break;
+
+            case kFieldMap:
+                frames.push_back({ mSchema.mNodes[node].additional, structName });
+                break;
+
+            case kFieldStruct:
+            {
+                if (!mSchema.mNodes[node].title.empty())
+                    structName = Identifier(mSchema.mNodes[node].title.c_str());
+
+                String baseName = structName;
+
+                for (int suffix = 2; used.find(structName) != used.end(); suffix++)
+                    Format(&structName, "%s%d", baseName.c_str(), suffix);
+
+                used.insert(structName);
+                mStructNames[node] = structName;
+                mStructs.push_back(node);
+
+                for (const Member& member : mSchema.mNodes[node].members)
+                    frames.push_back({ member.node, structName + CamelCase(member.name.c_str()) });
+                break;
+            }
+
+            default:
+                break;
+            }
+        }
+
+        std::reverse(mStructs.begin(), mStructs.end());
+
+        return !mStructs.empty() && mStructs.back() == root;
+    }
+
+    void Load(int node, const String& src, const String& dst, int indent, int depth)
+    // Writes code to convert Value 'src' into field 'dst', setting 'result' to false on failure
+    {
+        String in  = Indent(indent);
+        String i   = "i" + std::to_string(depth);
+        String n   = "n" + std::to_string(depth);
+        String e   = "e" + std::to_string(depth);
+        String f   = "f" + std::to_string(depth);
+
+        const char* check = nullptr;
+        const char* as    = nullptr;
+
+        switch (Kind(node))
+        {
+        case kFieldValue:
+            AppendFormat(mText, "%s%s = %s;\n", in.c_str(), dst.c_str(), src.c_str());
+            return;
+        case kFieldBool:
+            check = "IsIntegral()";                       as = "AsBool()";
+            break;
+        case kFieldInt:
+            check = "IsConvertibleTo(HL::kValueInt)";     as = "AsInt()";
+            break;
+        case kFieldUInt:
+            check = "IsConvertibleTo(HL::kValueUInt)";    as = "AsUInt()";
+            break;
+        case kFieldInt64:
+            check = "IsConvertibleTo(HL::kValueInt64)";   as = "AsInt64()";
+            break;
+        case kFieldUInt64:
+            check = "IsConvertibleTo(HL::kValueUInt64)";  as = "AsUInt64()";
+            break;
+        case kFieldDouble:
+            check = "IsNumeric()";                        as = "AsDouble()";
+            break;
+        case kFieldString:
+            check = "IsString()";                         as = "AsString()";
+            break;
+
+        case kFieldStruct:
+            AppendFormat(mText, "%sif (!SetFromValue(%s, &%s))\n%s    result = false;\n", in.c_str(), src.c_str(), dst.c_str(), in.c_str());
+            return;
+
+        case kFieldArray:
+            AppendFormat(mText,
+                "%sif (%s.Type() == HL::kValueArray)\n"
+                "%s{\n"
+                "%s    %s.resize(%s.NumElts());\n"
+                "\n"
+                "%s    for (int64_t %s = 0, %s = %s.NumElts(); %s < %s; %s++)\n"
+                "%s    {\n"
+                "%s        const HL::Value& %s = %s.Elt(%s);\n",
+                in.c_str(), src.c_str(),
+                in.c_str(),
+                in.c_str(), dst.c_str(), src.c_str(),
+                in.c_str(), i.c_str(), n.c_str(), src.c_str(), i.c_str(), n.c_str(), i.c_str(),
+                in.c_str(),
+                in.c_str(), e.c_str(), src.c_str(), i.c_str()
+            );
+
+            Load(mSchema.mNodes[node].items, e, dst + "[" + i + "]", indent + 8, depth + 1);
+
+            AppendFormat(mText, "%s    }\n%s}\n%selse\n%s    result = false;\n", in.c_str(), in.c_str(), in.c_str(), in.c_str());
+            return;
+
+        case kFieldMap:
+            AppendFormat(mText,
+                "%sif (%s.Type() == HL::kValueObject)\n"
+                "%s{\n"
+                "%s    %s.clear();\n"
+                "%s    %s.reserve(%s.NumMembers());\n"
+                "\n"
+                "%s    for (int %s = 0, %s = %s.NumMembers(); %s < %s; %s++)\n"
+                "%s    {\n"
+                "%s        const HL::Value& %s = %s.MemberValue(%s);\n"
+                "%s        auto& %s = %s.emplace_back();\n"
+                "%s        %s.first = %s.MemberName(%s);\n",
+                in.c_str(), src.c_str(),
+                in.c_str(),
+                in.c_str(), dst.c_str(),
+                in.c_str(), dst.c_str(), src.c_str(),
+                in.c_str(), i.c_str(), n.c_str(), src.c_str(), i.c_str(), n.c_str(), i.c_str(),
+                in.c_str(),
+                in.c_str(), e.c_str(), src.c_str(), i.c_str(),
+                in.c_str(), f.c_str(), dst.c_str(),
+                in.c_str(), f.c_str(), src.c_str(), i.c_str()
+            );
+
+            Load(mSchema.mNodes[node].additional, e, f + ".second", indent + 8, depth + 1);
+
+            AppendFormat(mText, "%s    }\n%s}\n%selse\n%s    result = false;\n", in.c_str(), in.c_str(), in.c_str(), in.c_str());
+            return;
+        }
+
+        AppendFormat(mText, "%sif (%s.%s)\n%s    %s = %s.%s;\n%selse\n%s    result = false;\n",
+            in.c_str(), src.c_str(), check, in.c_str(), dst.c_str(), src.c_str(), as, in.c_str(), in.c_str());
+    }
+
+    void Save(int node, const String& src, const String& dst, int indent, int depth)
+    // Writes code to store field 'src' into Value 'dst'
+    {
+        String in = Indent(indent);
+        String i  = "i" + std::to_string(depth);
+        String n  = "n" + std::to_string(depth);
+        String a  = "a" + std::to_string(depth);
+        String b  = "b" + std::to_string(depth);
+        String e  = "e" + std::to_string(depth);
+
+        switch (Kind(node))
+        {
+        case kFieldStruct:
+            AppendFormat(mText, "%sSetFromStruct(%s, &%s);\n", in.c_str(), src.c_str(), dst.c_str());
+            return;
+
+        case kFieldArray:
+            AppendFormat(mText,
+                "%sHL::ArrayValue& %s = %s.MakeArray(%s.size());\n"
+                "\n"
+                "%sfor (int64_t %s = 0, %s = int64_t(%s.size()); %s < %s; %s++)\n"
+                "%s{\n",
+                in.c_str(), a.c_str(), dst.c_str(), src.c_str(),
+                in.c_str(), i.c_str(), n.c_str(), src.c_str(), i.c_str(), n.c_str(), i.c_str(),
+                in.c_str()
+            );
+
+            Save(mSchema.mNodes[node].items, src + "[" + i + "]", a + "[" + i + "]", indent + 4, depth + 1);
+
+            AppendFormat(mText, "%s}\n", in.c_str());
+            return;
+
+        case kFieldMap:
+            AppendFormat(mText,
+                "%sHL::ObjectBuilder %s;\n"
+                "%s%s.Reserve(%s.size());\n"
+                "\n"
+                "%sfor (const auto& %s : %s)\n"
+                "%s{\n"
+                "%s    HL::Value& %s = %s.Add(%s.first.c_str());\n",
+                in.c_str(), b.c_str(),
+                in.c_str(), b.c_str(), src.c_str(),
+                in.c_str(), e.c_str(), src.c_str(),
+                in.c_str(),
+                in.c_str(), a.c_str(), b.c_str(), e.c_str()
+            );
+
+            Save(mSchema.mNodes[node].additional, e + ".second", a, indent + 4, depth + 1);
+
+            AppendFormat(mText, "%s}\n\n%s%s.Finish(&%s);\n", in.c_str(), in.c_str(), b.c_str(), dst.c_str());
+            return;
+
+        default:
+            AppendFormat(mText, "%s%s = %s;\n", in.c_str(), dst.c_str(), src.c_str());
+            return;
+        }
+    }
+
+    void WriteStruct(int node)
+    {
+        const String& name = mStructNames[node];
+        const std::vector<Member>& members = mSchema.mNodes[node].members;
+
+        std::vector<String> types;
+        size_t width = 0;
+
+        for (const Member& member : members)
+        {
+            types.push_back(CppType(member.node));
+            width = std::max(width, types.back().size());
+        }
+
+        AppendFormat(mText, "struct %s\n{\n", name.c_str());
+
+        for (size_t i = 0; i < members.size(); i++)
+            AppendFormat(mText, "    %-*s %s%s;\n", int(width), types[i].c_str(), Identifier(members[i].name.c_str()).c_str(), Initialiser(members[i].node).c_str());
+
+        *mText += "};\n\n";
+    }
+
+    void WriteLoader(int node)
+    {
+        const String& name = mStructNames[node];
+        const std::vector<Member>& members = mSchema.mNodes[node].members;
+
+        // Group members by ID, in case of collisions
+        std::vector<std::pair<ID, int>> ids;
+        std::vector<uint64_t> requiredBits(members.size(), 0);
+        uint64_t requiredMask = 0;
+        int numRequired = 0;
+
+        for (int i = 0, n = int(members.size()); i < n; i++)
+        {
+            ids.push_back({ IDFromString(members[i].name.c_str()), i });
+
+            if (members[i].required && numRequired < 64)  // Beyond that, required members go unchecked
+            {
+                requiredBits[i] = uint64_t(1) << numRequired++;
+                requiredMask |= requiredBits[i];
+            }
+        }
+
+        std::sort(ids.begin(), ids.end());
+
+        AppendFormat(mText,
+            "inline bool SetFromValue(const HL::Value& v, %s* s)\n"
+            "{\n"
+            "    if (v.Type() != HL::kValueObject)\n"
+            "        return false;\n"
+            "\n"
+            "    bool result = true;\n"
+            "%s"
+            "\n"
+            "    for (int i = 0, n = v.NumMembers(); i < n; i++)\n"
+            "    {\n"
+            "        const char*      name  = v.MemberName(i);\n"
+            "        const HL::Value& value = v.MemberValue(i);\n"
+            "\n"
+            "        switch (v.MemberID(i))\n"
+            "        {\n",
+            name.c_str(),
+            requiredMask ? "    uint64_t found = 0;  // Required members seen\n" : ""
+        );
+
+        for (size_t i = 0; i < ids.size(); i++)
+        {
+            bool first = i == 0 || ids[i].first != ids[i - 1].first;
+            bool last  = i + 1 == ids.size() || ids[i].first != ids[i + 1].first;
+            const Member& member = members[ids[i].second];
+
+            if (first)
+                AppendFormat(mText, "        case 0x%08xu:\n", ids[i].first);
+
+            AppendFormat(mText, "            %sif (strcmp(name, %s) == 0)\n            {\n", first ? "" : "else ", CppString(member.name.c_str()).c_str());
+
+            if (requiredBits[ids[i].second])
+                AppendFormat(mText, "                found |= 0x%llx;\n", (unsigned long long) requiredBits[ids[i].second]);
+
+            Load(member.node, "value", "s->" + Identifier(member.name.c_str()), 16, 0);
+
+            *mText += "            }\n";
+
+            if (last)
+                *mText += "            break;\n";
+        }
+
+        *mText +=
+            "        }\n"
+            "    }\n"
+            "\n";
+
+        if (requiredMask)
+            AppendFormat(mText, "    return result && found == 0x%llx;\n}\n\n", (unsigned long long) requiredMask);
+        else
+            *mText += "    return result;\n}\n\n";
+    }
+
+    void WriteSaver(int node)
+    {
+        const std::vector<Member>& members = mSchema.mNodes[node].members;
+
+        AppendFormat(mText,
+            "inline void SetFromStruct(const %s& s, HL::Value* v)\n"
+            "{\n"
+            "    HL::ObjectBuilder builder;\n"
+            "    builder.Reserve(%d);\n"
+            "\n",
+            mStructNames[node].c_str(), int(members.size())
+        );
+
+        for (const Member& member : members)
+        {
+            String field = "s." + Identifier(member.name.c_str());
+            FieldKind kind = Kind(member.node);
+
+            if (kind == kFieldArray || kind == kFieldMap)
+            {
+                AppendFormat(mText, "    {\n        HL::Value& m = builder.Add(%s);\n", CppString(member.name.c_str()).c_str());
+                Save(member.node, field, "m", 8, 0);
+                *mText += "    }\n\n";
+            }
+            else
+                Save(member.node, field, "builder.Add(" + CppString(member.name.c_str()) + ")", 4, 0);
+        }
+
+        *mText += "\n    builder.Finish(v);\n}\n\n";
+    }
+};
+
+bool ValueSchema::GenerateStructs(String* text, const char* name, String* errors) const
+{
+    if (!mValid)
+    {
+        HL_ERROR("Schema hasn't been compiled");
+        return false;
+    }
+
+    StructGenerator generator(*this, text);
+
+    if (!generator.AssignNames(mRoot, name))
+    {
+        if (errors)
+            *errors += "Schema root must be an object with 'properties'\n";
+        return false;
+    }
+
+    name = generator.mStructNames[mRoot].c_str();  // in case of a title
+
+    String guard;
+    for (const char* s = name; *s; s++)
+        guard += isalnum(uint8_t(*s)) ? char(toupper(uint8_t(*s))) : '_';
+
+    Format(text,
+        "//\n"
+        "// %s -- generated from a schema by ValueSchema::GenerateStructs(), don't edit\n"
+        "//\n"
+        "\n"
+        "#ifndef %s_GENERATED_H\n"
+        "#define %s_GENERATED_H\n"
+        "\n"
+        "#include \"Value.hpp\"\n"
+        "\n",
+        name, guard.c_str(), guard.c_str()
+    );
+
+    for (int node : generator.mStructs)
+        generator.WriteStruct(node);
+
+    for (int node : generator.mStructs)
+        AppendFormat(text,
+            "bool SetFromValue (const HL::Value& v, %s* s);  // Returns false if 'v' doesn't convert\n"
+            "void SetFromStruct(const %s& s, HL::Value* v);\n"
+            "\n",
+            generator.mStructNames[node].c_str(), generator.mStructNames[node].c_str()
+        );
+
+    for (int node : generator.mStructs)
+    {
+        generator.WriteLoader(node);
+        generator.WriteSaver(node);
+    }
+
+    *text += "#endif\n";
+
+    return true;
+}
@@ -0,0 +1,99 @@
+//
+// ValueSchema.hpp
+//
+// Validation of values against a schema
+//
+
+#ifndef HL_VALUE_SCHEMA_H
+#define HL_VALUE_SCHEMA_H
+
+#include "Value.hpp"
+
+#include <math.h>
+
+namespace HL
+{
+    class ValueSchema
+    // Checks a value's types, ranges, and members against a schema, itself a value, e.g., from LoadJsonFile(). Schemas
+    // use a subset of JSON Schema:
+    //   type                   "null", "bool", "int", "uint", "int64", "uint64", "double", "string", "array", "object",
+    //                          or "any", or an array of these. Numbers match any numeric type they're losslessly
+    //                          convertible to, as per IsConvertibleTo(). Also "float", "boolean", "integer", "number".
+    //   minimum, maximum       inclusive range for numbers
+    //   minLength, maxLength   inclusive range for string lengths, in bytes
+    //   enum                   array of allowed values
+    //   items                  schema for every array element
+    //   minItems, maxItems     inclusive range for array sizes
+    //   properties             object mapping member names to their schemas
+    //   required               array of names of members that must be present
+    //   additionalProperties   false to disallow members not in 'properties', or a schema for them
+    //   default, title         used only by GenerateStructs(), for field initialisers and struct names respectively
+    // The schema is compiled once into a flat plan, with each object's expected members pre-sorted in the same order
+    // as Value keeps them. Validation is then a single pass over the value, checking each object's members against the
+    // expected ones in step, and reporting every problem found with its path.
+    {
+    public:
+        ValueSchema() = default;
+        ValueSchema(const Value& schema, String* errors = nullptr) { Compile(schema, errors); }
+
+        bool Compile(const Value& schema, String* errors = nullptr);   // Returns false and appends to 'errors' if the schema is malformed
+        bool IsValid() const;                                           // True if successfully compiled
+
+        bool Validate(const Value& v, String* errors = nullptr) const;  // Returns false if 'v' doesn't conform, appending a line per problem, prefixed by its path, to 'errors'
+
+        bool GenerateStructs(String* text, const char* name, String* errors = nullptr) const;
+        // Writes a C++ header with a struct per object schema that has 'properties', the root one being 'name', along
+        // with 'bool SetFromValue(const Value&, T*)' loaders and 'void SetFromStruct(const T&, Value*)' savers for
+        // each. Loaders dispatch on each member's IDFromString() hash via a switch, rather than looking fields up by
+        // name, and return false if the value isn't an object, a member doesn't convert, or a required one is missing.
+
+    protected:
+        enum : int
+        {
+            kNodeAny  = -1,   // anything is allowed
+            kNodeNone = -2,   // nothing is allowed
+        };
+
+        struct Member
+        {
+            String name;
+            int    node;
+            bool   required;
+        };
+
+        struct Node
+        {
+            uint32_t            types     = ~0u;        // Bit per allowed ValueType
+            double              minimum   = -HUGE_VAL;
+            double              maximum   = +HUGE_VAL;
+            uint64_t            minLength = 0;
+            uint64_t            maxLength = UINT64_MAX;
+            uint64_t            minItems  = 0;
+            uint64_t            maxItems  = UINT64_MAX;
+            Value               enumValues;             // Array of allowed values, if not null
+            int                 items      = kNodeAny;  // Array element schema
+            int                 additional = kNodeAny;  // Schema for members not in 'members'
+            std::vector<Member> members;                // Sorted by name
+            Value               defaultValue;
+            String              title;
+        };
+
+        std::vector<Node> mNodes;
+        int               mRoot  = kNodeAny;
+        bool              mValid = false;
+
+        bool MatchesType(const Node& node, const Value& v) const;
+
+        struct StructGenerator;
+    };
+
+
+    // --- Inlines -------------------------------------------------------------
+
+    inline bool ValueSchema::IsValid() const
+    {
+        return mValid;
+    }
+}
+
+#endif
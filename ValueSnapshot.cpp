@@ -0,0 +1,43 @@
+//
+// ValueSnapshot.cpp
+//
+// Immutable values that share structure between versions
+//
+
+#include "ValueSnapshot.hpp"
+
+using namespace HL;
+
+void ValueSnapshot::operator = (const ValueSnapshot& other)
+{
+    if (&other == this)
+        return;
+
+    // Reference rather than copy any root object
+    mRoot.MakeNull();
+
+    if (other.mRoot.Type() == kValueObject)
+        mRoot = other.mRoot.mValue.mObject;
+    else
+        mRoot = other.mRoot;
+}
+
+ValueSnapshot ValueSnapshot::Set(const char* path, const Value& v) const
+{
+    return Edit([path, &v](ValueTransaction& t) { t.Set(path, v); });
+}
+
+ValueSnapshot ValueSnapshot::Remove(const char* path) const
+{
+    return Edit([path](ValueTransaction& t) { t.Remove(path); });
+}
+
+ValueSnapshot ValueSnapshot::Merge(const char* path, const Value& overrides) const
+{
+    return Edit([path, &overrides](ValueTransaction& t) { t.Merge(path, overrides); });
+}
+
+bool ValueSnapshot::SharesRoot(const ValueSnapshot& other) const
+{
+    return mRoot.Type() == other.mRoot.Type() && mRoot.mValue.mUInt64 == other.mRoot.mValue.mUInt64;
+}
@@ -0,0 +1,105 @@
+//
+// ValueSnapshot.hpp
+//
+// Immutable values that share structure between versions
+//
+
+#ifndef HL_VALUE_SNAPSHOT_H
+#define HL_VALUE_SNAPSHOT_H
+
+#include "ValueTransaction.hpp"
+
+namespace HL
+{
+    class ValueSnapshot
+    // An immutable version of a value, for cheap undo history, or handing a consistent view to other code or threads.
+    // Copying a snapshot is O(1), as it just references the same tree. Editing one produces a new snapshot, copying only
+    // the objects and arrays on the path from the root to each edited value, and sharing everything else with the
+    // original, so each edit costs O(depth) shallow copies rather than the O(size) of copying a Value.
+    // Read the contents via the usual Value API, e.g., snapshot->Member("a"), or MemberPath(*snapshot, "a.b[2]").
+    {
+    public:
+        ValueSnapshot() = default;
+        explicit ValueSnapshot(const Value& v);  // Snapshot of a copy of 'v'
+        explicit ValueSnapshot(Value&& v);       // Snapshot taking over 'v', which mustn't be modified via other references to its contents afterwards
+
+        ValueSnapshot(const ValueSnapshot& other);
+        ValueSnapshot(ValueSnapshot&& other) noexcept = default;
+        void operator = (const ValueSnapshot& other);
+        void operator = (ValueSnapshot&& other);
+
+        const Value&  Root() const;
+        const Value&  operator *  () const;
+        const Value*  operator -> () const;
+        const Value&  operator [] (ValueKey key) const;  // Root().Member(key)
+
+        ValueSnapshot Set   (const char* path, const Value& v) const;          // Returns a snapshot with the value at 'path' set to 'v'
+        ValueSnapshot Remove(const char* path) const;                          // Returns a snapshot without the member at 'path'
+        ValueSnapshot Merge (const char* path, const Value& overrides) const;  // Returns a snapshot with 'overrides' merged into the value at 'path'
+
+        template<class F> ValueSnapshot Edit(F edits) const;
+        // Returns a snapshot with the given batch of edits applied, where 'edits' is called with a ValueTransaction to make
+        // them through, e.g., s.Edit([](ValueTransaction& t) { t.Set("a.b", Value(1)); t.Remove("c"); }). Values on
+        // shared paths are only copied once.
+
+        bool SharesRoot(const ValueSnapshot& other) const;  // True if the two are the same version, e.g., there were no edits between them
+
+    protected:
+        Value mRoot;
+    };
+
+
+    // --- Inlines -------------------------------------------------------------
+
+    inline ValueSnapshot::ValueSnapshot(const Value& v) : mRoot(v)
+    {
+    }
+
+    inline ValueSnapshot::ValueSnapshot(Value&& v) : mRoot(std::move(v))
+    {
+    }
+
+    inline ValueSnapshot::ValueSnapshot(const ValueSnapshot& other)
+    {
+        *this = other;
+    }
+
+    inline void ValueSnapshot::operator = (ValueSnapshot&& other)
+    {
+        mRoot.MakeNull();  // Value's move would swap object contents rather than pointers
+        mRoot.Swap(other.mRoot);
+    }
+
+    inline const Value& ValueSnapshot::Root() const
+    {
+        return mRoot;
+    }
+
+    inline const Value& ValueSnapshot::operator * () const
+    {
+        return mRoot;
+    }
+
+    inline const Value* ValueSnapshot::operator -> () const
+    {
+        return &mRoot;
+    }
+
+    inline const Value& ValueSnapshot::operator [] (ValueKey key) const
+    {
+        return mRoot.Member(key);
+    }
+
+    template<class F> inline ValueSnapshot ValueSnapshot::Edit(F edits) const
+    {
+        ValueSnapshot result(*this);
+        ValueTransaction transaction(&result.mRoot, true);
+
+        edits(transaction);
+        transaction.Commit();
+
+        return result;
+    }
+}
+
+#endif
@@ -0,0 +1,346 @@
+//
+// ValueStatic.cpp
+//
+// Read-only values compiled into the program as constant data
+//
+
+#include "ValueStatic.hpp"
+
+#include <string.h>
+#include <unordered_map>
+
+using namespace HL;
+
+namespace
+{
+    const int kMaxStaticCount = 0x0FFFFFFF;  // Element/member count limit, given the 4 bits for the type
+}
+
+bool StaticValue::AsBool(bool defaultValue) const
+{
+    switch (Type())
+    {
+    case kValueString:
+        return EqualI(AsString(), "true");
+    case kValueArray:
+    case kValueObject:
+        return Count() > 0;
+    default:
+        return Scalar().AsBool(defaultValue);
+    }
+}
+
+int32_t StaticValue::AsInt(int32_t defaultValue) const
+{
+    return Scalar().AsInt(defaultValue);
+}
+
+uint32_t StaticValue::AsUInt(uint32_t defaultValue) const
+{
+    return Scalar().AsUInt(defaultValue);
+}
+
+int64_t StaticValue::AsInt64(int64_t defaultValue) const
+{
+    return Scalar().AsInt64(defaultValue);
+}
+
+uint64_t StaticValue::AsUInt64(uint64_t defaultValue) const
+{
+    return Scalar().AsUInt64(defaultValue);
+}
+
+float StaticValue::AsFloat(float defaultValue) const
+{
+    return Scalar().AsFloat(defaultValue);
+}
+
+double StaticValue::AsDouble(double defaultValue) const
+{
+    return Scalar().AsDouble(defaultValue);
+}
+
+const char* StaticValue::AsString(const char* defaultValue) const
+{
+    return Type() == kValueString ? mTable->strings + mData->data : defaultValue;
+}
+
+const char* StaticValue::AsCString(const char* defaultValue) const
+{
+    return Type() == kValueString ? mTable->strings + mData->data : defaultValue;
+}
+
+StaticValue StaticValue::Elt(int index) const
+{
+    if (Type() != kValueArray || index < 0 || index >= Count())
+        return StaticValue();
+
+    return StaticValue(mTable, uint32_t(mData->data + index));
+}
+
+const char* StaticValue::MemberName(int i) const
+{
+    return mTable->strings + mTable->values[mData->data + i].key;
+}
+
+StaticValue StaticValue::MemberValue(int i) const
+{
+    return StaticValue(mTable, uint32_t(mData->data + i));
+}
+
+StaticValue StaticValue::Member(ValueKeySpan key) const
+{
+    if (Type() != kValueObject)
+        return StaticValue();
+
+    // Members are sorted by name
+    const StaticValueData* members = mTable->values + mData->data;
+    int lo = 0;
+    int hi = Count();
+
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        int c = CompareKey(mTable->strings + members[mid].key, key);
+
+        if (c == 0)
+            return StaticValue(mTable, uint32_t(mData->data + mid));
+
+        if (c < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return StaticValue();
+}
+
+Value StaticValue::ToValue() const
+{
+    switch (Type())
+    {
+    case kValueString:
+        return Value(AsString());
+
+    case kValueArray:
+    {
+        ArrayBuilder builder;
+        builder.Reserve(Count());
+
+        for (int i = 0, n = Count(); i < n; i++)
+            builder.Add(Elt(i).ToValue());
+
+        Value v;
+        builder.Finish(&v);
+        return v;
+    }
+
+    case kValueObject:
+    {
+        ObjectBuilder builder;
+        builder.Reserve(Count());
+
+        for (int i = 0, n = Count(); i < n; i++)
+            builder.Add(MemberName(i), MemberValue(i).ToValue());
+
+        Value v;
+        builder.Finish(&v);
+        return v;
+    }
+
+    default:
+        return Scalar();
+    }
+}
+
+Value StaticValue::Scalar() const
+{
+    uint64_t bits = mData ? mData->data : 0;
+
+    switch (Type())
+    {
+    case kValueBool:
+        return Value(bits != 0);
+    case kValueInt:
+        return Value(int32_t(uint32_t(bits)));
+    case kValueUInt:
+        return Value(uint32_t(bits));
+    case kValueInt64:
+        return Value(int64_t(bits));
+    case kValueUInt64:
+        return Value(bits);
+    case kValueDouble:
+    {
+        double d;
+        memcpy(&d, &bits, sizeof(d));
+        return Value(d);
+    }
+    default:
+        return Value();
+    }
+}
+
+StaticValue HL::MemberPath(const StaticValue& v, const char* path)
+{
+    StaticValue result = v;
+
+    while (*path)
+    {
+        size_t len = PathFieldLength(path);
+
+        if (path[0] == '[' && result.IsArray())
+        {
+            char* end = nullptr;
+            long index = strtol(path + 1, &end, 10);
+
+            result = *end == ']' ? result.Elt(int(index)) : StaticValue();
+        }
+        else
+            result = result.Member(PathFieldKey(path, len));
+
+        path += len;
+    }
+
+    return result;
+}
+
+void HL::SaveAsCpp(String* text, const Value& root, const char* name)
+{
+    // Values are laid out breadth first, so each container's elements or members are contiguous
+    std::vector<const Value*>     sources = { &root };
+    std::vector<uint32_t>         keys    = { 0 };
+    std::vector<StaticValueData>  values;
+
+    String pool(1, '\0');
+    std::unordered_map<std::string, uint32_t> poolOffsets = { { "", 0 } };
+
+    auto AddString = [&pool, &poolOffsets](const char* s) -> uint32_t
+    {
+        auto it = poolOffsets.find(s);
+
+        if (it != poolOffsets.end())
+            return it->second;
+
+        uint32_t offset = uint32_t(pool.size());
+        pool.append(s, strlen(s) + 1);
+        poolOffsets.emplace(s, offset);
+
+        return offset;
+    };
+
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        const Value& v = *sources[i];
+        uint64_t data  = 0;
+        int      count = 0;
+
+        switch (v.Type())
+        {
+        case kValueBool:
+            data = v.mValue.mBool;
+            break;
+        case kValueInt:
+        case kValueUInt:
+            data = v.mValue.mUInt32;
+            break;
+        case kValueInt64:
+        case kValueUInt64:
+        case kValueDouble:
+            data = v.mValue.mUInt64;
+            break;
+        case kValueString:
+            data = AddString(v.AsString());
+            break;
+        case kValueArray:
+            data  = sources.size();
+            count = v.NumElts();
+
+            for (int j = 0; j < count; j++)
+            {
+                sources.push_back(&v.Elt(j));
+                keys.push_back(0);
+            }
+            break;
+        case kValueObject:
+            data  = sources.size();
+            count = v.NumMembers();
+
+            for (int j = 0; j < count; j++)
+            {
+                sources.push_back(&v.AsObject().MemberValue(j));
+                keys.push_back(AddString(v.AsObject().MemberName(j)));
+            }
+            break;
+        default:
+            break;
+        }
+
+        if (count > kMaxStaticCount)
+        {
+            HL_ERROR("Too many elements or members for a static value");
+            count = kMaxStaticCount;
+        }
+
+        values.push_back({ data, keys[i], uint32_t(v.Type()) | (uint32_t(count) << 4) });
+    }
+
+    Format(text,
+        "//\n"
+        "// %s -- generated by SaveAsCpp(), don't edit\n"
+        "//\n"
+        "// Declare with: HL::StaticValue %s();\n"
+        "//\n"
+        "\n"
+        "#include \"ValueStatic.hpp\"\n"
+        "\n"
+        "namespace\n"
+        "{\n"
+        "    const char kStrings[] =\n"
+        "    {\n",
+        name, name
+    );
+
+    // One string per line
+    for (size_t i = 0; i < pool.size(); )
+    {
+        *text += "        ";
+
+        for (; pool[i]; i++)
+        {
+            char c = pool[i];
+
+            if (c == '\'' || c == '\\')
+                AppendFormat(text, "'\\%c',", c);
+            else if (c >= 32 && c < 127)
+                AppendFormat(text, "'%c',", c);
+            else
+                AppendFormat(text, "'\\x%02x',", uint8_t(c));
+        }
+
+        *text += "0,\n";
+        i++;
+    }
+
+    *text +=
+        "    };\n"
+        "\n"
+        "    const HL::StaticValueData kValues[] =\n"
+        "    {\n";
+
+    for (const StaticValueData& value : values)
+        AppendFormat(text, "        { %llu%s, %u, 0x%x },\n",
+            (unsigned long long) value.data, value.data > UINT32_MAX ? "u" : "", value.key, value.typeAndCount);
+
+    AppendFormat(text,
+        "    };\n"
+        "\n"
+        "    const HL::StaticValueTable kTable = { kStrings, kValues };\n"
+        "}\n"
+        "\n"
+        "HL::StaticValue %s()\n"
+        "{\n"
+        "    return HL::StaticValue(&kTable);\n"
+        "}\n",
+        name
+    );
+}
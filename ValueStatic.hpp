@@ -0,0 +1,172 @@
+//
+// ValueStatic.hpp
+//
+// Read-only values compiled into the program as constant data
+//
+
+#ifndef HL_VALUE_STATIC_H
+#define HL_VALUE_STATIC_H
+
+#include "Value.hpp"
+
+namespace HL
+{
+    struct StaticValueData
+    // One value in the generated table. Elements and members are contiguous, with members sorted by name.
+    {
+        uint64_t data;          // Scalar value bits, string pool offset for strings, or index of the first element or member
+        uint32_t key;           // String pool offset of the member name, if a member
+        uint32_t typeAndCount;  // ValueType in the bottom 4 bits, and the number of elements or members above that
+    };
+
+    struct StaticValueTable
+    {
+        const char*            strings;  // Pool of 0-terminated strings, starting with ""
+        const StaticValueData* values;   // Root first
+    };
+
+    class StaticValue
+    // Read-only view of a value generated by SaveAsCpp() or 'config_tool -gen-cpp', with the same read API as Value.
+    // The generated data is plain constants with no pointers, so there's no parsing or initialisation at startup, and
+    // it lives in read-only pages shared across processes. Views are two pointers, and cheap to pass around by value.
+    {
+    public:
+        StaticValue() = default;  // null
+        StaticValue(const StaticValueTable* table, uint32_t index = 0);
+
+        ValueType   Type() const;
+
+        bool        IsNull()    const;
+        bool        IsBool()    const;
+        bool        IsNumeric() const;
+        bool        IsString()  const;
+        bool        IsArray()   const;
+        bool        IsObject()  const;
+
+        bool        AsBool   (bool        defaultValue = false  ) const;
+        int32_t     AsInt    (int32_t     defaultValue = 0      ) const;
+        uint32_t    AsUInt   (uint32_t    defaultValue = 0      ) const;
+        int64_t     AsInt64  (int64_t     defaultValue = 0      ) const;
+        uint64_t    AsUInt64 (uint64_t    defaultValue = 0      ) const;
+        float       AsFloat  (float       defaultValue = 0.0f   ) const;
+        double      AsDouble (double      defaultValue = 0.0    ) const;
+        const char* AsString (const char* defaultValue = ""     ) const;
+        const char* AsCString(const char* defaultValue = 0      ) const;
+
+        // Array API
+        int         NumElts() const;
+        StaticValue Elt(int index) const;               // Returns null if out of range
+
+        // Object API
+        int         NumMembers() const;
+        const char* MemberName (int i) const;
+        StaticValue MemberValue(int i) const;
+        StaticValue Member     (ValueKey key) const;    // Returns null if there's no such member. O(log n).
+        StaticValue Member     (ValueKeySpan key) const;
+        bool        HasMember  (ValueKey key) const;
+
+        StaticValue operator [] (size_t   index) const; // Elt(index)
+        StaticValue operator [] (ValueKey key)   const; // Member(key)
+        size_t      size() const;                       // Number of elements or members
+
+        Value       ToValue() const;                    // Returns equivalent regular Value
+
+    protected:
+        const StaticValueTable* mTable = nullptr;
+        const StaticValueData*  mData  = nullptr;
+
+        Value       Scalar() const;                     // Value equivalent for non-string scalars, otherwise null
+        int         Count() const;
+    };
+
+    StaticValue MemberPath(const StaticValue& v, const char* path);  // As MemberPath() for Value
+
+    void SaveAsCpp(String* text, const Value& v, const char* name);
+    // Writes a C++ source file containing 'v' as constant data, along with 'HL::StaticValue name()' to access it.
+
+
+    // --- Inlines -------------------------------------------------------------
+
+    inline StaticValue::StaticValue(const StaticValueTable* table, uint32_t index) :
+        mTable(table),
+        mData(table->values + index)
+    {
+    }
+
+    inline ValueType StaticValue::Type() const
+    {
+        return mData ? ValueType(mData->typeAndCount & 0xF) : kValueNull;
+    }
+
+    inline int StaticValue::Count() const
+    {
+        return mData ? int(mData->typeAndCount >> 4) : 0;
+    }
+
+    inline bool StaticValue::IsNull() const
+    {
+        return Type() == kValueNull;
+    }
+
+    inline bool StaticValue::IsBool() const
+    {
+        return Type() == kValueBool;
+    }
+
+    inline bool StaticValue::IsNumeric() const
+    {
+        return Type() >= kValueBool && Type() <= kValueDouble;
+    }
+
+    inline bool StaticValue::IsString() const
+    {
+        return Type() == kValueString;
+    }
+
+    inline bool StaticValue::IsArray() const
+    {
+        return Type() == kValueArray;
+    }
+
+    inline bool StaticValue::IsObject() const
+    {
+        return Type() == kValueObject;
+    }
+
+    inline int StaticValue::NumElts() const
+    {
+        return Type() == kValueArray ? Count() : 0;
+    }
+
+    inline int StaticValue::NumMembers() const
+    {
+        return Type() == kValueObject ? Count() : 0;
+    }
+
+    inline StaticValue StaticValue::operator [] (size_t index) const
+    {
+        return Elt(int(index));
+    }
+
+    inline StaticValue StaticValue::operator [] (ValueKey key) const
+    {
+        return Member(key);
+    }
+
+    inline StaticValue StaticValue::Member(ValueKey key) const
+    {
+        return Member({ key, strlen(key) });
+    }
+
+    inline bool StaticValue::HasMember(ValueKey key) const
+    {
+        return Member(key).mData != nullptr;
+    }
+
+    inline size_t StaticValue::size() const
+    {
+        return Type() >= kValueArray ? Count() : 0;
+    }
+}
+
+#endif
@@ -0,0 +1,398 @@
+//
+// ValueTransaction.cpp
+//
+// Batched edits to a value, committed or rolled back as one
+//
+
+#include "ValueTransaction.hpp"
+
+#include <algorithm>
+#include <stdlib.h>
+
+using namespace HL;
+
+namespace
+{
+    inline bool IsIndexField(const Value& v, const char* field, int64_t* index)
+    {
+        if (field[0] != '[' || v.Type() != kValueArray)
+            return false;
+
+        char* end = nullptr;
+        long long i = strtoll(field + 1, &end, 10);
+
+        *index = (*end == ']' && i >= 0 && i < v.NumElts()) ? int64_t(i) : -1;
+        return true;
+    }
+
+    inline Value Shared(const Value& v)
+    // Returns v, but referencing rather than copying any object, as Value's copy would
+    {
+        if (v.Type() == kValueObject)
+            return Value(v.mValue.mObject);
+
+        return v;
+    }
+
+    const Value* Lookup(const Value& root, const char* path)
+    // Like MemberPath(), but distinguishes missing values from null ones, and "" is the root itself
+    {
+        const Value* v = &root;
+
+        while (v && *path)
+        {
+            size_t len = PathFieldLength(path);
+            int64_t index;
+
+            if (IsIndexField(*v, path, &index))
+                v = index >= 0 ? &v->Elt(index) : nullptr;
+            else
+                v = v->MemberPtr(PathFieldKey(path, len));
+
+            path += len;
+        }
+
+        return v;
+    }
+
+    bool HasEditedParent(const String& path, const String* first, const String* last)
+    // Returns true if any of the sorted paths in [first, last) is above 'path'
+    {
+        if (path.empty())
+            return false;
+
+        if (first != last && first->empty())
+            return true;
+
+        for (size_t i = 1; i < path.size(); i++)
+            if (path[i] == '.' || path[i] == '[')
+                if (std::binary_search(first, last, path.substr(0, i)))
+                    return true;
+
+        return false;
+    }
+}
+
+ValueTransaction::ValueTransaction(Value* root, bool persistent) :
+    mRoot(root),
+    mWorking(Shared(*root)),
+    mBefore(Shared(*root)),
+    mPersistent(persistent)
+{
+    if (mBefore.Type() == kValueObject)
+        mBeforeModCount = mBefore.mValue.mObject->ModCount();
+}
+
+ValueTransaction::~ValueTransaction()
+{
+    if (mOpen)
+        Rollback();
+}
+
+Value& ValueTransaction::Update(const char* path)
+{
+    HL_ASSERT(mOpen);
+    Value* v = Find(path, true);
+
+    if (!v)
+    {
+        kNullValueScratch.MakeNull();
+        return kNullValueScratch;
+    }
+
+    UnshareAll(v);
+    mPaths.push_back(path);
+
+    return *v;
+}
+
+void ValueTransaction::Set(const char* path, const Value& value)
+{
+    HL_ASSERT(mOpen);
+    Value* v = Find(path, true);
+
+    if (v)
+    {
+        v->MakeNull();  // rather than swapping 'value' into an object that may still be part of the original
+        *v = value;
+        mPaths.push_back(path);
+    }
+}
+
+bool ValueTransaction::Remove(const char* path)
+{
+    HL_ASSERT(mOpen);
+
+    // Check the member exists first, so nothing's copied if there's nothing to remove
+    const char* field = path;
+
+    for (const char* p = path; *p; p += PathFieldLength(p))
+        field = p;
+
+    String parentPath(path, field - path);
+    const Value* parent = Lookup(mWorking, parentPath.c_str());
+    ValueKeySpan key = PathFieldKey(field, strlen(field));
+    int64_t index;
+
+    if (!*field || !parent || IsIndexField(*parent, field, &index) || !parent->MemberPtr(key))
+        return false;
+
+    Value* v = Find(parentPath.c_str(), false);
+    Unshare(v);
+    v->RemoveMember(key);
+
+    mPaths.push_back(path);
+    return true;
+}
+
+void ValueTransaction::Merge(const char* path, const Value& overrides)
+{
+    HL_ASSERT(mOpen);
+
+    if (overrides.IsNull())
+        return;
+
+    Value* v = Find(path, true);
+
+    if (!v)
+        return;
+
+    if (overrides.Type() != kValueObject || v->Type() != kValueObject)
+    {
+        *v = overrides;
+        mPaths.push_back(path);
+        return;
+    }
+
+    // Unshare each object before it's merged into, and record each member set or removed rather than 'path' as a whole
+    Unshare(v);
+
+    v->mValue.mObject->Merge(*overrides.mValue.mObject,
+        [this](MergeChange change, const String& memberPath, Value* member)
+        {
+            if (change == kMergeDescend)
+                Unshare(member);
+            else
+                mPaths.push_back(memberPath);
+        },
+        path
+    );
+}
+
+const std::vector<String>& ValueTransaction::Commit()
+{
+    HL_ASSERT(mOpen);
+    HL_ASSERT(RootUnchanged());
+
+    // Each copy now takes over from its original as a single modification
+    for (size_t i = 0, n = mObjects.size(); i < n; i++)
+        mObjects[i]->mModCount = mModCounts[i] + 1;
+
+    if (!mPersistent && mBefore.Type() == kValueObject && mWorking.Type() == kValueObject && mWorking.mValue.mObject != mBefore.mValue.mObject)
+    {
+        // Swap the new root contents into the original root object, so, as with assignment, it keeps its identity
+        ObjectRef original = mBefore.mValue.mObject;
+        ObjectRef current  = mWorking.mValue.mObject;
+        uint32_t  modCount = original->mModCount;
+
+        original->Swap(current);
+        original->mModCount = modCount + 1;
+        current ->mModCount = modCount;
+
+        mBefore = current;
+    }
+    else if (mWorking.Type() == kValueObject)
+        *mRoot = mWorking.mValue.mObject;
+    else
+        *mRoot = mWorking;
+
+    mWorking.MakeNull();
+
+    mObjects.clear();
+    mModCounts.clear();
+    mArrays.clear();
+    mCopies.clear();
+    mOpen = false;
+
+    // Sorting puts parents before their children, so we only need to check against the paths kept so far
+    std::sort(mPaths.begin(), mPaths.end());
+    mPaths.erase(std::unique(mPaths.begin(), mPaths.end()), mPaths.end());
+
+    size_t numKept = 0;
+
+    for (size_t i = 0, n = mPaths.size(); i < n; i++)
+        if (!HasEditedParent(mPaths[i], mPaths.data(), mPaths.data() + numKept))
+            mPaths[numKept++].swap(mPaths[i]);
+
+    mPaths.resize(numKept);
+
+    return mPaths;
+}
+
+void ValueTransaction::Rollback()
+{
+    HL_ASSERT(mOpen);
+    HL_ASSERT(RootUnchanged());
+
+    mWorking.MakeNull();
+    mObjects.clear();
+    mModCounts.clear();
+    mArrays.clear();
+    mCopies.clear();
+    mPaths.clear();
+    mOpen = false;
+}
+
+bool ValueTransaction::RootUnchanged() const
+{
+    if (mBefore.Type() == kValueObject)
+        return mRoot->Type() == kValueObject && mRoot->mValue.mObject == mBefore.mValue.mObject && mRoot->mValue.mObject->ModCount() == mBeforeModCount;
+
+    return *mRoot == mBefore;
+}
+
+void ValueTransaction::Unshare(Value* v)
+{
+    // A container with a single reference was created during the transaction, as anything reachable from the
+    // original tree is referenced by both it and our copy of its parent.
+    if (v->Type() == kValueObject)
+    {
+        ObjectValue* object = v->mValue.mObject;
+
+        if (object->RefCount() == 1 || mCopies.count(object))
+            return;
+
+        ObjectValue* copy = CopyObject(*object);
+
+        mObjects.push_back(copy);
+        mModCounts.push_back(object->mModCount);
+        mCopies.insert(copy);
+
+        *v = copy;
+    }
+    else if (v->Type() == kValueArray && v->mValue.mArray)
+    {
+        ArrayValue* array = v->mValue.mArray;
+
+        if ((array->RefCount() == 1 && !array->IsSlice()) || mCopies.count(array))
+            return;
+
+        ArrayValue* copy = CreateArrayValue(array->count);
+
+        for (int64_t i = 0; i < array->count; i++)
+            (*copy)[i] = Shared((*array)[i]);
+
+        mArrays.push_back(copy);
+        mCopies.insert(copy);
+
+        *v = copy;
+    }
+}
+
+void ValueTransaction::UnshareAll(Value* v)
+{
+    // Even containers already ours may hold ones from the original tree, so visit everything
+    std::vector<Value*> stack = { v };
+
+    while (!stack.empty())
+    {
+        Value* next = stack.back();
+        stack.pop_back();
+
+        Unshare(next);
+
+        if (next->Type() == kValueObject)
+        {
+            ObjectValue* object = next->mValue.mObject;
+
+            for (int i = 0, n = object->NumMembers(); i < n; i++)
+                stack.push_back(&object->MemberValue(i));
+        }
+        else if (next->Type() == kValueArray && next->mValue.mArray)
+        {
+            ArrayValue* array = next->mValue.mArray;
+
+            for (int64_t i = 0, n = array->size(); i < n; i++)
+                stack.push_back(&(*array)[i]);
+        }
+    }
+}
+
+Value* ValueTransaction::Find(const char* path, bool create)
+{
+    HL_ASSERT(RootUnchanged());
+    Value* v = &mWorking;
+
+    while (v && *path)
+    {
+        size_t len = PathFieldLength(path);
+
+        Unshare(v);
+        v = Field(v, path, len, create);
+        path += len;
+    }
+
+    return v;
+}
+
+Value* ValueTransaction::Field(Value* v, const char* field, size_t len, bool create)
+{
+    int64_t index;
+
+    if (IsIndexField(*v, field, &index))
+    {
+        if (index >= 0)
+            return &v->Elt(index);
+
+        if (create)
+            HL_ERROR("Can't update a non-existent array element");
+
+        return nullptr;
+    }
+
+    ValueKeySpan key = PathFieldKey(field, len);
+
+    if (create)
+    {
+        if (v->ToObject())
+            return &v->mValue.mObject->UpdateMember(key);
+
+        HL_ERROR("Can't insert a member on a non-object");
+        return nullptr;
+    }
+
+    if (v->Type() != kValueObject)
+        return nullptr;
+
+    ObjectValue* object = v->mValue.mObject;
+    int i = object->MemberIndex(key);
+
+    return i >= 0 ? &object->MemberValue(i) : nullptr;
+}
+
+ObjectValue* ValueTransaction::CopyObject(const ObjectValue& other)
+{
+    ObjectValue* object;
+
+    if (other.mShape)
+    {
+        object = ObjectValue::CreateShaped(other.mShape);
+
+        Value*       values      = object->ShapeValues();
+        const Value* otherValues = other.ShapeValues();
+
+        for (int i = 0, n = other.mShape->count; i < n; i++)
+            values[i] = Shared(otherValues[i]);
+    }
+    else
+    {
+        object = new ObjectValue;
+        object->mMap.reserve(other.mMap.size());
+
+        for (const auto& member : other.mMap)
+            object->mMap.emplace_back(member.first, Shared(member.second));
+    }
+
+    object->mModCount = other.mModCount;
+    return object;
+}
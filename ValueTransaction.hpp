@@ -0,0 +1,79 @@
+//
+// ValueTransaction.hpp
+//
+// Batched edits to a value, committed or rolled back as one
+//
+
+#ifndef HL_VALUE_TRANSACTION_H
+#define HL_VALUE_TRANSACTION_H
+
+#include "Value.hpp"
+
+#include <unordered_set>
+
+namespace HL
+{
+    class ValueTransaction
+    // Groups a batch of edits to a value so they appear as a single change. Edits are made via paths in MemberPath()
+    // form, e.g., "materials.default.albedo" or "passes[2].name", to a working root private to the transaction. The
+    // first edit below any object or array there swaps it for a shallow copy, so only the containers along edited
+    // paths are copied, and the original tree, root included, is untouched until Commit(). Commit() then installs the
+    // working root, making all the edits visible at once, and each edited object's mod count goes up by exactly one,
+    // however many edits were made below it. Rollback() just discards the working root.
+    // As edits replace containers rather than modifying them, anyone holding a reference to a container inside the
+    // tree, rather than going via the root, keeps seeing the old version. Don't otherwise edit the tree while the
+    // transaction is open, as Commit() replaces it.
+    {
+    public:
+        ValueTransaction(Value* root, bool persistent = false);  // Begins a transaction on 'root', which must outlive it. If 'persistent', Commit() leaves the original root object alone too, see ValueSnapshot.
+        ~ValueTransaction();            // Rolls back if neither Commit() nor Rollback() has been called
+
+        Value&       Update(const char* path);                          // Returns the value at 'path' for writing, creating it if necessary. Any containers within it are copied, so it can be edited to any depth, but for a small edit to a large subtree, use a deeper path.
+        void         Set   (const char* path, const Value& v);          // Sets the value at 'path'
+        bool         Remove(const char* path);                          // Removes the member at 'path'. Returns false if it doesn't exist.
+        void         Merge (const char* path, const Value& overrides);  // Value::Merge() for the value at 'path'
+
+        const std::vector<String>& Commit();    // Completes the transaction, returning the paths edited, sorted, and omitting any below another edited path
+        void         Rollback();                // Discards all edits, leaving the original value as it was
+
+        bool         IsOpen() const;            // True until Commit() or Rollback()
+        const Value& Before() const;            // The value as it was when the transaction began
+
+    protected:
+        Value*                          mRoot;
+        Value                           mWorking;    // Our version of the root, with the edits so far
+        Value                           mBefore;     // The original root, for Before() and checking it's untouched
+        uint32_t                        mBeforeModCount = 0;
+        bool                            mOpen = true;
+        bool                            mPersistent;
+
+        std::vector<ObjectRef>          mObjects;    // Our copies, kept referenced so their addresses aren't reused while we're open
+        std::vector<uint32_t>           mModCounts;  // Corresponding original mod counts
+        std::vector<ArrayValueRef>      mArrays;
+        std::unordered_set<const void*> mCopies;     // Everything in mObjects and mArrays
+
+        std::vector<String>             mPaths;      // Edited paths, consolidated by Commit()
+
+        bool   RootUnchanged() const;                       // True if the root is as it was when we began, as it should be until Commit()
+        void   Unshare(Value* v);                           // Replaces v's container with a copy, unless it's one of ours already
+        void   UnshareAll(Value* v);                        // Unshare()s v and every container within it
+        static ObjectValue* CopyObject(const ObjectValue& other);           // Copies 'other', referencing rather than copying its object members
+        Value* Find(const char* path, bool create);         // Returns the value at 'path', unsharing everything above it, or 0 if it doesn't exist and 'create' is false
+        Value* Field(Value* v, const char* field, size_t len, bool create);  // Returns the member or element of 'v' for the given path field
+    };
+
+
+    // --- Inlines -------------------------------------------------------------
+
+    inline bool ValueTransaction::IsOpen() const
+    {
+        return mOpen;
+    }
+
+    inline const Value& ValueTransaction::Before() const
+    {
+        return mBefore;
+    }
+}
+
+#endif
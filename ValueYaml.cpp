@@ -23,20 +23,40 @@
 #endif
 
 #include "external/yaml.h"
+#include <deque>
 #include <math.h>
 
 using namespace HL;
 
 namespace
 {
-    enum YamlResult { kYamlOk, kYamlEnd, kYamlError };
+    enum YamlResult { kYamlOk, kYamlEnd, kYamlError, kYamlStarted };  // kYamlStarted: a sequence or mapping has been pushed on mFrames
 
     struct YamlReader
     {
+        struct Frame
+        {
+            Value*        mNode;            // Where the sequence or mapping goes once read
+            bool          mIsMapping;
+            bool          mInChild = false; // Whether an element or member is being read
+            bool          mMerging = false; // Whether mChild is a '<<' merge value
+            ObjectValue*  mObject  = 0;     // Mapping: the object being added to directly, if any
+            Value         mChild;           // Sequence element or merge value being read
+            String        mAnchor;
+            ArrayBuilder  mArray;
+            ObjectBuilder mBuilder;
+
+            Frame(Value* node, bool isMapping, StringTable* st, ObjectShapeTable* shapes) :
+                mNode(node), mIsMapping(isMapping), mBuilder(st, shapes) {}
+        };
+
         yaml_parser_t             mParser;
         StringTable*              mStringTable = 0;
+        ObjectShapeTableRef       mShapeTable  = CreateObjectShapeTable();
         vector_map<String, Value> mAnchors;
         String                    mLocalError;
+        std::deque<Frame>         mFrames;  // Sequences and mappings being read, from the outermost
+        int                       mMaxDepth = kYamlMaxDepth;
 
         YamlReader(const char* text, StringTable* st) : mStringTable(st)
         {
@@ -55,13 +75,40 @@ namespace
             yaml_parser_delete(&mParser);
         }
 
-        YamlResult ParseScalar  (Value* value);
-        YamlResult ParseSequence(Values* array);
-        YamlResult ParseMapping (ObjectValue* object);
+        YamlResult Parse      (Value* value);
+        YamlResult ParseScalar(Value* value);
+
+        YamlResult StartContainer(Value* value, bool isMapping, const yaml_char_t* anchor);
+        Value*     NextElt       (Frame& frame, YamlResult* result);
+        Value*     NextMember    (Frame& frame, YamlResult* result);
+        YamlResult EndContainer  (Frame& frame, YamlResult result);
+        bool       Merge         (Frame& frame);
 
+        void SetProblem(const char* problem);
         void AppendError(String* errors);
     };
 
+    YamlResult YamlReader::Parse(Value* value)
+    {
+        // Sequences and mappings are read via mFrames rather than recursively, so nesting is only limited by
+        // mMaxDepth. Each time round, the innermost one is given the result of reading its last element or member,
+        // and either supplies where to read the next one, or is complete.
+        YamlResult result = ParseScalar(value);
+
+        while (!mFrames.empty())
+        {
+            Frame& frame = mFrames.back();
+            Value* next = frame.mIsMapping ? NextMember(frame, &result) : NextElt(frame, &result);
+
+            if (next)
+                result = ParseScalar(next);
+            else
+                result = EndContainer(frame, result);
+        }
+
+        return result;
+    }
+
     YamlResult YamlReader::ParseScalar(Value* scalar)
     {
         bool done = false;
@@ -91,23 +138,12 @@ namespace
                 break;
 
             case YAML_SEQUENCE_START_EVENT:
-                {
-                    Values array;
-                    result = ParseSequence(&array);
-                    *scalar = array;
-
-                    if (event.data.scalar.anchor)
-                        mAnchors[String((const char*) event.data.scalar.anchor)] = scalar->AsArrayPtr();
-                }
+                result = StartContainer(scalar, false, event.data.sequence_start.anchor);
                 done = true;
                 break;
 
             case YAML_MAPPING_START_EVENT:
-                result = ParseMapping(scalar->ToObjectPtr());
-
-                if (event.data.mapping_start.anchor)
-                    mAnchors[String((const char*) event.data.mapping_start.anchor)] = scalar->AsObjectPtr();
-
+                result = StartContainer(scalar, true, event.data.mapping_start.anchor);
                 done = true;
                 break;
 
@@ -128,8 +164,7 @@ namespace
                     else
                     {
                         mLocalError = Format("unknown anchor '%s'", anchor);
-                        mParser.problem = mLocalError;
-                        mParser.problem_mark = mParser.mark;
+                        SetProblem(mLocalError);
                         result = kYamlError;
                     }
                 }
@@ -141,7 +176,10 @@ namespace
                     static_assert(sizeof(yaml_char_t) == sizeof(char), "mismatch");
 
                     result = kYamlOk;
-                    String valueStr(event.data.scalar.value, event.data.scalar.value + event.data.scalar.length);
+
+                    // libyaml terminates scalars, so we can use them in place
+                    const char* valueStr = (const char*) event.data.scalar.value;
+                    size_t valueLen = event.data.scalar.length;
 
                     // TODO: I guess we're supposed to handle explicit 'tag' types here. But how many
                     // people even know they exist?! Ridiculous format.
@@ -212,9 +250,9 @@ namespace
                     {
                         // Well, I guess it's a string then.
                         if (mStringTable)
-                            *scalar = Value(mStringTable->GetString(valueStr));
+                            *scalar = Value(mStringTable->GetString(valueStr, valueLen));
                         else
-                            *scalar = Value(valueStr);
+                            *scalar = Value(CreateStringValue(valueStr, valueLen));
 
                         done = true;
                     }
@@ -232,114 +270,195 @@ namespace
         return result;
     }
 
-    YamlResult YamlReader::ParseSequence(Values* array)
+    YamlResult YamlReader::StartContainer(Value* value, bool isMapping, const yaml_char_t* anchor)
     {
-        while (true)
+        if (size_i(mFrames) >= mMaxDepth)
         {
-            Value item;
+            SetProblem("nesting too deep");
+            return kYamlError;
+        }
 
-            YamlResult result = ParseScalar(&item);
+        mFrames.emplace_back(value, isMapping, mStringTable, mShapeTable);
+        Frame& frame = mFrames.back();
 
-            if (result == kYamlEnd)
-                return kYamlOk;
+        if (anchor)
+            frame.mAnchor = (const char*) anchor;
 
-            if (result == kYamlError)
-                return kYamlError;
+        // Members are collected in a builder, unless we're adding to an existing object, or have had to merge into
+        // what we have so far, in which case we switch to updating the object directly.
+        if (isMapping)
+        {
+            frame.mObject = value->AsObjectPtr();
 
-            array->push_back(item);
+            if (!frame.mObject)
+                value->MakeNull();
         }
+
+        return kYamlStarted;
     }
 
-    YamlResult YamlReader::ParseMapping(ObjectValue* object)
+    Value* YamlReader::NextElt(Frame& frame, YamlResult* result)
     {
-        YamlResult result;
-
-        while (true)
+        if (frame.mInChild)
         {
-            yaml_event_t event;
+            frame.mInChild = false;
 
-            if (!yaml_parser_parse(&mParser, &event))
+            if (*result == kYamlEnd)
             {
-                result = kYamlError;
-                break;
+                *result = kYamlOk;
+                return 0;
             }
 
-            if (event.type == YAML_MAPPING_END_EVENT)
+            if (*result == kYamlError)
+                return 0;
+
+            frame.mArray.Add(std::move(frame.mChild));
+        }
+
+        frame.mChild.MakeNull();
+        frame.mInChild = true;
+
+        return &frame.mChild;
+    }
+
+    Value* YamlReader::NextMember(Frame& frame, YamlResult* result)
+    {
+        if (frame.mInChild)
+        {
+            frame.mInChild = false;
+
+            if (*result != kYamlOk)
+                return 0;
+
+            if (frame.mMerging)
             {
-                result = kYamlOk;
-                break;
+                frame.mMerging = false;
+
+                if (!Merge(frame))
+                {
+                    *result = kYamlError;
+                    return 0;
+                }
             }
-            else if (event.type != YAML_SCALAR_EVENT)
+        }
+
+        yaml_event_t event;
+
+        if (!yaml_parser_parse(&mParser, &event))
+        {
+            *result = kYamlError;
+            return 0;
+        }
+
+        Value* next = 0;
+
+        if (event.type == YAML_MAPPING_END_EVENT)
+            *result = kYamlOk;
+        else if (event.type != YAML_SCALAR_EVENT)
+        {
+            *result = kYamlError;
+            SetProblem("expecting scalar value for key");
+        }
+        else
+        {
+            ValueKeySpan key = { (const char*) event.data.scalar.value, event.data.scalar.length };
+
+            if (key.size == 2 && memcmp(key.data, "<<", 2) == 0)
             {
-                result = kYamlError;
-                mParser.problem = "expecting scalar value for key";
-                mParser.problem_mark = mParser.mark;
-                break;
+                frame.mMerging = true;
+                frame.mChild.MakeNull();
+                next = &frame.mChild;
             }
+            else if (frame.mObject)
+                next = &frame.mObject->UpdateMember(key, mStringTable);
             else
-            {
-                String key(event.data.scalar.value, event.data.scalar.value + event.data.scalar.length);
+                next = &frame.mBuilder.Add(key);
 
-                if (key == "<<")
-                {
-                    Value mergeValue;
-                    result = ParseScalar(&mergeValue);
+            frame.mInChild = true;
+        }
 
-                    if (result == kYamlOk)
-                    {
-                        bool success = true;
-                        if (mergeValue.IsObject())
-                            object->Merge(mergeValue.AsObject());
-                        else if (mergeValue.IsArray())
-                        {
-                            // This exists pretty much just to support [*anchor1, *anchor2, ...] syntax :P
+        yaml_event_delete(&event);
 
-                            for (const Value& av : mergeValue.AsArray())
-                                if (av.IsObject())
-                                    object->Merge(av.AsObject());
-                                else
-                                    success = false;
-                        }
+        return next;
+    }
 
-                        if (!success)
-                        {
-                            result = kYamlError;
-                            mParser.problem = "can't merge non-mapping";
-                            mParser.problem_mark = mParser.mark;
-                        }
-                    }
-                }
+    bool YamlReader::Merge(Frame& frame)
+    {
+        if (!frame.mObject)
+        {
+            frame.mBuilder.Finish(frame.mNode);
+            frame.mObject = frame.mNode->AsObjectPtr();
+        }
+
+        const Value& mergeValue = frame.mChild;
+        bool success = true;
+
+        if (mergeValue.IsObject())
+            frame.mObject->Merge(mergeValue.AsObject());
+        else if (mergeValue.IsArray())
+        {
+            // This exists pretty much just to support [*anchor1, *anchor2, ...] syntax :P
+
+            for (const Value& av : mergeValue.AsArray())
+                if (av.IsObject())
+                    frame.mObject->Merge(av.AsObject());
                 else
-                {
-                    Value& newMember = object->UpdateMember(key, mStringTable);
+                    success = false;
+        }
 
-                    result = ParseScalar(&newMember);
-                }
+        if (!success)
+            SetProblem("can't merge non-mapping");
 
-                if (result != kYamlOk)
-                    break;
-            }
+        return success;
+    }
 
-            yaml_event_delete(&event);
+    YamlResult YamlReader::EndContainer(Frame& frame, YamlResult result)
+    {
+        Value* value = frame.mNode;
+
+        if (frame.mIsMapping)
+        {
+            if (!frame.mObject)
+                frame.mBuilder.Finish(value);
+
+            if (!frame.mAnchor.empty())
+                mAnchors[frame.mAnchor] = value->AsObjectPtr();
+        }
+        else
+        {
+            frame.mArray.Finish(value);
+
+            if (!frame.mAnchor.empty())
+                mAnchors[frame.mAnchor] = value->AsArrayPtr();
         }
 
+        mFrames.pop_back();
+
         return result;
     }
 
+    void YamlReader::SetProblem(const char* problem)
+    {
+        mParser.problem = problem;
+        mParser.problem_mark = mParser.mark;
+    }
+
     void YamlReader::AppendError(String* errors)
     {
         *errors += mParser.problem;
-        *errors += Format(" in line %d, col %d\n", mParser.problem_mark.line, mParser.problem_mark.column);
+        *errors += Format(" in line %llu, col %llu\n", (unsigned long long) mParser.problem_mark.line, (unsigned long long) mParser.problem_mark.column);
     }
 }
 
+int HL::kYamlMaxDepth = 20000;
+
 bool HL::LoadYamlText(const char* text, Value* value, String* errors, StringTable* st)
 {
     YamlReader reader(text, st);
 
     value->MakeNull();
 
-    YamlResult result = reader.ParseScalar(value);
+    YamlResult result = reader.Parse(value);
 
     if (result == kYamlError && errors)
         reader.AppendError(errors);
@@ -352,7 +471,7 @@ bool HL::LoadYamlFile(FILE* file, Value* value, String* errors, StringTable* st)
     YamlReader reader(file, st);
 
     value->MakeNull();
-    YamlResult result = reader.ParseScalar(value);
+    YamlResult result = reader.Parse(value);
 
     if (result == kYamlError && errors)
         reader.AppendError(errors);
@@ -21,6 +21,8 @@ namespace HL
     bool LoadYamlFile(FILE*       file, Value* value, String* errors = 0, StringTable* st = 0);
     bool LoadYamlText(const char* text, Value* value, String* errors = 0, StringTable* st = 0);
 
+    extern int kYamlMaxDepth;  // Maximum nesting depth when loading, beyond which loading fails with an error
+
     String AsYaml(const Value& v, int indent = 2);
 
     bool SaveAsYaml(const char*  path, const Value& v, int indent = 2);
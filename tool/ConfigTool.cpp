@@ -11,7 +11,12 @@
 #include "ArgSpec.h"
 
 #include "Config.hpp"
+#include "ConfigWatcher.hpp"
 #include "Value.hpp"
+#include "ValuePack.hpp"
+#include "ValueQuery.hpp"
+#include "ValueSchema.hpp"
+#include "ValueStatic.hpp"
 
 // For writing...
 #include "ValueJson.hpp"
@@ -34,23 +39,124 @@ namespace
         if (!file)
             return false;
 
-        size_t fileSize = 0;
+        // Read in chunks rather than seeking to find the size, as ftell() is limited to 2GB on some platforms
+        char buffer[64 * 1024];
+        size_t count;
 
-        if (fseek(file, 0, SEEK_END) == 0)
-            fileSize = ftell(file);
+        text->clear();
 
-        if (fseek(file, 0, SEEK_SET) != 0)
-            fileSize = 0;
+        while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+            text->append(buffer, count);
 
-        text->resize(fileSize);
-
-        if (fread((char*) text->data(), 1, fileSize, file) != fileSize)
+        if (ferror(file))
             text->clear();
 
         fclose(file);
         return !text->empty();
     }
 
+    bool LoadPacked(const char* path, const char* query, Value* config, String* errors)
+    // Loads a packed config. If the query starts with a member name, only that member is decompressed.
+    {
+        ValuePack pack;
+
+        if (!pack.Open(path, errors))
+            return false;
+
+        size_t len = query ? strcspn(query, ".[*?") : 0;
+        bool result;
+
+        if (len > 0 && pack.Type() == kValueObject)
+        {
+            ValueKeySpan key = { query, len };
+            const Value& member = pack.Member(key);
+
+            config->MakeNull();
+
+            if (pack.MemberIndex(key) >= 0)
+                config->UpdateMember(key) = member;
+
+            result = pack.Errors().empty();
+        }
+        else
+            result = pack.Load(config);
+
+        *errors += pack.Errors();
+        return result;
+    }
+
+    String StructName(const char* schemaPath)
+    {
+        // e.g., "examples/renderer_schema.json" -> "Renderer"
+        const char* name = strrchr(schemaPath, '/');
+        name = name ? name + 1 : schemaPath;
+
+        String stem(name, strcspn(name, "."));
+
+        if (stem.size() > 7 && stem.compare(stem.size() - 7, 7, "_schema") == 0)
+            stem.resize(stem.size() - 7);
+
+        String result;
+        bool upper = true;
+
+        for (char c : stem)
+        {
+            if (!isalnum(uint8_t(c)))
+                upper = true;
+            else
+            {
+                result += upper ? char(toupper(uint8_t(c))) : c;
+                upper = false;
+            }
+        }
+
+        return result.empty() || isdigit(uint8_t(result[0])) ? "Config" + result : result;
+    }
+
+    bool LoadTrace(const char* path, std::vector<String>* paths)
+    // Reads the paths in a usage trace, one per line, ignoring blank lines and #-comments. An empty trace is treated
+    // as an error, rather than pruning everything.
+    {
+        String text;
+        ReadText(path, &text);
+
+        for (const char* line = text.c_str(); *line; )
+        {
+            size_t len = strcspn(line, "\r\n");
+            String field(line, len);
+
+            line += len;
+            line += strspn(line, "\r\n");
+
+            field.resize(std::min(field.find('#'), field.size()));
+
+            size_t first = field.find_first_not_of(" \t");
+            size_t last  = field.find_last_not_of(" \t");
+
+            if (first != String::npos)
+                paths->push_back(field.substr(first, last + 1 - first));
+        }
+
+        if (paths->empty())
+        {
+            HL_LOG_E(Console, "Couldn't read any paths from trace %s", path);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool LoadSchema(const char* path, ValueSchema* schema, String* errors)
+    {
+        Value schemaValue;
+
+        if (LoadJsonFile(path, &schemaValue, errors) && schema->Compile(schemaValue, errors))
+            return true;
+
+        HL_LOG_E(Console, "Error in schema %s:\n%s", path, errors->c_str());
+        return false;
+    }
+
     enum ResultCodes : int
     {
         kResultOK               =  0,
@@ -60,31 +166,66 @@ namespace
         kResultConfigError      = 78,  // EX_CONFIG
     };
 
+    void DumpValue(const Value& v, bool membersOnly, bool yaml, const JsonFormat& format)
+    {
+        if (membersOnly && v.IsObject())
+            for (ConstNameValue nv : v.AsObject())
+                printf("%s\n", nv.name);
+        else
+        {
+            if (yaml)
+                SaveAsYaml(stdout, v, format.indent);
+            else
+                SaveAsJson(stdout, v, format);
+            fprintf(stdout, "\n");
+        }
+    }
+
     bool DumpConfig(const Value& config, const char* query, bool membersOnly, bool yaml, const JsonFormat& format)
     {
-        const Value* v = &config;
+        if (!query)
+        {
+            DumpValue(config, membersOnly, yaml, format);
+            return true;
+        }
 
-        if (query)
+        String errors;
+        ValueQuery valueQuery;
+
+        if (!valueQuery.Compile(query, &errors))
         {
-            v = &MemberPath(config, query);
+            fprintf(stderr, "%s", errors.c_str());
+            return false;
+        }
 
-            if (v->IsNull())
+        if (valueQuery.IsSinglePath())
+        {
+            const Value& v = valueQuery.First(config);
+
+            if (v.IsNull())
             {
                 fprintf(stderr, "%s not found\n", query);
                 return false;
             }
+
+            DumpValue(v, membersOnly, yaml, format);
+            return true;
         }
 
-        if (membersOnly && v->IsObject())
-            for (ConstNameValue nv : v->AsObject())
-                printf("%s\n", nv.name);
-        else
+        // Wildcard/filter queries show the path of each result
+        int count = 0;
+
+        for (ValueQueryResult result : valueQuery.Run(config))
         {
-            if (yaml)
-                SaveAsYaml(stdout, *v, format.indent);
-            else
-                SaveAsJson(stdout, *v, format);
-            fprintf(stdout, "\n");
+            printf("%s: ", result.path);
+            DumpValue(result.value, membersOnly, yaml, format);
+            count++;
+        }
+
+        if (count == 0)
+        {
+            fprintf(stderr, "%s not found\n", query);
+            return false;
         }
 
         return true;
@@ -108,11 +249,18 @@ int main(int argc, const char* argv[])
         kFlagYaml,
         kFlagJsonStrict,
         kFlagShowDeps,
+        kFlagWatch,
+        kFlagUnpack,
     };
 
     ConfigInfo configInfo;
     std::vector<const char*> inputPaths;
     const char* query = nullptr;
+    const char* genCppName = nullptr;
+    const char* schemaPath = nullptr;
+    const char* genStructPath = nullptr;
+    const char* packPath = nullptr;
+    const char* tracePath = nullptr;
     std::vector<const char*> settings;
     JsonFormat format;
 
@@ -123,9 +271,13 @@ int main(int argc, const char* argv[])
             "[<path:cstring> ...]", &inputPaths,
             "Read given config file(s) and dump corresponding data",
         "-query <object_path:cstring>", &query,
-            "Show the value at the given path, e.g., people.bob.name",
+            "Show the value at the given path, e.g., people.bob.name, or all values matching a query, e.g., people.*.name, ..name, people[?age > 30]",
+        "-threads <int>", &configInfo.mThreads,
+            "Number of threads to use for imports, templates, and json output, or 0 for one per core, default=1",
         "-set <cstring> ...", &settings,
             "Additional settings to apply to the config after reading",
+        "-prune <trace:cstring>", &tracePath,
+            "Remove members not on any of the paths listed in the given file, one per line, e.g., those read at runtime, and hidden (_name) members",
         "-names^", kFlagMembersOnly,
             "For an object, show only member names",
         "-indent <int>", &format.indent,
@@ -140,10 +292,22 @@ int main(int argc, const char* argv[])
             "Set whether to trim trailing zeroes from real numbers",
         "-strict^", kFlagJsonStrict,
             "Select output options for a strict json parser",
+        "-validate <schema:cstring>", &schemaPath,
+            "Check the config against the given schema file, listing any problems, rather than dumping it",
+        "-gen-struct <schema:cstring>", &genStructPath,
+            "Output a C++ header with structs for the given schema, and functions to load and save them from/to values",
         "-deps^", kFlagShowDeps,
             "List input file dependencies",
+        "-watch^", kFlagWatch,
+            "Keep running, and re-read the input files whenever any of them or their imports change",
         "-yaml^", kFlagYaml,
             "Output result as yaml rather than json",
+        "-gen-cpp <name:cstring>", &genCppName,
+            "Output result as C++ source for compiling in as constant data, accessed via 'HL::StaticValue name()'",
+        "-pack <path:cstring>", &packPath,
+            "Write result in compressed binary form to the given path, or - for stdout, for fast loading via ValuePack",
+        "-unpack^", kFlagUnpack,
+            "Input files are packed, as per -pack. A query starting with a member name loads only that member",
     #ifdef HL_LOG_H
         "-v^", kFlagVerbose,
             "Verbose output",
@@ -183,49 +347,146 @@ int main(int argc, const char* argv[])
     if (spec.Flag(kFlagJsonStrict))
         format = kJsonFormatStrict;
 
+    format.threads = configInfo.mThreads;
+
     String errors;
     int result = kResultOK;
 
-    for (const char* inputPath : inputPaths)
+    if (genStructPath)
     {
-        Value config;
+        ValueSchema structSchema;
+        String source;
 
-        if (size_i(inputPaths) > 1)
-            HL_LOG_I(Console, "%s:\n", inputPath);
+        if (!LoadSchema(genStructPath, &structSchema, &errors))
+            return kResultArgError;
 
-        String text;
-        ReadText(inputPath, &text);
+        if (!structSchema.GenerateStructs(&source, StructName(genStructPath).c_str(), &errors))
+        {
+            HL_LOG_E(Console, "%s: %s", genStructPath, errors.c_str());
+            return kResultConfigError;
+        }
+
+        fputs(source.c_str(), stdout);
+        return kResultOK;
+    }
+
+    ValueSchema schema;
+
+    if (schemaPath && !LoadSchema(schemaPath, &schema, &errors))
+        return kResultArgError;
 
-        if (LoadConfig(inputPath, &config, &errors, &configInfo))
+    std::vector<String> tracePaths;
+    std::vector<const char*> traceCStrs;
+
+    if (tracePath)
+    {
+        if (!LoadTrace(tracePath, &tracePaths))
+            return kResultArgError;
+
+        for (const String& path : tracePaths)
+            traceCStrs.push_back(path.c_str());
+    }
+
+    ConfigWatcher watcher;
+    bool watch = spec.Flag(kFlagWatch);
+    std::vector<String> changed;
+
+    do
+    {
+        if (!changed.empty())
         {
-            if (spec.Flag(kFlagShowDeps))
+            for (const String& path : changed)
+                fprintf(stderr, "%s changed\n", path.c_str());
+
+            changed.clear();
+            watcher.Clear();
+            result = kResultOK;
+        }
+
+        for (const char* inputPath : inputPaths)
+        {
+            Value config;
+
+            if (size_i(inputPaths) > 1)
+                HL_LOG_I(Console, "%s:\n", inputPath);
+
+            String text;
+            ReadText(inputPath, &text);
+
+            bool loaded;
+
+            if (spec.Flag(kFlagUnpack))
             {
-                HL_LOG_I(Console, "%s:", configInfo.mMain.c_str());
+                loaded = LoadPacked(inputPath, query, &config, &errors);
 
-                for (const String& import : configInfo.mImports)
-                    HL_LOG_I(Console, "     %s", import.c_str());
+                configInfo.mMain = inputPath;
+                configInfo.mImports.clear();
             }
             else
+                loaded = LoadConfig(inputPath, &config, &errors, &configInfo);
+
+            if (loaded)
             {
-                if (!ApplySettings(size_i(settings), settings.data(), &config, &errors))
+                if (spec.Flag(kFlagShowDeps))
                 {
-                    HL_LOG_E(Console, "Parse error in value: %s", errors.c_str());
-                    result = kResultConfigError;
-                }
+                    HL_LOG_I(Console, "%s:", configInfo.mMain.c_str());
 
-                if (!DumpConfig(config, query, spec.Flag(kFlagMembersOnly), spec.Flag(kFlagYaml), format))
-                    result = kResultIOError;
+                    for (const String& import : configInfo.mImports)
+                        HL_LOG_I(Console, "     %s", import.c_str());
+                }
+                else
+                {
+                    if (!ApplySettings(size_i(settings), settings.data(), &config, &errors))
+                    {
+                        HL_LOG_E(Console, "Parse error in value: %s", errors.c_str());
+                        result = kResultConfigError;
+                    }
+
+                    if (tracePath)
+                        PruneConfig(traceCStrs, &config);
+
+                    if (schemaPath)
+                    {
+                        if (schema.Validate(config, &errors))
+                            HL_LOG_I(Console, "%s is valid", inputPath);
+                        else
+                            result = kResultConfigError;
+                    }
+                    else if (genCppName)
+                    {
+                        String source;
+                        SaveAsCpp(&source, query ? MemberPath(config, query) : config, genCppName);
+                        fputs(source.c_str(), stdout);
+                    }
+                    else if (packPath)
+                    {
+                        const Value& packed = query ? MemberPath(config, query) : config;
+                        bool saved = strcmp(packPath, "-") == 0 ? SaveAsPacked(stdout, packed, &errors) : SaveAsPacked(packPath, packed, &errors);
+
+                        if (!saved)
+                            result = kResultIOError;
+                    }
+                    else if (!DumpConfig(config, query, spec.Flag(kFlagMembersOnly), spec.Flag(kFlagYaml), format))
+                        result = kResultIOError;
+                }
             }
+            else
+                result = kResultArgError;
+
+            // Watch whatever was found even on failure, so fixing the error triggers a re-read
+            if (watch && !watcher.Watch(configInfo, &errors))
+                watch = false;
         }
-        else
-            result = kResultArgError;
-    }
 
-    if (!errors.empty())
-    {
-        HL_LOG_E(Console, "%s", errors.c_str());
-        errors.clear();
+        if (!errors.empty())
+        {
+            HL_LOG_E(Console, "%s", errors.c_str());
+            errors.clear();
+        }
+
+        fflush(stdout);
     }
+    while (watch && watcher.Wait(-1.0, &changed));
 
     return result;
 }